@@ -1,8 +1,24 @@
+#define _GNU_SOURCE
 #include "GEDCOMutilities.h"
 #include "LinkedListAPI.h"
 #include <sys/stat.h>
 #include <ctype.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #ifdef __GNUC__
 #  define UNUSED(x) UNUSED_ ## x __attribute__((__unused__))
@@ -10,10 +26,28 @@
 #  define UNUSED(x) UNUSED_ ## x
 #endif
 
+// bytes a record occupies in the file it was parsed from; start is -1 for records built in memory
+typedef struct {
+	off_t start;
+	off_t end;
+} SourceRange;
+
+// the parsed file, used to copy unmodified records when the object is written back
+typedef struct {
+	char* path;
+	struct stat info;
+	SourceRange* otherRecords;
+	int otherRecordCount;
+	// how its lines end, so lines written next to copied records end the same way
+	char lineEnd[3];
+} SourceFile;
+
 typedef struct {
 	Individual individual;
 	char id[16];
 	List listOfFamiliesIds;
+	SourceRange source;
+	bool modified;
 } IndividualWithId;
 
 typedef struct {
@@ -22,89 +56,243 @@ typedef struct {
 	char* wifeId;
 	char* husbandId;
 	List childrenIds;
+	SourceRange source;
+	bool modified;
 } FamilyWithIds;
 
 typedef struct {
 	Header header;
 	char submitterId[16];
+	SourceFile* source;
 } HeaderWithSubmitterId;
 
 
-/////  Dyn Buffer implementation
+/////  String builder implementation
 
-typedef struct buffer
-{
-	char* str;
-	int allocated;
-	int length;
-} DynBuffer;
+#define STRING_BUILDER_MIN_SIZE 64
 
-void initDynBuffer(DynBuffer* buffer)
-{
-	buffer->str = malloc(buffer->allocated = 1024);
-	buffer->str[buffer->length = 0] = '\0';
+void initStringBuilder(StringBuilder* builder, size_t capacity) {
+	builder->allocated = capacity > STRING_BUILDER_MIN_SIZE ? capacity : STRING_BUILDER_MIN_SIZE;
+	builder->str = malloc(builder->allocated + 1);
+	builder->str[builder->length = 0] = '\0';
 }
 
-void deleteDynBuffer(DynBuffer* buffer)
-{
-	free(buffer->str);
-	buffer->str = 0;
-	buffer->length = 0;
+void deleteStringBuilder(StringBuilder* builder) {
+	free(builder->str);
+	builder->str = NULL;
+	builder->length = builder->allocated = 0;
 }
 
-void appendToDynBuffer(DynBuffer* buffer, const char* data)
-{
-	int len = strlen(data);
+// grows by doubling, so appending n bytes in pieces copies O(n) bytes in total
+void reserveStringBuilder(StringBuilder* builder, size_t extra) {
+	if (builder->length + extra <= builder->allocated) {
+		return;
+	}
+	size_t size = builder->allocated ? builder->allocated : STRING_BUILDER_MIN_SIZE;
+	while (size < builder->length + extra) {
+		size *= 2;
+	}
+	builder->str = realloc(builder->str, size + 1);
+	builder->allocated = size;
+}
 
-	if (len + buffer->length >= buffer->allocated)
-	{
-		// reallocate
-		int newSize = (len + buffer->length) | 0x400;
-		buffer->str = realloc(buffer->str, newSize);
-		buffer->allocated = newSize;
+void appendToBuilder(StringBuilder* builder, const char* data, size_t len) {
+	reserveStringBuilder(builder, len);
+	memcpy(builder->str + builder->length, data, len);
+	builder->length += len;
+	builder->str[builder->length] = '\0';
+}
+
+void appendStringToBuilder(StringBuilder* builder, const char* str) {
+	appendToBuilder(builder, str, strlen(str));
+}
+
+void appendCharToBuilder(StringBuilder* builder, char c) {
+	if (builder->length == builder->allocated) {
+		reserveStringBuilder(builder, 1);
 	}
-	strncat(buffer->str, data, buffer->allocated - len);
+	builder->str[builder->length++] = c;
+	builder->str[builder->length] = '\0';
 }
 
-int growDynBuffer(DynBuffer* buffer)
-{
-	buffer->allocated += 1024;
-	buffer->str = realloc(buffer->str, buffer->allocated);
-	return buffer->allocated;
+// writes the decimal digits of number so they end at end; returns where they start
+char* formatDigits(char* end, unsigned long long number) {
+	do {
+		*--end = (char)('0' + number % 10);
+		number /= 10;
+	} while (number);
+	return end;
 }
 
-int appendIntends(DynBuffer* buffer, int count);
+void appendIntToBuilder(StringBuilder* builder, long long value) {
+	char digits[24];
+	char* end = digits + sizeof(digits);
+	// negate as unsigned, so LLONG_MIN works too
+	char* start = formatDigits(end, value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value);
+	if (value < 0) {
+		*--start = '-';
+	}
+	appendToBuilder(builder, start, end - start);
+}
 
-int sprintfDyn(DynBuffer* buffer, int intends, const char* format, ...)
-{
-	int res;
-	if (intends)
-	{
-		appendIntends(buffer, intends);
+// writes value with the given decimals so it ends at end, which needs 48 bytes before it; returns where it starts,
+// or NULL for what the integer path can not represent
+char* formatFixed(char* end, double value, int decimals) {
+	if (decimals > 9 || !(value > -1e18 && value < 1e18)) {
+		return NULL;
+	}
+	unsigned long long scale = 1;
+	for (int i = 0; i < decimals; i++) {
+		scale *= 10;
+	}
+	bool negative = value < 0;
+	double magnitude = negative ? -value : value;
+	unsigned long long whole = (unsigned long long)magnitude;
+	unsigned long long fraction = (unsigned long long)((magnitude - whole) * scale + 0.5);
+	if (fraction >= scale) {
+		whole++;
+		fraction -= scale;
+	}
+	char* start = end;
+	if (decimals) {
+		start = formatDigits(end, fraction);
+		while (end - start < decimals) {
+			*--start = '0';
+		}
+		*--start = '.';
+	}
+	start = formatDigits(start, whole);
+	if (negative) {
+		*--start = '-';
+	}
+	return start;
+}
+
+void appendFloatToBuilder(StringBuilder* builder, double value, int decimals) {
+	if (decimals < 0) {
+		decimals = 0;
+	}
+	char digits[48];
+	char* end = digits + sizeof(digits);
+	char* start = formatFixed(end, value, decimals);
+	if (!start) {
+		sprintfBuilder(builder, "%.*f", decimals, value);
+		return;
 	}
+	appendToBuilder(builder, start, end - start);
+}
 
-	int rest = buffer->allocated - buffer->length;
+int sprintfBuilder(StringBuilder* builder, const char* format, ...) {
 	va_list args;
 	va_start(args, format);
-
-	while ((res = vsnprintf(buffer->str + buffer->length, rest, format, args)) >= rest)
-	{
-		rest = growDynBuffer(buffer) - buffer->length;
+	size_t rest = builder->allocated - builder->length + 1;
+	// a va_list can be used only once, so the first attempt gets a copy
+	va_list attempt;
+	va_copy(attempt, args);
+	int res = vsnprintf(builder->str + builder->length, rest, format, attempt);
+	va_end(attempt);
+	if (res >= 0 && (size_t)res >= rest) {
+		reserveStringBuilder(builder, res);
+		res = vsnprintf(builder->str + builder->length, res + 1, format, args);
+	}
+	va_end(args);
+	if (res > 0) {
+		builder->length += res;
+	} else {
+		builder->str[builder->length] = '\0';
 	}
-	buffer->length += res;
-	return res + intends;
+	return res;
 }
 
-int appendIntends(DynBuffer* buffer, int count)
-{
-	char* buf = malloc(count + 1);
-	memset(buf, '\t', count);
-	buf[count] = '\0';
-	int res = sprintfDyn(buffer, 0, "%s", buf);
-	free(buf);
+char* takeBuilderString(StringBuilder* builder) {
+	char* res = builder->str;
+	builder->str = NULL;
+	builder->length = builder->allocated = 0;
 	return res;
 }
 
+/////// Pointer map implementation
+
+// open addressing map from record pointer to int, used where a List lookup would be too slow
+typedef struct {
+    const void** keys;
+    int* values;
+    int capacity;
+    int count;
+} PointerMap;
+
+void initPointerMap(PointerMap* map, int expected) {
+    map->capacity = 16;
+    while (map->capacity < expected * 2) {
+        map->capacity <<= 1;
+    }
+    map->keys = calloc(map->capacity, sizeof(void*));
+    map->values = malloc(map->capacity * sizeof(int));
+    map->count = 0;
+}
+
+void deletePointerMap(PointerMap* map) {
+    free(map->keys);
+    free(map->values);
+    map->keys = NULL;
+    map->values = NULL;
+    map->capacity = map->count = 0;
+}
+
+int pointerHash(const void* key, int capacity) {
+    uint64_t h = (uint64_t)(uintptr_t)key;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (int)(h & (uint64_t)(capacity - 1));
+}
+
+void putPointer(PointerMap* map, const void* key, int value);
+
+void growPointerMap(PointerMap* map) {
+    const void** oldKeys = map->keys;
+    int* oldValues = map->values;
+    int oldCapacity = map->capacity;
+    map->capacity <<= 1;
+    map->keys = calloc(map->capacity, sizeof(void*));
+    map->values = malloc(map->capacity * sizeof(int));
+    map->count = 0;
+    for (int i = 0; i < oldCapacity; i++) {
+        if (oldKeys[i]) {
+            putPointer(map, oldKeys[i], oldValues[i]);
+        }
+    }
+    free(oldKeys);
+    free(oldValues);
+}
+
+void putPointer(PointerMap* map, const void* key, int value) {
+    if ((map->count + 1) * 2 > map->capacity) {
+        growPointerMap(map);
+    }
+    int pos = pointerHash(key, map->capacity);
+    while (map->keys[pos] && map->keys[pos] != key) {
+        pos = (pos + 1) & (map->capacity - 1);
+    }
+    if (!map->keys[pos]) {
+        map->keys[pos] = key;
+        map->count++;
+    }
+    map->values[pos] = value;
+}
+
+// returns -1 if key is not in the map
+int getPointer(const PointerMap* map, const void* key) {
+    int pos = pointerHash(key, map->capacity);
+    while (map->keys[pos]) {
+        if (map->keys[pos] == key) {
+            return map->values[pos];
+        }
+        pos = (pos + 1) & (map->capacity - 1);
+    }
+    return -1;
+}
+
 ///////// parsing functions ///////////////
 
 char* readLine(char* content, char** res)
@@ -189,7 +377,7 @@ GEDCOMerror readFileToMemory(char* fileName, char** buffer)
 		return createError(INV_FILE, -1);
 	}
 
-	int filesize = st.st_size;
+	size_t filesize = st.st_size;
 	FILE* fl = fopen(fileName, "rb");
 
 	if (!fl)
@@ -199,10 +387,11 @@ GEDCOMerror readFileToMemory(char* fileName, char** buffer)
 
 	*buffer = malloc(filesize + 1);
 
-    if (filesize != (int)fread(*buffer, 1, filesize, fl))
+    if (!*buffer || filesize != fread(*buffer, 1, filesize, fl))
 	{
 		free(*buffer);
 		*buffer = NULL;
+		fclose(fl);
 		return createError(INV_FILE, -1);
 	}
 
@@ -211,6 +400,364 @@ GEDCOMerror readFileToMemory(char* fileName, char** buffer)
 	return createError(OK, 0);
 }
 
+/////// line input
+
+// true for names ending in .gz, which are read and written through zlib
+bool isCompressedName(const char* fileName) {
+	size_t len = strlen(fileName);
+	return len > 3 && !strcmp(fileName + len - 3, ".gz");
+}
+
+#define INPUT_CHUNK_SIZE (1 << 20)
+#define MAX_QUEUED_CHUNKS 4
+
+// decompressed text handed from the reading thread to the parser; chunks end at a line end
+typedef struct inputChunk {
+	char* data;
+	struct inputChunk* next;
+} InputChunk;
+
+// the parser's view of a file: a plain file is one chunk in memory, a compressed one
+// is decompressed by a second thread while the parser works on the previous chunks
+typedef struct {
+	char* data;
+	char* position;
+	// the terminator of data
+	char* end;
+	off_t offset;
+	off_t nextOffset;
+	bool compressed;
+#ifdef HAVE_ZLIB
+	gzFile file;
+	pthread_t reader;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	InputChunk* first;
+	InputChunk* last;
+	int queued;
+	int maxQueued;
+	bool finished;
+	bool failed;
+	bool stop;
+#endif
+} LineInput;
+
+#ifdef HAVE_ZLIB
+// returns false if the parser has stopped reading
+bool queueInputChunk(LineInput* input, char* data) {
+	InputChunk* chunk = malloc(sizeof(InputChunk));
+	chunk->data = data;
+	chunk->next = NULL;
+	pthread_mutex_lock(&input->lock);
+	while (input->queued >= input->maxQueued && !input->stop) {
+		pthread_cond_wait(&input->changed, &input->lock);
+	}
+	bool stop = input->stop;
+	if (!stop) {
+		if (input->last) {
+			input->last->next = chunk;
+		} else {
+			input->first = chunk;
+		}
+		input->last = chunk;
+		input->queued++;
+		pthread_cond_broadcast(&input->changed);
+	}
+	pthread_mutex_unlock(&input->lock);
+	if (stop) {
+		free(data);
+		free(chunk);
+	}
+	return !stop;
+}
+
+void* readCompressedInput(void* arg) {
+	LineInput* input = (LineInput*)arg;
+	size_t capacity = INPUT_CHUNK_SIZE;
+	size_t length = 0;
+	char* buffer = malloc(capacity + 1);
+	bool failed = false;
+	for (;;) {
+		int read = gzread(input->file, buffer + length, capacity - length);
+		if (read < 0) {
+			failed = true;
+			break;
+		}
+		length += read;
+		if (!read) {
+			// a truncated file ends without an error from gzread
+			int error;
+			gzerror(input->file, &error);
+			failed = error != Z_OK;
+			break;
+		}
+		// hand over the complete lines and keep the rest for the next chunk
+		size_t cut = length;
+		for (; cut && buffer[cut - 1] != '\n' && buffer[cut - 1] != '\r'; cut--);
+		if (!cut) {
+			if (length == capacity) {
+				capacity *= 2;
+				buffer = realloc(buffer, capacity + 1);
+			}
+			continue;
+		}
+		char* rest = malloc(capacity + 1);
+		memcpy(rest, buffer + cut, length - cut);
+		buffer[cut] = '\0';
+		if (!queueInputChunk(input, buffer)) {
+			buffer = rest;
+			length = 0;
+			break;
+		}
+		buffer = rest;
+		length -= cut;
+	}
+	if (length && !failed) {
+		buffer[length] = '\0';
+		queueInputChunk(input, buffer);
+	} else {
+		free(buffer);
+	}
+	pthread_mutex_lock(&input->lock);
+	input->finished = true;
+	input->failed = failed;
+	pthread_cond_broadcast(&input->changed);
+	pthread_mutex_unlock(&input->lock);
+	return NULL;
+}
+#endif
+
+GEDCOMerror openLineInput(LineInput* input, char* fileName) {
+	input->data = NULL;
+	input->offset = input->nextOffset = 0;
+	input->compressed = isCompressedName(fileName);
+	if (!input->compressed) {
+		GEDCOMerror res = readFileToMemory(fileName, &input->data);
+		input->position = input->data;
+		input->end = input->data ? input->data + strlen(input->data) : NULL;
+		return res;
+	}
+#ifdef HAVE_ZLIB
+	input->file = gzopen(fileName, "rb");
+	if (!input->file) {
+		return createError(INV_FILE, -1);
+	}
+	gzbuffer(input->file, 1 << 16);
+	pthread_mutex_init(&input->lock, NULL);
+	pthread_cond_init(&input->changed, NULL);
+	input->first = input->last = NULL;
+	input->queued = 0;
+	input->maxQueued = MAX_QUEUED_CHUNKS;
+	input->finished = input->failed = input->stop = false;
+	input->data = malloc(1);
+	input->data[0] = '\0';
+	input->position = input->end = input->data;
+	if (pthread_create(&input->reader, NULL, &readCompressedInput, input)) {
+		// read everything on this thread instead
+		input->maxQueued = INT_MAX;
+		readCompressedInput(input);
+		input->reader = pthread_self();
+	}
+	return createError(OK, 0);
+#else
+	return createError(INV_FILE, -1);
+#endif
+}
+
+// moves to the next chunk; false at the end of the input
+bool nextInputChunk(LineInput* input) {
+#ifdef HAVE_ZLIB
+	if (!input->compressed) {
+		return false;
+	}
+	pthread_mutex_lock(&input->lock);
+	while (!input->first && !input->finished) {
+		pthread_cond_wait(&input->changed, &input->lock);
+	}
+	InputChunk* chunk = input->first;
+	if (chunk) {
+		input->first = chunk->next;
+		if (!input->first) {
+			input->last = NULL;
+		}
+		input->queued--;
+		pthread_cond_broadcast(&input->changed);
+	}
+	pthread_mutex_unlock(&input->lock);
+	if (!chunk) {
+		return false;
+	}
+	free(input->data);
+	input->data = chunk->data;
+	free(chunk);
+	input->offset = input->nextOffset;
+	input->end = input->data + strlen(input->data);
+	input->nextOffset += input->end - input->data;
+	// line ends split between two chunks
+	input->position = input->data;
+	while (*input->position == '\r' || *input->position == '\n') {
+		input->position++;
+	}
+	return true;
+#else
+	(void)input;
+	return false;
+#endif
+}
+
+// reads the next line into a newly allocated string; lineStart is its offset in the (decompressed) input
+bool nextInputLine(LineInput* input, char** line, off_t* lineStart) {
+	while (!*input->position) {
+		if (!nextInputChunk(input)) {
+			return false;
+		}
+	}
+	*lineStart = input->offset + (input->position - input->data);
+	input->position = readLine(input->position, line);
+	return true;
+}
+
+// the next line without copying it; false at the end of the input
+bool peekInputLine(LineInput* input, const char** start, const char** end) {
+	while (!*input->position) {
+		if (!nextInputChunk(input)) {
+			return false;
+		}
+	}
+	const char* lineEnd = input->position;
+	for (; *lineEnd && *lineEnd != '\n' && *lineEnd != '\r'; lineEnd++);
+	*start = input->position;
+	*end = lineEnd;
+	return true;
+}
+
+// moves past a line returned by peekInputLine
+void skipInputLine(LineInput* input, const char* end) {
+	for (; *end == '\r' || *end == '\n'; end++);
+	input->position = (char*)end;
+}
+
+bool lineInputFailed(LineInput* input) {
+#ifdef HAVE_ZLIB
+	if (input->compressed) {
+		pthread_mutex_lock(&input->lock);
+		bool failed = input->failed;
+		pthread_mutex_unlock(&input->lock);
+		return failed;
+	}
+#endif
+	(void)input;
+	return false;
+}
+
+void closeLineInput(LineInput* input) {
+#ifdef HAVE_ZLIB
+	if (input->compressed && input->data) {
+		// the parser may stop before the end of the file
+		pthread_mutex_lock(&input->lock);
+		input->stop = true;
+		pthread_cond_broadcast(&input->changed);
+		pthread_mutex_unlock(&input->lock);
+		if (!pthread_equal(input->reader, pthread_self())) {
+			pthread_join(input->reader, NULL);
+		}
+		while (input->first) {
+			InputChunk* chunk = input->first;
+			input->first = chunk->next;
+			free(chunk->data);
+			free(chunk);
+		}
+		gzclose(input->file);
+		pthread_mutex_destroy(&input->lock);
+		pthread_cond_destroy(&input->changed);
+	}
+#endif
+	free(input->data);
+	input->data = NULL;
+}
+
+// true if the text from word to wordEnd is text
+bool wordIs(const char* word, const char* wordEnd, const char* text) {
+	size_t len = strlen(text);
+	return (size_t)(wordEnd - word) == len && !memcmp(word, text, len);
+}
+
+// end of the line at pos: the first '\n' or '\r', or end
+const char* findLineEnd(const char* pos, const char* end) {
+	for (; pos < end && *pos != '\n' && *pos != '\r'; pos++);
+	return pos;
+}
+
+// start of the first line after pos that begins with "0 " (a level 0 record), or end;
+// pos must be at a line end or inside a line
+const char* findLevelZeroLine(const char* pos, const char* end) {
+#ifdef __SSE2__
+	// a line end, '0' and ' ' at three consecutive positions, 16 candidates at a time
+	const __m128i newline = _mm_set1_epi8('\n');
+	const __m128i carriage = _mm_set1_epi8('\r');
+	const __m128i zero = _mm_set1_epi8('0');
+	const __m128i space = _mm_set1_epi8(' ');
+	for (; end - pos >= 18; pos += 16) {
+		__m128i first = _mm_loadu_si128((const __m128i*)pos);
+		__m128i second = _mm_loadu_si128((const __m128i*)(pos + 1));
+		__m128i third = _mm_loadu_si128((const __m128i*)(pos + 2));
+		__m128i lineEnd = _mm_or_si128(_mm_cmpeq_epi8(first, newline), _mm_cmpeq_epi8(first, carriage));
+		__m128i hit = _mm_and_si128(lineEnd, _mm_and_si128(_mm_cmpeq_epi8(second, zero), _mm_cmpeq_epi8(third, space)));
+		int mask = _mm_movemask_epi8(hit);
+		if (mask) {
+			return pos + __builtin_ctz(mask) + 1;
+		}
+	}
+#endif
+	for (; end - pos >= 3; pos++) {
+		if ((*pos == '\n' || *pos == '\r') && pos[1] == '0' && pos[2] == ' ') {
+			return pos + 1;
+		}
+	}
+	return end;
+}
+
+// the number of lines that end between pos and end, where end is readable and starts a line or the terminator.
+// Like readLine, a run of line end characters ends one line
+int countLines(const char* pos, const char* end) {
+	int lines = 0;
+#ifdef __SSE2__
+	// a line end followed by anything else, 16 positions at a time
+	const __m128i newline = _mm_set1_epi8('\n');
+	const __m128i carriage = _mm_set1_epi8('\r');
+	for (; end - pos >= 16; pos += 16) {
+		__m128i current = _mm_loadu_si128((const __m128i*)pos);
+		__m128i following = _mm_loadu_si128((const __m128i*)(pos + 1));
+		int ends = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(current, newline), _mm_cmpeq_epi8(current, carriage)));
+		int continued = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(following, newline), _mm_cmpeq_epi8(following, carriage)));
+		lines += __builtin_popcount(ends & ~continued);
+	}
+#endif
+	for (; pos < end; pos++) {
+		lines += (*pos == '\n' || *pos == '\r') && pos[1] != '\n' && pos[1] != '\r';
+	}
+	return lines;
+}
+
+// moves past the lines of a record after its level 0 line, up to the next level 0 line, without reading them;
+// returns the number of lines skipped
+int skipInputRecord(LineInput* input) {
+	int lines = 0;
+	for (;;) {
+		const char* pos = input->position;
+		const char* next = pos;
+		if (next < input->end && !(next[0] == '0' && next[1] == ' ')) {
+			next = findLevelZeroLine(next, input->end);
+		}
+		lines += countLines(pos, next);
+		input->position = (char*)next;
+		// chunks end at a line end, so the next one starts with a new line
+		if (next < input->end || !nextInputChunk(input)) {
+			return lines;
+		}
+	}
+}
+
 int comparePointers(const void* data1, const void* data2)
 {
 	if (data1 == data2)
@@ -228,29 +775,84 @@ void doNotDelete(void* UNUSED(obj)) {
 	// if we keep reference without owning
 }
 
-char* printIndividual(void* obj) {
-	IndividualWithId* indi = (IndividualWithId*)obj;
-	DynBuffer buffer;
-	initDynBuffer(&buffer);
-	sprintfDyn(&buffer, 0, "Given name: %s\n", indi->individual.givenName);
-	sprintfDyn(&buffer, 0, "Surname: %s\n", indi->individual.surname);
-	// events:
-	sprintfDyn(&buffer, 0, "Events: \n");
-	ListIterator iter = createIterator(indi->individual.events);
+// %s-style text: NULL shows as (null)
+void appendValue(StringBuilder* builder, const char* value) {
+	appendStringToBuilder(builder, value ? value : "(null)");
+}
+
+// one "- tag: value" line per field
+void appendFieldLines(StringBuilder* builder, List fields) {
+	ListIterator iter = createIterator(fields);
 	for (void* data = nextElement(&iter); data; data = nextElement(&iter))
 	{
-		Event* event = (Event*)data;
-		char* buf = printEvent(event);
-		sprintfDyn(&buffer, 0, "%s\n", buf);
-		free(buf);
+		Field* field = (Field*)data;
+		appendStringToBuilder(builder, "- ");
+		appendValue(builder, field->tag);
+		appendStringToBuilder(builder, ": ");
+		appendValue(builder, field->value);
+		appendCharToBuilder(builder, '\n');
+	}
+}
+
+void appendField(StringBuilder* builder, const Field* field) {
+	appendValue(builder, field->tag);
+	appendStringToBuilder(builder, " = ");
+	appendValue(builder, field->value);
+}
+
+void appendEvent(StringBuilder* builder, const Event* event) {
+	appendStringToBuilder(builder, "type = ");
+	appendStringToBuilder(builder, event->type);
+	appendCharToBuilder(builder, '\n');
+	if (event->date) {
+		appendStringToBuilder(builder, "date = ");
+		appendStringToBuilder(builder, event->date);
+		appendCharToBuilder(builder, '\n');
+	}
+	if (event->place) {
+		appendStringToBuilder(builder, "place = ");
+		appendStringToBuilder(builder, event->place);
+		appendCharToBuilder(builder, '\n');
 	}
+	appendFieldLines(builder, event->otherFields);
+}
 
-	iter = createIterator(indi->individual.otherFields);
+void appendIndividual(StringBuilder* builder, const Individual* individual) {
+	appendStringToBuilder(builder, "Given name: ");
+	appendValue(builder, individual->givenName);
+	appendStringToBuilder(builder, "\nSurname: ");
+	appendValue(builder, individual->surname);
+	appendStringToBuilder(builder, "\nEvents: \n");
+	ListIterator iter = createIterator(individual->events);
 	for (void* data = nextElement(&iter); data; data = nextElement(&iter))
 	{
-		Field* field = (Field*)data;
-		sprintfDyn(&buffer, 0, "- %s: %s\n", field->tag, field->value);
+		appendEvent(builder, (Event*)data);
+		appendCharToBuilder(builder, '\n');
+	}
+	appendFieldLines(builder, individual->otherFields);
+}
+
+// "<role> - given surname" for a spouse that is set
+void appendSpouse(StringBuilder* builder, const char* role, const Individual* spouse) {
+	if (spouse) {
+		appendStringToBuilder(builder, role);
+		appendStringToBuilder(builder, " - ");
+		appendValue(builder, spouse->givenName);
+		appendCharToBuilder(builder, ' ');
+		appendValue(builder, spouse->surname);
+		appendCharToBuilder(builder, '\n');
 	}
+}
+
+void appendFamily(StringBuilder* builder, const Family* family) {
+	appendSpouse(builder, "husband", family->husband);
+	appendSpouse(builder, "wife", family->wife);
+}
+
+char* printIndividual(void* obj) {
+	StringBuilder buffer;
+	initStringBuilder(&buffer, 0);
+	appendIndividual(&buffer, (Individual*)obj);
 	return buffer.str;
 }
 
@@ -270,15 +872,9 @@ int compareIndividuals(const void* obj1, const void* obj2) {
 }
 
 char* printFamily(void* obj) {
-	FamilyWithIds* family = (FamilyWithIds*)obj;
-	DynBuffer buffer;
-	initDynBuffer(&buffer);
-	if (family->family.husband) {
-		sprintfDyn(&buffer, 0, "husband - %s %s\n", family->family.husband->givenName, family->family.husband->surname);
-	}
-	if (family->family.wife) {
-		sprintfDyn(&buffer, 0, "wife - %s %s\n", family->family.wife->givenName, family->family.wife->surname);
-	}
+	StringBuilder buffer;
+	initStringBuilder(&buffer, 0);
+	appendFamily(&buffer, (Family*)obj);
 	return buffer.str;
 }
 
@@ -298,9 +894,9 @@ int compareFamilies(const void* obj1, const void* obj2) {
 }
 
 char* printId(void* obj) {
-	DynBuffer buffer;
-	initDynBuffer(&buffer);
-	sprintfDyn(&buffer, 0, "%s", obj);
+	StringBuilder buffer;
+	initStringBuilder(&buffer, 0);
+	appendStringToBuilder(&buffer, (char*)obj);
 	return buffer.str;
 }
 
@@ -313,10 +909,9 @@ int compareId(const void* obj1, const void* obj2) {
 }
 
 char* printField(void* obj) {
-	Field* field = (Field*)obj;
-	DynBuffer buffer;
-	initDynBuffer(&buffer);
-	sprintfDyn(&buffer, 0, "%s = %s", field->tag, field->value);
+	StringBuilder buffer;
+	initStringBuilder(&buffer, 0);
+	appendField(&buffer, (Field*)obj);
 	return buffer.str;
 }
 
@@ -332,22 +927,9 @@ int compareFields(const void* obj1, const void* obj2) {
 }
 
 char* printEvent(void* obj) {
-	Event* event = (Event*)obj;
-	DynBuffer buffer;
-	initDynBuffer(&buffer);
-	sprintfDyn(&buffer, 0, "type = %s\n", event->type);
-	if (event->date) {
-		sprintfDyn(&buffer, 0, "date = %s\n", event->date);
-	}
-	if (event->place) {
-		sprintfDyn(&buffer, 0, "place = %s\n", event->place);
-	}
-	ListIterator iter = createIterator(event->otherFields);
-	for (void* data = nextElement(&iter); data; data = nextElement(&iter))
-	{
-		Field* field = (Field*)data;
-		sprintfDyn(&buffer, 0, "- %s: %s\n", field->tag, field->value);
-	}
+	StringBuilder buffer;
+	initStringBuilder(&buffer, 0);
+	appendEvent(&buffer, (Event*)obj);
 	return buffer.str;
 }
 
@@ -405,7 +987,7 @@ void initHeader(Header* header) {
 
 GEDCOMerror SkipAllReceiver(void* UNUSED(receiver), char* UNUSED(line), void* newScope) {
 	ParserScope* targetScope = (ParserScope*)newScope;
-	targetScope->receiver = &SkipAllReceiver;
+	targetScope->enter = &SkipAllReceiver;
 	return createError(OK, 0);
 }
 
@@ -439,6 +1021,7 @@ GEDCOMerror parseAsField(List* list, char* line, int errCode) {
 	if (!word1) {
 		return createError(errCode, 0);
 	}
+	end = skipSpaces(end);
 
 	int valueSize = strlen(end);
 	char* value = malloc(valueSize + 1);
@@ -548,6 +1131,10 @@ void parseNames(char* line, char** givenName, char** surname) {
 			else
 			{
 				int len = strlen(*surname);
+				// a lone "/" has no slashes to strip
+				if (len < 2) {
+					len = 2;
+				}
 				char* newSurname = malloc(len - 1);
 				strncpy(newSurname, (*surname) + 1, len - 2);
 				newSurname[len - 2] = 0;
@@ -581,22 +1168,25 @@ GEDCOMerror EnterEvent(void* receiver, char* line, void* newScope) {
 	char* end = getWord(line, 1, &word1);
 	while (isspace(*end)) end++;
 	int len = strlen(end);
-	while (end[len - 1] == '\r' || end[len - 1] == '\n') len--;
-	char* value = malloc(len + 1);
-	strncpy(value, end, len);
-	value[len] = 0;
+	while (len > 0 && (end[len - 1] == '\r' || end[len - 1] == '\n')) len--;
 
 	if (!word1) {
 		return createError(INV_RECORD, 0);
 	}
+	char* value = malloc(len + 1);
+	strncpy(value, end, len);
+	value[len] = 0;
 
 	if (!strcmp(word1, "TYPE")) {
 		strncpy(obj->type, word1, sizeof(obj->type));
 		free(word1);
+		free(value);
 	} else if (!strcmp(word1, "PLAC")) {
+		free(obj->place);
 		obj->place = value;
 		free(word1);
 	} else if (!strcmp(word1, "DATE")) {
+		free(obj->date);
 		obj->date = value;
 		free(word1);
 	}
@@ -625,6 +1215,10 @@ GEDCOMerror IndiEnter(void* receiver, char* line, void* newScope) {
 	GEDCOMerror res = createError(OK, 0);
 
 	if (!strcmp(word1, "NAME")) {
+		// a later NAME line replaces the earlier one
+		free(obj->individual.givenName);
+		free(obj->individual.surname);
+		obj->individual.surname = NULL;
 		parseNames(line, &obj->individual.givenName, &obj->individual.surname);
 	} else if (!strcmp(word1, "FAMS") || !strcmp(word1, "FAMC")) {
 		char* familyId = NULL;
@@ -639,6 +1233,7 @@ GEDCOMerror IndiEnter(void* receiver, char* line, void* newScope) {
 		Event* event = malloc(sizeof(Event));
 		memset(event, 0, sizeof(Event));
 		strncpy(event->type, word1, sizeof(event->type));
+		event->otherFields = initializeList(&printField, &deleteField, &compareFields);
 		insertBack(&obj->individual.events, event);
 		targetScope->receiver = event;
 		targetScope->enter = &EnterEvent;
@@ -663,12 +1258,14 @@ GEDCOMerror FamilyEnter(void* receiver, char* line, void* newScope) {
 	}
 	GEDCOMerror res = createError(OK, 0);
 	if (!strcmp(word1, "HUSB")) {
+		free(obj->husbandId);
 		getWord(line, 2, &obj->husbandId);
 		if (!obj->husbandId) {
 			res = createError(INV_RECORD, 0);
 			goto clearAndReturn;
 		}
 	} else if (!strcmp(word1, "WIFE")) {
+		free(obj->wifeId);
 		getWord(line, 2, &obj->wifeId);
 		if (!obj->wifeId) {
 			res = createError(INV_RECORD, 0);
@@ -686,6 +1283,7 @@ GEDCOMerror FamilyEnter(void* receiver, char* line, void* newScope) {
 		Event* event = malloc(sizeof(Event));
 		memset(event, 0, sizeof(Event));
 		strncpy(event->type, word1, sizeof(event->type));
+		event->otherFields = initializeList(&printField, &deleteField, &compareFields);
 		insertBack(&obj->family.events, event);
 		targetScope->receiver = event;
 		targetScope->enter = &EnterEvent;
@@ -708,6 +1306,7 @@ GEDCOMerror SubmitterAddressReceiver(void* receiver, char* line, void* newScope)
 	if (!word1) {
 		return createError(INV_RECORD, 0);
 	}
+	end = skipSpaces(end);
 	int valueSize = strlen(end);
 	char* value = malloc(valueSize + 1);
 	strncpy(value, end, valueSize);
@@ -757,6 +1356,7 @@ GEDCOMerror EnterSubmitter(void* receiver, char* line, void* newScope) {
 		2 CONT Address Line 4
 		2 CTRY Country
 		*/
+		end = skipSpaces(end);
 		int valueSize = strlen(end);
 		char* value = malloc(valueSize + 1);
 		strncpy(value, end, valueSize);
@@ -783,6 +1383,11 @@ clearAndReturn:
 	return res;
 }
 
+// source, version and encoding are required before the first record after the header
+bool headerIsComplete(const Header* header) {
+	return header->source[0] && header->gedcVersion != 0.0f && (int)header->encoding >= 0;
+}
+
 GEDCOMerror GEDCOMobjectEnter(void* receiver, char* line, void* newScope) {
 	ParserScope* targetScope = (ParserScope*)newScope;
 	GEDCOMobject* obj = (GEDCOMobject*)receiver;
@@ -795,10 +1400,13 @@ GEDCOMerror GEDCOMobjectEnter(void* receiver, char* line, void* newScope) {
 	}
 
 	GEDCOMerror res = createError(OK, 0);
+	// records we do not support are skipped with all their lines
+	targetScope->enter = &SkipAllReceiver;
 	if (!strcmp(word, "HEAD")) {
 		// initialize header
 		obj->header = malloc(sizeof(HeaderWithSubmitterId));
 		((HeaderWithSubmitterId*)obj->header)->submitterId[0] = '\0';
+		((HeaderWithSubmitterId*)obj->header)->source = NULL;
 		initHeader(obj->header);
 		targetScope->receiver = obj->header;
 		targetScope->enter = &HeaderEnter;
@@ -810,13 +1418,18 @@ GEDCOMerror GEDCOMobjectEnter(void* receiver, char* line, void* newScope) {
 		goto clearAndReturn;
 	}
 
-	if (!obj->header->source[0] || obj->header->gedcVersion == 0.0f || ((int)obj->header->encoding < 0)) { 
+	if (!headerIsComplete(obj->header)) {
 		res = createError(INV_HEADER, -1);
 		goto clearAndReturn;
 	} 
 	// there must be second word
 	getWord(line, 2, &word2);
 
+	if (!word2) {
+		res = createError(INV_GEDCOM, 0);
+		goto clearAndReturn;
+	}
+
 	if (!strcmp(word2, "INDI")) {
 		// process individual
 		IndividualWithId* indi = malloc(sizeof(IndividualWithId));
@@ -824,7 +1437,11 @@ GEDCOMerror GEDCOMobjectEnter(void* receiver, char* line, void* newScope) {
 		indi->individual.families = initializeList(&printFamily, &doNotDelete, &compareFamilies);
 		indi->individual.otherFields = initializeList(&printField, &deleteField, &compareFields);
 		indi->individual.events = initializeList(&printEvent, &deleteEvent, &compareEvents);
+		indi->individual.givenName = NULL;
+		indi->individual.surname = NULL;
 		strncpy(indi->id, word, sizeof(indi->id));
+		indi->source.start = indi->source.end = -1;
+		indi->modified = false;
 		insertBack(&obj->individuals, indi);
 		targetScope->receiver = indi;
 		targetScope->enter = &IndiEnter;
@@ -840,26 +1457,32 @@ GEDCOMerror GEDCOMobjectEnter(void* receiver, char* line, void* newScope) {
 		family->childrenIds = initializeList(&printId, &deleteId, &compareId);
 		family->family.events = initializeList(&printEvent, &deleteEvent, &compareEvents);
 		strncpy(family->id, word, sizeof(family->id));
+		family->source.start = family->source.end = -1;
+		family->modified = false;
 		insertBack(&obj->families, family);
 		targetScope->receiver = family;
 		targetScope->enter = &FamilyEnter;
 	}
 	if (!strcmp(word2, "SUBM")) {
+		bool named = !strcmp(word, ((HeaderWithSubmitterId*)obj->header)->submitterId);
+		// one submitter is kept: the one the header names, otherwise the first; other SUBM records are skipped
+		if (obj->submitter && (!named || obj->header->submitter)) {
+			goto clearAndReturn;
+		}
+		if (obj->submitter) {
+			clearList(&obj->submitter->otherFields);
+			free(obj->submitter);
+		}
 		obj->submitter = malloc(sizeof(Submitter) + 1);
 		obj->submitter->otherFields = initializeList(&printField, &deleteField, &compareFields);
 		obj->submitter->address[0] = 0;
 		targetScope->receiver = obj;
 		targetScope->enter = &EnterSubmitter;
-		if (!strcmp(word, ((HeaderWithSubmitterId*)obj->header)->submitterId)) {
+		if (named) {
 			obj->header->submitter = obj->submitter;
 		}
 	}
 
-	if (!word2) {
-		res = createError(INV_GEDCOM, 0);
-		goto clearAndReturn;
-	}
-
 clearAndReturn:
 	free(word);
 	if (word2) {
@@ -868,6 +1491,37 @@ clearAndReturn:
 	return res;
 }
 
+// remembers the parsed file so writeGEDCOM can copy unmodified records from it
+void attachSourceFile(GEDCOMobject* obj, const char* fileName, const char* text, SourceRange* otherRecords, int otherRecordCount) {
+	SourceFile* source = malloc(sizeof(SourceFile));
+	source->path = realpath(fileName, NULL);
+	if (!source->path || stat(source->path, &source->info)) {
+		free(source->path);
+		free(source);
+		free(otherRecords);
+		return;
+	}
+	source->otherRecords = otherRecords;
+	source->otherRecordCount = otherRecordCount;
+	// the first line end decides; CR LF (or LF CR) is one line end
+	const char* lineEnd = text + strcspn(text, "\r\n");
+	size_t len = (lineEnd[1] == '\r' || lineEnd[1] == '\n') && lineEnd[1] != lineEnd[0] ? 2 : 1;
+	if (!*lineEnd) {
+		lineEnd = "\n";
+	}
+	memcpy(source->lineEnd, lineEnd, len);
+	source->lineEnd[len] = '\0';
+	((HeaderWithSubmitterId*)obj->header)->source = source;
+}
+
+void deleteSourceFile(SourceFile* source) {
+	if (source) {
+		free(source->path);
+		free(source->otherRecords);
+		free(source);
+	}
+}
+
 bool IndiHasId(const void* p1, const void* p2) {
 	IndividualWithId* indi = (IndividualWithId*)p1;
 	const char* id = (const char*)p2;
@@ -888,47 +1542,200 @@ FamilyWithIds* findFamilyById(List list, const char* id) {
 	return findElement(list, &FamilyHasId, id);
 }
 
-GEDCOMerror createGEDCOM(char* fileName, GEDCOMobject** obj) {
-	if (!fileName) {
-		 return createError(INV_FILE, -1);
-	}
-	int len = strlen(fileName);
-	if (len < 4) {
-		return createError(INV_FILE, -1);
-	}
-	char *ext = fileName + len - 4;
-	if (strcmp(ext, ".ged")) {
-		return createError(INV_FILE, -1);
-	}
+void initParseOptions(ParseOptions* options) {
+	options->individuals = true;
+	options->families = true;
+	options->events = true;
+	options->eventDates = true;
+	options->eventPlaces = true;
+	options->eventFields = true;
+	options->otherFields = true;
+	options->fieldTags = NULL;
+	options->submitterAddress = true;
+}
 
-	*obj = NULL;
-	char* content = NULL;
+// the level of a line, read like atoi does
+int peekLevel(const char* start, const char* end) {
+	for (; start < end && isspace((unsigned char)*start); start++);
+	bool negative = start < end && *start == '-';
+	start += start < end && (*start == '-' || *start == '+');
+	int level = 0;
+	for (; start < end && isdigit((unsigned char)*start) && level < MAX_PARSER_DEEP; start++) {
+		level = level * 10 + *start - '0';
+	}
+	return negative ? -level : level;
+}
 
-	GEDCOMerror res;
-	if ((res = readFileToMemory(fileName, &content)).type != OK) {
-		return res;
+// word number index of a line, found like getWord does
+const char* peekWord(const char* start, const char* end, int index, const char** wordEnd) {
+	const char* pos = start;
+	for (int i = 0; i < index && pos < end; i++) {
+		for (; pos < end && !isspace((unsigned char)*pos); pos++);
+		for (; pos < end && isspace((unsigned char)*pos); pos++);
 	}
+	const char* last = pos;
+	for (; last < end && !isspace((unsigned char)*last); last++);
+	*wordEnd = last;
+	return pos;
+}
 
-	char* position = content;
-	ParserScope* scopeStack;
-	ParserScope* currentScope;
+bool keepsField(const ParseOptions* options, const char* tag, const char* tagEnd) {
+	if (!options->otherFields || !options->fieldTags) {
+		return options->otherFields;
+	}
+	for (const char* const* kept = options->fieldTags; *kept; kept++) {
+		if (wordIs(tag, tagEnd, *kept)) {
+			return true;
+		}
+	}
+	return false;
+}
 
-	*obj = malloc(sizeof(GEDCOMobject));
-	initGEDCOMobject(*obj);
+bool isEventTag(const char* tag, const char* tagEnd) {
+	for (int i = 0; i < (int)(sizeof(EVENT_TAGS) / sizeof(char*)); i++) {
+		if (wordIs(tag, tagEnd, EVENT_TAGS[i])) {
+			return true;
+		}
+	}
+	return wordIs(tag, tagEnd, "EVEN");
+}
 
-	scopeStack = malloc(MAX_PARSER_DEEP * sizeof(ParserScope));
-	currentScope = scopeStack;
-	currentScope->receiver = *obj;
+// true if the line, which would go to scope, is left out with the lines below it
+bool isProjectedOut(const ParseOptions* options, const ParserScope* scope, const char* line, const char* end) {
+	const char* tagEnd;
+	const char* tag = peekWord(line, end, 1, &tagEnd);
+	if (tag == tagEnd) {
+		// the parser reports the error
+		return false;
+	}
+	if (scope->enter == &SkipAllReceiver) {
+		return true;
+	}
+	if (scope->enter == &GEDCOMobjectEnter) {
+		const char* typeEnd;
+		const char* type = peekWord(line, end, 2, &typeEnd);
+		return (!options->individuals && wordIs(type, typeEnd, "INDI")) || (!options->families && wordIs(type, typeEnd, "FAM"));
+	}
+	if (scope->enter == &IndiEnter) {
+		if (wordIs(tag, tagEnd, "NAME")) {
+			return false;
+		}
+		if (wordIs(tag, tagEnd, "FAMS") || wordIs(tag, tagEnd, "FAMC")) {
+			return !options->families;
+		}
+		return isEventTag(tag, tagEnd) ? !options->events : !keepsField(options, tag, tagEnd);
+	}
+	if (scope->enter == &FamilyEnter) {
+		if (wordIs(tag, tagEnd, "HUSB") || wordIs(tag, tagEnd, "WIFE") || wordIs(tag, tagEnd, "CHIL")) {
+			return !options->individuals;
+		}
+		return isEventTag(tag, tagEnd) ? !options->events : !keepsField(options, tag, tagEnd);
+	}
+	if (scope->enter == &EnterEvent) {
+		if (wordIs(tag, tagEnd, "DATE")) {
+			return !options->eventDates;
+		}
+		if (wordIs(tag, tagEnd, "PLAC")) {
+			return !options->eventPlaces;
+		}
+		return !wordIs(tag, tagEnd, "TYPE") && !options->eventFields;
+	}
+	if (scope->enter == &HeaderEnter) {
+		return !wordIs(tag, tagEnd, "GEDC") && !wordIs(tag, tagEnd, "SUBM") && !wordIs(tag, tagEnd, "SOUR") &&
+			!wordIs(tag, tagEnd, "CHAR") && !keepsField(options, tag, tagEnd);
+	}
+	if (scope->enter == &EnterSubmitter) {
+		if (wordIs(tag, tagEnd, "ADDR")) {
+			return !options->submitterAddress;
+		}
+		return !wordIs(tag, tagEnd, "NAME") && !keepsField(options, tag, tagEnd);
+	}
+	return false;
+}
+
+// skips the lines the projection leaves out, each with the lines below it, without copying them.
+// Skipped lines are not checked
+void skipProjectedLines(LineInput* input, const ParseOptions* options, ParserScope* scopes, int* prevLevel, int* lineNum) {
+	const char* start;
+	const char* end;
+	while (options && peekInputLine(input, &start, &end)) {
+		int level = peekLevel(start, end);
+		if (level < 0 || level > *prevLevel + 1 || level >= MAX_PARSER_DEEP - 1 || !isProjectedOut(options, scopes + level, start, end)) {
+			return;
+		}
+		do {
+			skipInputLine(input, end);
+			(*lineNum)++;
+		} while (peekInputLine(input, &start, &end) && peekLevel(start, end) > level);
+		*prevLevel = level;
+	}
+}
+
+// .ged, or .ged.gz
+bool isGEDCOMfileName(const char* fileName) {
+	if (!fileName) {
+		return false;
+	}
+	int len = strlen(fileName);
+	// .ged.gz needs zlib, which is used only when the library is built with -DHAVE_ZLIB and linked with -lz
+	if (isCompressedName(fileName)) {
+#ifdef HAVE_ZLIB
+		len -= 3;
+#else
+		return false;
+#endif
+	}
+	return len >= 4 && !strncmp(fileName + len - 4, ".ged", 4);
+}
+
+GEDCOMerror createGEDCOM(char* fileName, GEDCOMobject** obj) {
+	return createGEDCOMwithOptions(fileName, obj, NULL);
+}
+
+GEDCOMerror createGEDCOMwithOptions(char* fileName, GEDCOMobject** obj, const ParseOptions* options) {
+	if (!isGEDCOMfileName(fileName)) {
+		 return createError(INV_FILE, -1);
+	}
+
+	*obj = NULL;
+	LineInput input;
+
+	GEDCOMerror res;
+	if ((res = openLineInput(&input, fileName)).type != OK) {
+		closeLineInput(&input);
+		return res;
+	}
+
+	ParserScope* scopeStack;
+	ParserScope* currentScope;
+
+	*obj = malloc(sizeof(GEDCOMobject));
+	initGEDCOMobject(*obj);
+
+	scopeStack = malloc(MAX_PARSER_DEEP * sizeof(ParserScope));
+	currentScope = scopeStack;
+	currentScope->receiver = *obj;
 	currentScope->enter = &GEDCOMobjectEnter;
 
 	char* line = NULL;
 
+	// byte ranges of records, kept so unmodified records can be copied when writing
+	SourceRange* openRange = NULL;
+	SourceRange* otherRecords = NULL;
+	int otherRecordCount = 0;
+	int otherRecordCapacity = 0;
+	bool skipRecord = false;
+
 	res = createError(INV_GEDCOM, -1);
 	bool init = false;
 	int lineNum = 1;
 	int prevLevel = -1;
-	while (*position) {
-		position = readLine(position, &line);
+	off_t lineStart;
+	while (nextInputLine(&input, &line, &lineStart)) {
+		if (line[0] == '0' && openRange) {
+			openRange->end = lineStart;
+			openRange = NULL;
+		}
 		if (!strncmp(line, "0 TRLR", 6)) {
 			res = createError(OK, 0);
 			break;
@@ -948,16 +1755,45 @@ GEDCOMerror createGEDCOM(char* fileName, GEDCOMobject** obj) {
 			goto doExit;			
 		}
 		currentScope = scopeStack + level;
+		int individualCount = getLength((*obj)->individuals);
+		int familyCount = getLength((*obj)->families);
 		res = currentScope->enter(currentScope->receiver, line, currentScope + 1);
 		if (res.type != OK) {
 			goto doExit;
 		}
+		if (!level && getLength((*obj)->individuals) != individualCount) {
+			openRange = &((IndividualWithId*)getFromBack((*obj)->individuals))->source;
+		} else if (!level && getLength((*obj)->families) != familyCount) {
+			openRange = &((FamilyWithIds*)getFromBack((*obj)->families))->source;
+		} else if (!level && (*obj)->header && currentScope[1].enter == &SkipAllReceiver) {
+			// a record we do not support; it is kept as bytes only
+			if (otherRecordCount == otherRecordCapacity) {
+				otherRecordCapacity = otherRecordCapacity ? otherRecordCapacity * 2 : 16;
+				otherRecords = realloc(otherRecords, otherRecordCapacity * sizeof(SourceRange));
+			}
+			openRange = otherRecords + otherRecordCount++;
+			skipRecord = true;
+		}
+		if (!level && openRange) {
+			openRange->start = lineStart;
+		}
 		free(line);
 		line = NULL;
 		init = true;
 		prevLevel = level;
 		res = createError(INV_GEDCOM, -1);
 		lineNum++;
+		if (skipRecord) {
+			// its lines would only be discarded, so they are not read at all
+			lineNum += skipInputRecord(&input);
+			skipRecord = false;
+		}
+		skipProjectedLines(&input, options, scopeStack, &prevLevel, &lineNum);
+	}
+
+	if (lineInputFailed(&input)) {
+		res = createError(INV_FILE, -1);
+		goto doExit;
 	}
 
 	if (!(*obj)->submitter) {
@@ -982,7 +1818,6 @@ GEDCOMerror createGEDCOM(char* fileName, GEDCOMobject** obj) {
 			const char* familyId = (const char*)fdata;
 			FamilyWithIds* family = findFamilyById((*obj)->families, familyId);
 			if (!family) {
-				deleteGEDCOM(*obj);
 				res = createError(INV_GEDCOM, 0);
 				goto doExit;
 			}
@@ -998,7 +1833,6 @@ GEDCOMerror createGEDCOM(char* fileName, GEDCOMobject** obj) {
 		if (family->husbandId) {
 			family->family.husband = (Individual*)findIndiById((*obj)->individuals, family->husbandId);
 			if (!family->family.husband) {
-				deleteGEDCOM(*obj);
 				res = createError(INV_GEDCOM, 0);
 				goto doExit;
 			}
@@ -1006,7 +1840,6 @@ GEDCOMerror createGEDCOM(char* fileName, GEDCOMobject** obj) {
 		if (family->wifeId) {
 			family->family.wife = (Individual*)findIndiById((*obj)->individuals, family->wifeId);
 			if (!family->family.wife) {
-				deleteGEDCOM(*obj);
 				res = createError(INV_GEDCOM, 0);
 				goto doExit;
 			}
@@ -1016,15 +1849,20 @@ GEDCOMerror createGEDCOM(char* fileName, GEDCOMobject** obj) {
 			const char* childId = (const char*)cdata;
 			IndividualWithId* child = findIndiById((*obj)->individuals, childId);
 			if (!child) {
-				deleteGEDCOM(*obj);
 				res = createError(INV_GEDCOM, 0);
 				goto doExit;
 			}
 			insertBack(&family->family.children, child);
 		}
 	}
+	// records of a compressed file can not be copied by offset, and those of a projection are not complete
+	if (!input.compressed && !options) {
+		attachSourceFile(*obj, fileName, input.data, otherRecords, otherRecordCount);
+		otherRecords = NULL;
+	}
 doExit:
-	free(content);
+	free(otherRecords);
+	closeLineInput(&input);
 	free(scopeStack);
 	if (line) {
 		free(line);
@@ -1039,6 +1877,7 @@ doExit:
 void deleteGEDCOM(GEDCOMobject* obj) {
 	// delete header
 	if (obj->header) {
+		deleteSourceFile(((HeaderWithSubmitterId*)obj->header)->source);
 		clearList(&obj->header->otherFields);
 		free(obj->header);
 	}
@@ -1051,56 +1890,59 @@ void deleteGEDCOM(GEDCOMobject* obj) {
 	free(obj);
 }
 
-char* printSubmitter(Submitter* submitter) {
-	DynBuffer buffer;
-	initDynBuffer(&buffer);
-	sprintfDyn(&buffer, 0, "Name: %s\n", submitter->submitterName);
-	sprintfDyn(&buffer, 0, "Address: %s\n", submitter->address);
+// the fields one after another, like toString on the list
+void appendFieldList(StringBuilder* builder, List fields) {
+	ListIterator iter = createIterator(fields);
+	for (void* data = nextElement(&iter); data; data = nextElement(&iter))
+	{
+		appendField(builder, (Field*)data);
+	}
+}
+
+void appendSubmitter(StringBuilder* builder, const Submitter* submitter) {
+	appendStringToBuilder(builder, "Name: ");
+	appendStringToBuilder(builder, submitter->submitterName);
+	appendStringToBuilder(builder, "\nAddress: ");
+	appendStringToBuilder(builder, submitter->address);
+	appendCharToBuilder(builder, '\n');
 	if (getLength(submitter->otherFields)) {
-		char* buf = toString(submitter->otherFields);
-		sprintfDyn(&buffer, 0, "\tFields: %s\n", buf);
-		free(buf);
+		appendStringToBuilder(builder, "\tFields: ");
+		appendFieldList(builder, submitter->otherFields);
+		appendCharToBuilder(builder, '\n');
 	}
+}
+
+char* printSubmitter(Submitter* submitter) {
+	StringBuilder buffer;
+	initStringBuilder(&buffer, 0);
+	appendSubmitter(&buffer, submitter);
 	return buffer.str;
 }
 
-char* printGEDCOM(const GEDCOMobject* obj) {
-	if (!obj) {
-		return NULL;
-	}
-	DynBuffer buffer;
-	initDynBuffer(&buffer);
-	sprintfDyn(&buffer, 0, "Header:\n");
-	sprintfDyn(&buffer, 0, " - source: %s\n", obj->header->source);
-	sprintfDyn(&buffer, 0, " - version: %f\n", obj->header->gedcVersion);
-	sprintfDyn(&buffer, 0, " - encoding: %d\n", obj->header->encoding);
+void appendGEDCOMheader(StringBuilder* builder, const GEDCOMobject* obj) {
+	appendStringToBuilder(builder, "Header:\n - source: ");
+	appendStringToBuilder(builder, obj->header->source);
+	appendStringToBuilder(builder, "\n - version: ");
+	appendFloatToBuilder(builder, obj->header->gedcVersion, 6);
+	appendStringToBuilder(builder, "\n - encoding: ");
+	appendIntToBuilder(builder, (int)obj->header->encoding);
+	appendCharToBuilder(builder, '\n');
 	if (obj->header->submitter) {
-		char* buf = printSubmitter(obj->header->submitter);
-		sprintfDyn(&buffer, 0, "\tSubmitter: %s\n", buf);
-		free(buf);
+		appendStringToBuilder(builder, "\tSubmitter: ");
+		appendSubmitter(builder, obj->header->submitter);
+		appendCharToBuilder(builder, '\n');
 	}
-
 	if (getLength(obj->header->otherFields)) {
-		char* buf = toString(obj->header->otherFields);
-		sprintfDyn(&buffer, 0, "\tFields: %s\n", buf);
-		free(buf);
+		appendStringToBuilder(builder, "\tFields: ");
+		appendFieldList(builder, obj->header->otherFields);
+		appendCharToBuilder(builder, '\n');
 	}
-
-	char* buf = toString(obj->individuals);
-	sprintfDyn(&buffer, 0, "Individuals: %s\n", buf);
-	free(buf);
-
-	buf = toString(obj->families);
-	sprintfDyn(&buffer, 0, "Families: %s\n", buf);
-	free(buf);
-
-	return buffer.str;
 }
 
 char* printError(GEDCOMerror err) {
-	// OK, INV_FILE, INV_GEDCOM, INV_HEADER, INV_RECORD, OTHER
+	// OK, INV_FILE, INV_GEDCOM, INV_HEADER, INV_RECORD, OTHER, WRITE_ERROR
 	char* constands[] = {
-		"OK", "Invalid file", "Invalid Gedcom", "Invalid header", "Invalid Record", "Other"
+		"OK", "Invalid file", "Invalid Gedcom", "Invalid header", "Invalid Record", "Other", "Write error"
 	};
 	if (err.type == OK) {
 		char* res = malloc(3);
@@ -1166,270 +2008,1171 @@ List getDescendants(const GEDCOMobject* familyRecord, const Individual* person)
 
 const char* endodingToStr(CharSet charset) {
     const char* names[] = {
-      "UTF8", "UNICODE", "ASCII"
+      "ANSEL", "UTF-8", "UNICODE", "ASCII"
     };
-    return names[charset - UTF8];
+    if ((int)charset < ANSEL || charset > ASCII) {
+        return "ASCII";
+    }
+    return names[charset - ANSEL];
 }
 
-GEDCOMerror writeFields(FILE* file, List list, const char* level) {
-    ListIterator it = createIterator(list);
-    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
-        Field* field = (Field*)data;
-        if (0 > fprintf(file, "%s %s %s\n", level, field->tag, field->value)) {
-            return createError(INV_FILE, 0);
+/////// buffered output
+
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+// lines are appended to a large buffer and written with write(2) when it fills up;
+// a failed write is remembered and reported once the record is done.
+// A buffer without a file (fd -1) starts small and grows instead, and its owner writes it out.
+// When compressor is set, everything written goes through zlib
+typedef struct {
+    int fd;
+    // appended to directly, so text.str is terminated only by takeOutputString
+    StringBuilder text;
+    bool failed;
+    void* compressor;
+    // ends GEDCOM lines
+    const char* lineEnd;
+    // set while the file is written under a temporary name
+    char* tempName;
+} OutputBuffer;
+
+void initOutputBuffer(OutputBuffer* out, int fd) {
+    out->fd = fd;
+    initStringBuilder(&out->text, fd >= 0 ? OUTPUT_BUFFER_SIZE : 0);
+    out->failed = false;
+    out->compressor = NULL;
+    out->lineEnd = "\n";
+    out->tempName = NULL;
+}
+
+void endCompression(OutputBuffer* out);
+
+void deleteOutputBuffer(OutputBuffer* out) {
+    endCompression(out);
+    deleteStringBuilder(&out->text);
+}
+
+// writes all iovecs, resuming after short writes and interrupts
+bool writeAll(int fd, struct iovec* parts, int count) {
+    while (count) {
+        ssize_t written = writev(fd, parts, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        while (count && (size_t)written >= parts->iov_len) {
+            written -= parts->iov_len;
+            parts++;
+            count--;
+        }
+        if (count) {
+            parts->iov_base = (char*)parts->iov_base + written;
+            parts->iov_len -= written;
         }
     }
-    return createError(OK, 0);
+    return true;
 }
 
-GEDCOMerror writeHeader(FILE* file, const Header* obj) {
-    if (0 > fprintf(file, "0 HEAD\n")) {
-        return createError(INV_FILE, 0);
+#ifdef HAVE_ZLIB
+bool compressOutput(OutputBuffer* out, const char* data, size_t len, bool finish) {
+    z_stream* stream = (z_stream*)out->compressor;
+    unsigned char buffer[1 << 16];
+    stream->next_in = (Bytef*)data;
+    stream->avail_in = (uInt)len;
+    int status;
+    do {
+        stream->next_out = buffer;
+        stream->avail_out = sizeof(buffer);
+        status = deflate(stream, finish ? Z_FINISH : Z_NO_FLUSH);
+        if (status == Z_STREAM_ERROR) {
+            return false;
+        }
+        struct iovec part = { buffer, sizeof(buffer) - stream->avail_out };
+        if (part.iov_len && !writeAll(out->fd, &part, 1)) {
+            return false;
+        }
+    } while (!stream->avail_out || (finish && status != Z_STREAM_END));
+    return true;
+}
+#endif
+
+bool startCompression(OutputBuffer* out) {
+#ifdef HAVE_ZLIB
+    z_stream* stream = calloc(1, sizeof(z_stream));
+    // 16 + window bits asks for a gzip header
+    if (deflateInit2(stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + 15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        free(stream);
+        return false;
     }
-    if (0 > fprintf(file, "1 SOUR %s\n", obj->source)) {
-        return createError(INV_FILE, 0);
+    out->compressor = stream;
+    return true;
+#else
+    (void)out;
+    return false;
+#endif
+}
+
+void endCompression(OutputBuffer* out) {
+#ifdef HAVE_ZLIB
+    if (out->compressor) {
+        deflateEnd((z_stream*)out->compressor);
+        free(out->compressor);
+        out->compressor = NULL;
     }
-    if (0 > fprintf(file, "1 GEDC\n")) {
-        return createError(INV_FILE, 0);
+#else
+    (void)out;
+#endif
+}
+
+void flushOutput(OutputBuffer* out);
+
+// makes room for len more bytes; only memory buffers are guaranteed to get it
+void reserveOutput(OutputBuffer* out, size_t len) {
+    if (out->text.length + len <= out->text.allocated) {
+        return;
     }
-    if (0 > fprintf(file, "2 VERS %f\n", obj->gedcVersion)) {
-        return createError(INV_FILE, 0);
+    if (out->fd >= 0) {
+        flushOutput(out);
+        return;
     }
-    if (obj->encoding) {
-        if (0 > fprintf(file, "1 CHAR %s\n", endodingToStr(obj->encoding))) {
-            return createError(INV_FILE, 0);
-        }
+    reserveStringBuilder(&out->text, len);
+}
+
+void flushOutput(OutputBuffer* out) {
+    if (out->fd < 0) {
+        return;
     }
-    if (obj->submitter) {
-        if (0 > fprintf(file, "1 SUBM @U1@\n")) {
-            return createError(INV_FILE, 0);
+    if (out->text.length && !out->failed) {
+#ifdef HAVE_ZLIB
+        if (out->compressor) {
+            out->failed = !compressOutput(out, out->text.str, out->text.length, false);
+            out->text.length = 0;
+            return;
         }
+#endif
+        struct iovec part = { out->text.str, out->text.length };
+        out->failed = !writeAll(out->fd, &part, 1);
     }
-    return writeFields(file, obj->otherFields, "1");
+    out->text.length = 0;
 }
 
-int getFamilyIndex(Family* family, Family** families, int familiesCount) {
-    for (int i = 0; i < familiesCount; i++) {
-        if (family == families[i]) {
-            return i;
+void appendOutput(OutputBuffer* out, const char* data, size_t len) {
+    if (out->fd < 0) {
+        reserveOutput(out, len);
+    }
+    if (out->text.length + len <= out->text.allocated) {
+        memcpy(out->text.str + out->text.length, data, len);
+        out->text.length += len;
+        return;
+    }
+    if (len < out->text.allocated / 2) {
+        flushOutput(out);
+        memcpy(out->text.str, data, len);
+        out->text.length = len;
+        return;
+    }
+    // large values go straight to the file together with what is buffered
+#ifdef HAVE_ZLIB
+    if (out->compressor) {
+        flushOutput(out);
+        if (!out->failed) {
+            out->failed = !compressOutput(out, data, len, false);
         }
+        return;
     }
-    return -1;
+#endif
+    struct iovec parts[2] = { { out->text.str, out->text.length }, { (void*)data, len } };
+    if (!out->failed) {
+        out->failed = !writeAll(out->fd, parts, 2);
+    }
+    out->text.length = 0;
 }
 
-int getIndividualIndex(Individual* indi, Individual** indies, int indisCount) {
-    for (int i = 0; i < indisCount; i++) {
-        if (indi == indies[i]) {
-            return i;
-        }
-    }
-    return -1;
+void appendOutputString(OutputBuffer* out, const char* str) {
+    appendOutput(out, str, strlen(str));
 }
 
-GEDCOMerror writeEvents(FILE* file, List events) {
-    ListIterator it = createIterator(events);
-    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
-        Event* event = (Event*)data;
-        if (0 > fprintf(file, "1 %s\n", event->type)) {
-            return createError(INV_FILE, 0);
-        }
-        if (event->date) {
-            if (0 > fprintf(file, "2 DATE %s\n", event->date)) {
-                return createError(INV_FILE, 0);
-            }
-        }
-        if (event->place) {
-            if (0 > fprintf(file, "2 PLAC %s\n", event->place)) {
-                return createError(INV_FILE, 0);
-            }
-        }
-        GEDCOMerror res = writeFields(file, event->otherFields, "2");
-        if (res.type != OK) {
-            return res;
-        }
+void appendOutputChar(OutputBuffer* out, char c) {
+    if (out->text.length == out->text.allocated) {
+        reserveOutput(out, 1);
     }
-    return createError(OK, 0);
+    out->text.str[out->text.length++] = c;
 }
 
-GEDCOMerror writeIndi(FILE* file, Individual* indi, const char* id, Family** families, int familiesCount) {
-    if (0 > fprintf(file, "0 %s INDI\n", id)) {
-        return createError(INV_FILE, 0);
+void appendLineEnd(OutputBuffer* out) {
+    if (out->lineEnd[1]) {
+        appendOutputString(out, out->lineEnd);
+    } else {
+        appendOutputChar(out, out->lineEnd[0]);
     }
-    if (0 > fprintf(file, "1 NAME %s /%s/\n", indi->givenName, indi->surname)) {
-        return createError(INV_FILE, 0);
+}
+
+void appendOutputNumber(OutputBuffer* out, unsigned long long number) {
+    char digits[24];
+    char* start = formatDigits(digits + sizeof(digits), number);
+    appendOutput(out, start, digits + sizeof(digits) - start);
+}
+
+// writes value with up to six decimals and no trailing zeros, as %g does for version numbers
+void appendOutputDecimal(OutputBuffer* out, double value) {
+    char digits[48];
+    char* end = digits + sizeof(digits);
+    char* start = formatFixed(end, value, 6);
+    if (!start) {
+        snprintf(digits, sizeof(digits), "%g", value);
+        appendOutputString(out, digits);
+        return;
     }
-    // write families
-    ListIterator it = createIterator(indi->families);
-    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
-        Family* family = (Family*)data;
-        int index = getFamilyIndex(family, families, familiesCount);
-        char id[16];
-        sprintf(id, "@F%d@", index);
-        if (0 > fprintf(file, "1 FAMS %s\n", id)) {
-            return createError(INV_FILE, 0);
-        }
+    for (; end[-1] == '0'; end--);
+    if (end[-1] == '.') {
+        end--;
     }
-    GEDCOMerror res = writeEvents(file, indi->events);
-    if (res.type != OK) {
-        return res;
+    appendOutput(out, start, end - start);
+}
+
+// writes @<prefix><number>@
+void appendXref(OutputBuffer* out, char prefix, int number) {
+    appendOutputChar(out, '@');
+    appendOutputChar(out, prefix);
+    appendOutputNumber(out, (unsigned long long)number);
+    appendOutputChar(out, '@');
+}
+
+// writes "<level> <tag>" and, if value is not NULL, " <value>"; the caller ends the line
+void appendTagLine(OutputBuffer* out, char level, const char* tag, const char* value) {
+    appendOutputChar(out, level);
+    appendOutputChar(out, ' ');
+    appendOutputString(out, tag);
+    if (value) {
+        appendOutputChar(out, ' ');
+        appendOutputString(out, value);
     }
-    res = writeFields(file, indi->otherFields, "1");
-    return res;
 }
 
-GEDCOMerror writeFamily(FILE* file, Family* family, const char* id, Individual** individuals, int individualsCount) {
-    if (0 > fprintf(file, "0 %s FAM\n", id)) {
-        return createError(INV_FILE, 0);
+GEDCOMerror outputStatus(const OutputBuffer* out) {
+    return createError(out->failed ? WRITE_ERROR : OK, 0);
+}
+
+// opens fileName for writing. When it is the file records are copied from (sourceFd), the output goes to
+// a temporary file next to it that finishOutputFile renames over it, so the source stays readable while
+// it is written; the temporary file gets the mode and, where allowed, the owner of the source.
+// Any other file is truncated and written in place, like fopen does, and tempName is set to NULL
+int createOutputFile(const char* fileName, int sourceFd, char** tempName) {
+    struct stat target;
+    struct stat source;
+    *tempName = NULL;
+    if (sourceFd < 0 || stat(fileName, &target) || fstat(sourceFd, &source) || !S_ISREG(target.st_mode) ||
+            target.st_dev != source.st_dev || target.st_ino != source.st_ino) {
+        return open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0666);
     }
-    if (family->husband) {
-        int index = getIndividualIndex(family->husband, individuals, individualsCount);
-        char id[16];
-        sprintf(id, "@I%d@", index);
-        if (0 > fprintf(file, "1 HUSB %s\n", id)) {
-            return createError(INV_FILE, 0);
-        }
+    // the temporary file goes next to the real file, so a symbolic link to it is kept
+    char* path = realpath(fileName, NULL);
+    if (!path) {
+        return -1;
     }
-    if (family->wife) {
-        int index = getIndividualIndex(family->wife, individuals, individualsCount);
-        char id[16];
-        sprintf(id, "@I%d@", index);
-        if (0 > fprintf(file, "1 WIFE %s\n", id)) {
-            return createError(INV_FILE, 0);
-        }
+    *tempName = malloc(strlen(path) + 8);
+    sprintf(*tempName, "%s.XXXXXX", path);
+    free(path);
+    int fd = mkstemp(*tempName);
+    // only root can give the file to another owner; keeping just the group may still be allowed
+    if (fd >= 0 && fchown(fd, target.st_uid, target.st_gid) && fchown(fd, (uid_t)-1, target.st_gid)) {
+        // the file stays the writer's, like a new one would be
     }
-    ListIterator it = createIterator(family->children);
-    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
-        Individual* chil = (Individual*)data;
-        int index = getIndividualIndex(chil, individuals, individualsCount);
-        char id[16];
-        sprintf(id, "@I%d@", index);
-        if (0 > fprintf(file, "1 CHIL %s\n", id)) {
-            return createError(INV_FILE, 0);
+    if (fd < 0 || fchmod(fd, target.st_mode & 07777)) {
+        if (fd >= 0) {
+            close(fd);
+            unlink(*tempName);
         }
+        free(*tempName);
+        *tempName = NULL;
+        return -1;
     }
-    GEDCOMerror res = writeEvents(file, family->events);
-    if (res.type != OK) {
-        return res;
+    return fd;
+}
+
+// renames a complete temporary file over the file it was created for, or removes an incomplete one;
+// frees tempName
+bool finishOutputFile(char* tempName, bool written) {
+    if (!tempName) {
+        return written;
     }
-    res = writeFields(file, family->otherFields, "1");
-    return res;
+    size_t length = strlen(tempName) - 7;
+    char* fileName = malloc(length + 1);
+    memcpy(fileName, tempName, length);
+    fileName[length] = '\0';
+    written = written && !rename(tempName, fileName);
+    if (!written) {
+        unlink(tempName);
+    }
+    free(fileName);
+    free(tempName);
+    return written;
 }
 
-GEDCOMerror writeSubmitter(FILE* file, Submitter* submitter) {
-    if (0 > fprintf(file, "0 @U1@ SUBM\n")) {
-        return createError(INV_FILE, 0);
+// creates fileName for writing, replacing it only once complete when it is the source (see createOutputFile);
+// names ending in .gz are compressed
+bool openOutput(OutputBuffer* out, const char* fileName, int sourceFd) {
+#ifndef HAVE_ZLIB
+    if (isCompressedName(fileName)) {
+        return false;
     }
-    if (0 > fprintf(file, "1 NAME %s\n", submitter->submitterName)) {
-        return createError(INV_FILE, 0);
+#endif
+    char* tempName;
+    int fd = createOutputFile(fileName, sourceFd, &tempName);
+    if (fd < 0) {
+        return false;
     }
-    // write address
-    char* line = submitter->address;
-    while (*line) {
-        char* lineEnd = line;
-        for (;*lineEnd && *lineEnd != '\n'; lineEnd++);
-        int len = lineEnd - line;
-        char* buf = alloca(len + 1);
-        strncpy(buf, line, len);
-        buf[len] = 0;
-        if (line == submitter->address)
-        {
-            if (0 > fprintf(file, "1 ADDR %s\n", buf)) {
-                return createError(INV_FILE, 0);
-            }
-        }
-        else
-        {
-            if (0 > fprintf(file, "2 CONT %s\n", buf)) {
-                return createError(INV_FILE, 0);
-            }
-        }
-        if (!*lineEnd) {
-            break;
-        }
-        line = lineEnd + 1;
+    initOutputBuffer(out, fd);
+    out->tempName = tempName;
+    if (isCompressedName(fileName) && !startCompression(out)) {
+        close(fd);
+        finishOutputFile(tempName, false);
+        deleteOutputBuffer(out);
+        return false;
     }
-    return writeFields(file, submitter->otherFields, "1");
+    return true;
 }
 
-
-GEDCOMerror writeGEDCOM(char* fileName, const GEDCOMobject* obj) {
-    FILE* file = fopen(fileName, "w");
-    if (!file) {
-        return createError(INV_FILE, 0);
+// writes what is left, closes the file and frees the buffer; reports any failed write
+GEDCOMerror closeOutput(OutputBuffer* out) {
+    flushOutput(out);
+#ifdef HAVE_ZLIB
+    if (out->compressor && !out->failed) {
+        out->failed = !compressOutput(out, "", 0, true);
     }
-    GEDCOMerror res = writeHeader(file, obj->header);
-    if (res.type != OK) {
-        goto clearAndExit;
+#endif
+    GEDCOMerror res = outputStatus(out);
+    if (close(out->fd) && res.type == OK) {
+        res = createError(WRITE_ERROR, 0);
     }
-    // copy list to array
-    Individual** indies = malloc(sizeof(Individual*) * getLength(obj->individuals));
-    ListIterator it = createIterator(obj->individuals);
+    if (!finishOutputFile(out->tempName, res.type == OK) && res.type == OK) {
+        res = createError(WRITE_ERROR, 0);
+    }
+    deleteOutputBuffer(out);
+    return res;
+}
+
+/////// printing to a file
+
+// printGEDCOM's text with individuals [offset, offset + limit), and the families when withFamilies is set.
+// When out is given, builder is its text and it is written out between records, so it stays bounded
+void appendGEDCOMpart(StringBuilder* builder, const GEDCOMobject* obj, int offset, int limit, bool withFamilies, OutputBuffer* out) {
+    appendGEDCOMheader(builder, obj);
+    // records follow each other without separators, and an empty list shows as "empty"
+    appendStringToBuilder(builder, "Individuals: ");
     int counter = 0;
-    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
-        Individual* indi = (Individual*)data;
-        indies[counter++] = indi;
+    ListIterator iter = createIterator(obj->individuals);
+    for (void* data = nextElement(&iter); data && counter - offset < limit; data = nextElement(&iter), counter++) {
+        if (counter >= offset) {
+            appendIndividual(builder, (Individual*)data);
+            if (out && builder->length >= OUTPUT_BUFFER_SIZE / 2) {
+                flushOutput(out);
+            }
+        }
     }
-    int indiesCount = counter;
-    // and families
-    Family** families = malloc(sizeof(Family*) * getLength(obj->families));
-    it = createIterator(obj->families);
-    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
-        Family* family = (Family*)data;
-        families[counter++] = family;
+    if (counter <= offset || limit <= 0) {
+        appendStringToBuilder(builder, "empty");
     }
-    int familiesCount = counter;
-
-    for (int i = 0; i < indiesCount; i++) {
-        char id[32];
-        sprintf(id, "@I%d@", i + 1);
-        writeIndi(file, indies[i], id, families, familiesCount);
+    appendCharToBuilder(builder, '\n');
+    if (!withFamilies) {
+        return;
     }
-clearAndExit:
-    fclose(file);
-    return res;
+    appendStringToBuilder(builder, "Families: ");
+    if (!getLength(obj->families)) {
+        appendStringToBuilder(builder, "empty");
+    }
+    iter = createIterator(obj->families);
+    for (void* data = nextElement(&iter); data; data = nextElement(&iter)) {
+        appendFamily(builder, (Family*)data);
+        if (out && builder->length >= OUTPUT_BUFFER_SIZE / 2) {
+            flushOutput(out);
+        }
+    }
+    appendCharToBuilder(builder, '\n');
 }
 
-ErrorCode validateGEDCOM(const GEDCOMobject* obj) {
+void appendGEDCOM(StringBuilder* builder, const GEDCOMobject* obj) {
+    appendGEDCOMpart(builder, obj, 0, INT_MAX, true, NULL);
+}
+
+char* printGEDCOM(const GEDCOMobject* obj) {
     if (!obj) {
-        return INV_GEDCOM;
-    }
-    if (!obj->header) {
-        return INV_HEADER;
+        return NULL;
     }
-    if (!obj->header->submitter) {
-        return INV_HEADER;
+    StringBuilder buffer;
+    initStringBuilder(&buffer, 0);
+    appendGEDCOM(&buffer, obj);
+    return buffer.str;
+}
+
+char* printGEDCOMPage(const GEDCOMobject* obj, int offset, int limit) {
+    if (!obj || offset < 0) {
+        return NULL;
     }
-    if (!obj->header->submitter->submitterName[0]) {
-        return INV_RECORD;
+    StringBuilder buffer;
+    initStringBuilder(&buffer, 0);
+    appendGEDCOMpart(&buffer, obj, offset, limit, false, NULL);
+    return buffer.str;
+}
+
+GEDCOMerror printGEDCOMToFd(int fd, const GEDCOMobject* obj) {
+    if (fd < 0 || !obj) {
+        return createError(WRITE_ERROR, 0);
     }
-    if (obj->header->gedcVersion == 0.0f) {
-        return INV_HEADER;
+    OutputBuffer out;
+    initOutputBuffer(&out, fd);
+    appendGEDCOMpart(&out.text, obj, 0, INT_MAX, true, &out);
+    flushOutput(&out);
+    GEDCOMerror res = outputStatus(&out);
+    deleteOutputBuffer(&out);
+    return res;
+}
+
+GEDCOMerror printGEDCOMToFile(FILE* file, const GEDCOMobject* obj) {
+    // output goes around stdio, after what is already buffered there
+    if (!file || fflush(file)) {
+        return createError(WRITE_ERROR, 0);
     }
-    if (!obj->submitter) {
-        return INV_GEDCOM;
+    return printGEDCOMToFd(fileno(file), obj);
+}
+
+// xref numbers of all records, so links are written in constant time;
+// number 0 means the record keeps the xref it had in the source file
+typedef struct {
+    PointerMap individuals;
+    PointerMap families;
+    // streamed records are numbered by the caller
+    XrefResolver individualResolver;
+    XrefResolver familyResolver;
+    void* context;
+} XrefTable;
+
+// returns n for ids of the form @<prefix>n@, otherwise 0
+int xrefNumber(const char* id, char prefix) {
+    if (id[0] != '@' || id[1] != prefix || !isdigit((unsigned char)id[2])) {
+        return 0;
     }
-    if (!obj->submitter->submitterName[0]) {
-        return INV_RECORD;
+    char* end;
+    long number = strtol(id + 2, &end, 10);
+    return *end == '@' && !end[1] && number < INT_MAX / 2 ? (int)number : 0;
+}
+
+void initXrefTable(XrefTable* table, const GEDCOMobject* obj, bool keepIds) {
+    initPointerMap(&table->individuals, getLength(obj->individuals));
+    initPointerMap(&table->families, getLength(obj->families));
+    table->individualResolver = table->familyResolver = NULL;
+    table->context = NULL;
+    // records without a source xref are numbered above every kept one
+    int individualCounter = 0;
+    int familyCounter = 0;
+    ListIterator it = createIterator(obj->individuals);
+    for (void* data = nextElement(&it); data && keepIds; data = nextElement(&it)) {
+        int number = xrefNumber(((IndividualWithId*)data)->id, 'I');
+        individualCounter = number > individualCounter ? number : individualCounter;
     }
-    ListIterator it = createIterator(obj->families);
     it = createIterator(obj->families);
-    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
-        if (!data) {
-            return INV_RECORD;
-        }
+    for (void* data = nextElement(&it); data && keepIds; data = nextElement(&it)) {
+        int number = xrefNumber(((FamilyWithIds*)data)->id, 'F');
+        familyCounter = number > familyCounter ? number : familyCounter;
     }
     it = createIterator(obj->individuals);
     for (void* data = nextElement(&it); data; data = nextElement(&it)) {
-        if (!data) {
-            return INV_RECORD;
-        }
+        bool keep = keepIds && ((IndividualWithId*)data)->id[0];
+        putPointer(&table->individuals, data, keep ? 0 : ++individualCounter);
+    }
+    it = createIterator(obj->families);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        bool keep = keepIds && ((FamilyWithIds*)data)->id[0];
+        putPointer(&table->families, data, keep ? 0 : ++familyCounter);
     }
+}
 
-    return OK;
+// returns -1 for records that must not be linked to
+int lookupXref(const XrefTable* table, const PointerMap* map, XrefResolver resolver, const void* record) {
+    if (resolver) {
+        int number = resolver(record, table->context);
+        return number > 0 ? number : -1;
+    }
+    return getPointer(map, record);
 }
 
-void addDescendant(const GEDCOMobject* familyRecord, const Individual* person, List** resultAsArray, int currentLevel, int maxGen) {
-    // enum families
+int individualXref(XrefTable* table, const Individual* indi) {
+    return lookupXref(table, &table->individuals, table->individualResolver, indi);
+}
+
+int familyXref(XrefTable* table, const Family* family) {
+    return lookupXref(table, &table->families, table->familyResolver, family);
+}
+
+void deleteXrefTable(XrefTable* table) {
+    deletePointerMap(&table->individuals);
+    deletePointerMap(&table->families);
+}
+
+void appendRecordXref(OutputBuffer* out, char prefix, int number, const char* id) {
+    if (number) {
+        appendXref(out, prefix, number);
+    } else {
+        appendOutputString(out, id);
+    }
+}
+
+/////// copying unmodified records from the source file
+
+// an unmodified record can be copied when its links still match the ones in the source
+bool individualIsClean(const IndividualWithId* indi, const XrefTable* xrefs) {
+    if (indi->modified || indi->source.start < 0 ||
+        getLength(indi->individual.families) != getLength(indi->listOfFamiliesIds)) {
+        return false;
+    }
+    ListIterator it = createIterator(indi->individual.families);
+    ListIterator idIt = createIterator(indi->listOfFamiliesIds);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        const char* id = nextElement(&idIt);
+        if (getPointer(&xrefs->families, data) || strcmp(((FamilyWithIds*)data)->id, id)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool memberIsClean(const Individual* member, const char* id, const XrefTable* xrefs) {
+    if (!member || !id) {
+        return !member && !id;
+    }
+    return !getPointer(&xrefs->individuals, member) && !strcmp(((const IndividualWithId*)member)->id, id);
+}
+
+bool familyIsClean(const FamilyWithIds* family, const XrefTable* xrefs) {
+    if (family->modified || family->source.start < 0 ||
+        getLength(family->family.children) != getLength(family->childrenIds) ||
+        !memberIsClean(family->family.husband, family->husbandId, xrefs) ||
+        !memberIsClean(family->family.wife, family->wifeId, xrefs)) {
+        return false;
+    }
+    ListIterator it = createIterator(family->family.children);
+    ListIterator idIt = createIterator(family->childrenIds);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        if (!memberIsClean(data, nextElement(&idIt), xrefs)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool sameFileVersion(const struct stat* first, const struct stat* second) {
+    return first->st_dev == second->st_dev && first->st_ino == second->st_ino &&
+        first->st_size == second->st_size &&
+        first->st_mtim.tv_sec == second->st_mtim.tv_sec && first->st_mtim.tv_nsec == second->st_mtim.tv_nsec;
+}
+
+// opens the file obj was parsed from, or returns -1 if records can not be copied from it.
+// Output replaces its target only when complete, so the source can also be the target
+int openSourceFile(const GEDCOMobject* obj) {
+    const SourceFile* source = ((HeaderWithSubmitterId*)obj->header)->source;
+    if (!source) {
+        return -1;
+    }
+    struct stat info;
+    int fd = open(source->path, O_RDONLY);
+    if (fd >= 0 && (fstat(fd, &info) || !sameFileVersion(&info, &source->info))) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// whether writeGEDCOM would keep the xrefs of the source file, which it does when it can copy records from it
+bool keepsSourceXrefs(const GEDCOMobject* obj) {
+    int fd = obj->header ? openSourceFile(obj) : -1;
+    if (fd >= 0) {
+        close(fd);
+    }
+    return fd >= 0;
+}
+
+// the line end of records written next to the copied ones
+const char* sourceLineEnd(const GEDCOMobject* obj, int sourceFd) {
+    return sourceFd >= 0 ? ((HeaderWithSubmitterId*)obj->header)->source->lineEnd : "\n";
+}
+
+// copies bytes from the source in the kernel where possible, otherwise through the buffer
+void copySourceBytes(OutputBuffer* out, int sourceFd, off_t start, off_t length) {
+    flushOutput(out);
+    reserveOutput(out, out->fd < 0 ? (size_t)length : 0);
+    while (out->fd >= 0 && !out->compressor && length > 0 && !out->failed) {
+        ssize_t copied = copy_file_range(sourceFd, &start, out->fd, NULL, length, 0);
+        if (copied > 0) {
+            length -= copied;
+        } else if (copied < 0 && errno == EINTR) {
+            continue;
+        } else if (copied < 0 && errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP) {
+            out->failed = true;
+        } else {
+            break;
+        }
+    }
+    while (length > 0 && !out->failed) {
+        size_t chunk = out->text.allocated - out->text.length;
+        chunk = (off_t)chunk < length ? chunk : (size_t)length;
+        ssize_t read = pread(sourceFd, out->text.str + out->text.length, chunk, start);
+        if (read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (read <= 0) {
+            // the source is shorter than when it was parsed
+            out->failed = true;
+            break;
+        }
+        out->text.length += read;
+        start += read;
+        length -= read;
+        if (out->text.length == out->text.allocated) {
+            flushOutput(out);
+        }
+    }
+}
+
+// adjacent records are copied with one call
+typedef struct {
+    int fd;
+    off_t start;
+    off_t end;
+} SourceCopy;
+
+void flushSourceCopy(OutputBuffer* out, SourceCopy* copy) {
+    if (copy->end > copy->start) {
+        copySourceBytes(out, copy->fd, copy->start, copy->end - copy->start);
+    }
+    copy->start = copy->end = -1;
+}
+
+void queueSourceCopy(OutputBuffer* out, SourceCopy* copy, SourceRange range) {
+    if (copy->end != range.start) {
+        flushSourceCopy(out, copy);
+        copy->start = range.start;
+    }
+    copy->end = range.end;
+}
+
+GEDCOMerror writeFields(OutputBuffer* out, List list, char level) {
+    ListIterator it = createIterator(list);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        Field* field = (Field*)data;
+        appendTagLine(out, level, field->tag, field->value);
+        appendLineEnd(out);
+    }
+    return outputStatus(out);
+}
+
+GEDCOMerror writeHeader(OutputBuffer* out, const Header* obj, const char* submitterXref) {
+    appendOutputString(out, "0 HEAD");
+    appendLineEnd(out);
+    appendTagLine(out, '1', "SOUR", obj->source);
+    appendLineEnd(out);
+    appendOutputString(out, "1 GEDC");
+    appendLineEnd(out);
+    appendOutputString(out, "2 VERS ");
+    appendOutputDecimal(out, obj->gedcVersion);
+    appendLineEnd(out);
+    appendTagLine(out, '1', "CHAR", endodingToStr(obj->encoding));
+    appendLineEnd(out);
+    if (obj->submitter) {
+        appendTagLine(out, '1', "SUBM", submitterXref);
+        appendLineEnd(out);
+    }
+    return writeFields(out, obj->otherFields, '1');
+}
+
+GEDCOMerror writeEvents(OutputBuffer* out, List events) {
+    ListIterator it = createIterator(events);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        Event* event = (Event*)data;
+        appendTagLine(out, '1', event->type, NULL);
+        appendLineEnd(out);
+        if (event->date) {
+            appendTagLine(out, '2', "DATE", event->date);
+            appendLineEnd(out);
+        }
+        if (event->place) {
+            appendTagLine(out, '2', "PLAC", event->place);
+            appendLineEnd(out);
+        }
+        writeFields(out, event->otherFields, '2');
+    }
+    return outputStatus(out);
+}
+
+GEDCOMerror writeIndi(OutputBuffer* out, const Individual* indi, int number, XrefTable* xrefs) {
+    appendOutputString(out, "0 ");
+    appendRecordXref(out, 'I', number, ((const IndividualWithId*)indi)->id);
+    appendOutputString(out, " INDI");
+    appendLineEnd(out);
+    // an individual read without a NAME line has neither name
+    if (indi->givenName || indi->surname) {
+        appendOutputString(out, "1 NAME ");
+        appendOutputString(out, indi->givenName ? indi->givenName : "");
+        appendOutputString(out, " /");
+        appendOutputString(out, indi->surname ? indi->surname : "");
+        appendOutputChar(out, '/');
+        appendLineEnd(out);
+    }
+    // write families; links to families outside of the object are dropped
+    ListIterator it = createIterator(indi->families);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        Family* family = (Family*)data;
+        int familyNumber = familyXref(xrefs, family);
+        if (familyNumber < 0) {
+            continue;
+        }
+        appendOutputString(out, family->husband == indi || family->wife == indi ? "1 FAMS " : "1 FAMC ");
+        appendRecordXref(out, 'F', familyNumber, ((FamilyWithIds*)family)->id);
+        appendLineEnd(out);
+    }
+    writeEvents(out, indi->events);
+    return writeFields(out, indi->otherFields, '1');
+}
+
+void writeFamilyMember(OutputBuffer* out, const char* tag, const Individual* indi, XrefTable* xrefs) {
+    int number = individualXref(xrefs, indi);
+    if (number >= 0) {
+        appendTagLine(out, '1', tag, NULL);
+        appendOutputChar(out, ' ');
+        appendRecordXref(out, 'I', number, ((const IndividualWithId*)indi)->id);
+        appendLineEnd(out);
+    }
+}
+
+GEDCOMerror writeFamily(OutputBuffer* out, const Family* family, int number, XrefTable* xrefs) {
+    appendOutputString(out, "0 ");
+    appendRecordXref(out, 'F', number, ((const FamilyWithIds*)family)->id);
+    appendOutputString(out, " FAM");
+    appendLineEnd(out);
+    if (family->husband) {
+        writeFamilyMember(out, "HUSB", family->husband, xrefs);
+    }
+    if (family->wife) {
+        writeFamilyMember(out, "WIFE", family->wife, xrefs);
+    }
+    ListIterator it = createIterator(family->children);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        writeFamilyMember(out, "CHIL", (Individual*)data, xrefs);
+    }
+    writeEvents(out, family->events);
+    return writeFields(out, family->otherFields, '1');
+}
+
+GEDCOMerror writeSubmitter(OutputBuffer* out, const Submitter* submitter, const char* xref) {
+    appendOutputString(out, "0 ");
+    appendOutputString(out, xref);
+    appendOutputString(out, " SUBM");
+    appendLineEnd(out);
+    appendTagLine(out, '1', "NAME", submitter->submitterName);
+    appendLineEnd(out);
+    // write address; the parser keeps it as "TAG = value" lines, other sources may use plain lines
+    const char* line = submitter->address;
+    while (*line) {
+        const char* lineEnd = line;
+        for (;*lineEnd && *lineEnd != '\n'; lineEnd++);
+        bool first = line == submitter->address;
+        const char* tag = first ? "ADDR" : "CONT";
+        int tagLen = 4;
+        const char* value = line;
+        const char* separator = strstr(line, " = ");
+        if (separator && separator < lineEnd) {
+            tag = line;
+            tagLen = separator - line;
+            value = separator + 3;
+        }
+        appendOutputChar(out, first ? '1' : '2');
+        appendOutputChar(out, ' ');
+        appendOutput(out, tag, tagLen);
+        appendOutputChar(out, ' ');
+        appendOutput(out, value, lineEnd - value);
+        appendLineEnd(out);
+        if (!*lineEnd) {
+            break;
+        }
+        line = lineEnd + 1;
+    }
+    return writeFields(out, submitter->otherFields, '1');
+}
+
+
+// header and submitter
+GEDCOMerror writeLeadingRecords(OutputBuffer* out, const GEDCOMobject* obj, bool keepIds) {
+    const HeaderWithSubmitterId* header = (const HeaderWithSubmitterId*)obj->header;
+    const char* submitterXref = keepIds && header->submitterId[0] ? header->submitterId : "@U1@";
+    GEDCOMerror res = writeHeader(out, obj->header, submitterXref);
+    Submitter* submitter = obj->submitter ? obj->submitter : obj->header->submitter;
+    if (res.type == OK && submitter) {
+        res = writeSubmitter(out, submitter, submitterXref);
+    }
+    return res;
+}
+
+// formats an individual or family, or queues its source bytes when it can be copied unchanged
+GEDCOMerror writeRecord(OutputBuffer* out, SourceCopy* copy, XrefTable* xrefs, void* record, bool isFamily) {
+    if (isFamily) {
+        FamilyWithIds* family = (FamilyWithIds*)record;
+        if (copy->fd >= 0 && familyIsClean(family, xrefs)) {
+            queueSourceCopy(out, copy, family->source);
+            return createError(OK, 0);
+        }
+        flushSourceCopy(out, copy);
+        return writeFamily(out, &family->family, getPointer(&xrefs->families, family), xrefs);
+    }
+    IndividualWithId* indi = (IndividualWithId*)record;
+    if (copy->fd >= 0 && individualIsClean(indi, xrefs)) {
+        queueSourceCopy(out, copy, indi->source);
+        return createError(OK, 0);
+    }
+    flushSourceCopy(out, copy);
+    return writeIndi(out, &indi->individual, getPointer(&xrefs->individuals, indi), xrefs);
+}
+
+// records the parser does not support are kept as they were, then the trailer
+void writeTrailingRecords(OutputBuffer* out, SourceCopy* copy, const GEDCOMobject* obj) {
+    const SourceFile* source = ((const HeaderWithSubmitterId*)obj->header)->source;
+    for (int i = 0; copy->fd >= 0 && i < source->otherRecordCount; i++) {
+        queueSourceCopy(out, copy, source->otherRecords[i]);
+    }
+    flushSourceCopy(out, copy);
+    appendOutputString(out, "0 TRLR");
+    appendLineEnd(out);
+}
+
+GEDCOMerror writeGEDCOM(char* fileName, const GEDCOMobject* obj) {
+    if (!fileName || !obj || !obj->header) {
+        return createError(WRITE_ERROR, 0);
+    }
+    // unmodified records are copied from the parsed file, keeping its xrefs
+    int sourceFd = openSourceFile(obj);
+    OutputBuffer out;
+    if (!openOutput(&out, fileName, sourceFd)) {
+        if (sourceFd >= 0) {
+            close(sourceFd);
+        }
+        return createError(INV_FILE, 0);
+    }
+    out.lineEnd = sourceLineEnd(obj, sourceFd);
+    XrefTable xrefs;
+    initXrefTable(&xrefs, obj, sourceFd >= 0);
+    SourceCopy copy = { sourceFd, -1, -1 };
+
+    GEDCOMerror res = writeLeadingRecords(&out, obj, sourceFd >= 0);
+    ListIterator it = createIterator(obj->individuals);
+    for (void* data = nextElement(&it); data && res.type == OK; data = nextElement(&it)) {
+        res = writeRecord(&out, &copy, &xrefs, data, false);
+    }
+    it = createIterator(obj->families);
+    for (void* data = nextElement(&it); data && res.type == OK; data = nextElement(&it)) {
+        res = writeRecord(&out, &copy, &xrefs, data, true);
+    }
+    writeTrailingRecords(&out, &copy, obj);
+    GEDCOMerror status = closeOutput(&out);
+    if (res.type == OK) {
+        res = status;
+    }
+
+    deleteXrefTable(&xrefs);
+    if (sourceFd >= 0) {
+        close(sourceFd);
+    }
+    return res;
+}
+
+/////// parallel writer
+
+#define RECORDS_PER_WRITE_SHARD 4096
+#define MAX_WRITER_THREADS 16
+
+// a contiguous range of records formatted into a memory buffer
+typedef struct {
+    OutputBuffer out;
+    SourceCopy copy;
+    XrefTable* xrefs;
+    void** records;
+    int individualCount;
+    int first;
+    int last;
+    GEDCOMerror result;
+} WriterShard;
+
+void* formatShard(void* arg) {
+    WriterShard* shard = (WriterShard*)arg;
+    shard->out.text.length = 0;
+    shard->result = createError(OK, 0);
+    for (int i = shard->first; i < shard->last && shard->result.type == OK; i++) {
+        shard->result = writeRecord(&shard->out, &shard->copy, shard->xrefs, shard->records[i], i >= shard->individualCount);
+    }
+    flushSourceCopy(&shard->out, &shard->copy);
+    if (shard->result.type == OK) {
+        shard->result = outputStatus(&shard->out);
+    }
+    return NULL;
+}
+
+bool writeAllAt(int fd, const char* data, size_t length, off_t offset) {
+    while (length) {
+        ssize_t written = pwrite(fd, data, length, offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        length -= written;
+        offset += written;
+    }
+    return true;
+}
+
+// individuals followed by families, so shards can be cut by position
+void** collectRecords(const GEDCOMobject* obj) {
+    void** records = malloc((getLength(obj->individuals) + getLength(obj->families) + 1) * sizeof(void*));
+    int count = 0;
+    ListIterator it = createIterator(obj->individuals);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        records[count++] = data;
+    }
+    it = createIterator(obj->families);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        records[count++] = data;
+    }
+    return records;
+}
+
+GEDCOMerror writeGEDCOMthreaded(char* fileName, const GEDCOMobject* obj, int threads) {
+    if (!fileName || !obj || !obj->header) {
+        return createError(WRITE_ERROR, 0);
+    }
+    // a compressed file is one stream, written in order
+    if (isCompressedName(fileName)) {
+        return writeGEDCOM(fileName, obj);
+    }
+    if (threads <= 0) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads > MAX_WRITER_THREADS) {
+        threads = MAX_WRITER_THREADS;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    int sourceFd = openSourceFile(obj);
+    char* tempName;
+    int fd = createOutputFile(fileName, sourceFd, &tempName);
+    if (fd < 0) {
+        if (sourceFd >= 0) {
+            close(sourceFd);
+        }
+        return createError(INV_FILE, 0);
+    }
+    XrefTable xrefs;
+    initXrefTable(&xrefs, obj, sourceFd >= 0);
+    int individualCount = getLength(obj->individuals);
+    int recordCount = individualCount + getLength(obj->families);
+    void** records = collectRecords(obj);
+
+    OutputBuffer head;
+    initOutputBuffer(&head, -1);
+    head.lineEnd = sourceLineEnd(obj, sourceFd);
+    GEDCOMerror res = writeLeadingRecords(&head, obj, sourceFd >= 0);
+    off_t offset = head.text.length;
+    if (res.type == OK && !writeAllAt(fd, head.text.str, head.text.length, 0)) {
+        res = createError(WRITE_ERROR, 0);
+    }
+
+    // rounds of one shard per thread, so only that many buffers are held at once
+    WriterShard shards[MAX_WRITER_THREADS];
+    pthread_t workers[MAX_WRITER_THREADS];
+    bool started[MAX_WRITER_THREADS];
+    for (int t = 0; t < threads; t++) {
+        initOutputBuffer(&shards[t].out, -1);
+        shards[t].out.lineEnd = head.lineEnd;
+        shards[t].copy = (SourceCopy){ sourceFd, -1, -1 };
+        shards[t].xrefs = &xrefs;
+        shards[t].records = records;
+        shards[t].individualCount = individualCount;
+    }
+    for (int next = 0; next < recordCount && res.type == OK;) {
+        int running = 0;
+        for (; running < threads && next < recordCount; running++) {
+            shards[running].first = next;
+            next = recordCount - next > RECORDS_PER_WRITE_SHARD ? next + RECORDS_PER_WRITE_SHARD : recordCount;
+            shards[running].last = next;
+        }
+        // the first shard runs on the calling thread, and so does any shard whose thread cannot be started
+        for (int t = 1; t < running; t++) {
+            started[t] = !pthread_create(&workers[t], NULL, &formatShard, &shards[t]);
+            if (!started[t]) {
+                formatShard(&shards[t]);
+            }
+        }
+        formatShard(&shards[0]);
+        for (int t = 1; t < running; t++) {
+            if (started[t]) {
+                pthread_join(workers[t], NULL);
+            }
+        }
+        for (int t = 0; t < running && res.type == OK; t++) {
+            res = shards[t].result;
+            if (res.type == OK && !writeAllAt(fd, shards[t].out.text.str, shards[t].out.text.length, offset)) {
+                res = createError(WRITE_ERROR, 0);
+            }
+            offset += shards[t].out.text.length;
+        }
+    }
+
+    SourceCopy copy = { sourceFd, -1, -1 };
+    head.text.length = 0;
+    writeTrailingRecords(&head, &copy, obj);
+    if (res.type == OK) {
+        res = outputStatus(&head);
+    }
+    if (res.type == OK && !writeAllAt(fd, head.text.str, head.text.length, offset)) {
+        res = createError(WRITE_ERROR, 0);
+    }
+
+    for (int t = 0; t < threads; t++) {
+        deleteOutputBuffer(&shards[t].out);
+    }
+    deleteOutputBuffer(&head);
+    free(records);
+    deleteXrefTable(&xrefs);
+    if (sourceFd >= 0) {
+        close(sourceFd);
+    }
+    if (close(fd) && res.type == OK) {
+        res = createError(WRITE_ERROR, 0);
+    }
+    if (!finishOutputFile(tempName, res.type == OK) && res.type == OK) {
+        res = createError(WRITE_ERROR, 0);
+    }
+    return res;
+}
+
+/////// streaming writer
+
+struct gedcomWriter {
+    OutputBuffer out;
+    XrefTable xrefs;
+    bool headerWritten;
+};
+
+GEDCOMwriter* openGEDCOMwriter(const char* fileName, XrefResolver individualXref, XrefResolver familyXref, void* context) {
+    // numbering records by address would give every record streamed through one reused struct the same xref
+    if (!fileName || !individualXref || !familyXref) {
+        return NULL;
+    }
+    GEDCOMwriter* writer = malloc(sizeof(GEDCOMwriter));
+    if (!openOutput(&writer->out, fileName, -1)) {
+        free(writer);
+        return NULL;
+    }
+    initPointerMap(&writer->xrefs.individuals, 0);
+    initPointerMap(&writer->xrefs.families, 0);
+    writer->xrefs.individualResolver = individualXref;
+    writer->xrefs.familyResolver = familyXref;
+    writer->xrefs.context = context;
+    writer->headerWritten = false;
+    return writer;
+}
+
+GEDCOMerror writeHeaderRecord(GEDCOMwriter* writer, const Header* header) {
+    if (!writer || !header) {
+        return createError(OTHER_ERROR, 0);
+    }
+    if (writer->headerWritten) {
+        return createError(INV_HEADER, 0);
+    }
+    writer->headerWritten = true;
+    return writeHeader(&writer->out, header, "@U1@");
+}
+
+GEDCOMerror writeSubmitterRecord(GEDCOMwriter* writer, const Submitter* submitter) {
+    if (!writer || !submitter) {
+        return createError(OTHER_ERROR, 0);
+    }
+    if (!writer->headerWritten) {
+        return createError(INV_HEADER, 0);
+    }
+    return writeSubmitter(&writer->out, submitter, "@U1@");
+}
+
+GEDCOMerror writeIndividualRecord(GEDCOMwriter* writer, const Individual* person) {
+    if (!writer || !person) {
+        return createError(OTHER_ERROR, 0);
+    }
+    if (!writer->headerWritten) {
+        return createError(INV_HEADER, 0);
+    }
+    int number = individualXref(&writer->xrefs, person);
+    if (number <= 0) {
+        return createError(INV_RECORD, 0);
+    }
+    return writeIndi(&writer->out, person, number, &writer->xrefs);
+}
+
+GEDCOMerror writeFamilyRecord(GEDCOMwriter* writer, const Family* family) {
+    if (!writer || !family) {
+        return createError(OTHER_ERROR, 0);
+    }
+    if (!writer->headerWritten) {
+        return createError(INV_HEADER, 0);
+    }
+    int number = familyXref(&writer->xrefs, family);
+    if (number <= 0) {
+        return createError(INV_RECORD, 0);
+    }
+    return writeFamily(&writer->out, family, number, &writer->xrefs);
+}
+
+GEDCOMerror closeGEDCOMwriter(GEDCOMwriter* writer) {
+    if (!writer) {
+        return createError(OTHER_ERROR, 0);
+    }
+    appendOutputString(&writer->out, "0 TRLR");
+    appendLineEnd(&writer->out);
+    GEDCOMerror res = closeOutput(&writer->out);
+    deleteXrefTable(&writer->xrefs);
+    free(writer);
+    return res;
+}
+
+ErrorCode validateStructure(const GEDCOMobject* obj);
+
+ErrorCode validateGEDCOM(const GEDCOMobject* obj) {
+    if (!obj) {
+        return INV_GEDCOM;
+    }
+    if (!obj->header) {
+        return INV_HEADER;
+    }
+    if (!obj->header->submitter) {
+        return INV_HEADER;
+    }
+    if (!obj->header->submitter->submitterName[0]) {
+        return INV_RECORD;
+    }
+    if (obj->header->gedcVersion == 0.0f) {
+        return INV_HEADER;
+    }
+    if (!obj->submitter) {
+        return INV_GEDCOM;
+    }
+    if (!obj->submitter->submitterName[0]) {
+        return INV_RECORD;
+    }
+    return validateStructure(obj);
+}
+
+void addDescendant(const GEDCOMobject* familyRecord, const Individual* person, List** resultAsArray, int currentLevel, int maxGen) {
+    // enum families
     ListIterator it = createIterator(familyRecord->families);
     for (void* data = nextElement(&it); data; data = nextElement(&it)) {
         Family* family = (Family*)data;
@@ -1453,6 +3196,7 @@ void addDescendant(const GEDCOMobject* familyRecord, const Individual* person, L
             }
             if (!getLength(*list)) {
                 clearList(list);
+                free(list);
                 resultAsArray[currentLevel] = NULL;
             }
         }
@@ -1470,6 +3214,7 @@ List getDescendantListN(const GEDCOMobject* familyRecord, const Individual* pers
         }
         insertBack(&res, resultAsArray[i]);
     }
+    free(resultAsArray);
     return res;
 }
 
@@ -1502,6 +3247,7 @@ void addAncestor(const GEDCOMobject* familyRecord, const Individual* person, Lis
             }
             if (!getLength(*list)) {
                 clearList(list);
+                free(list);
                 resultAsArray[currentLevel] = NULL;
             }
         }
@@ -1519,195 +3265,4162 @@ List getAncestorListN(const GEDCOMobject* familyRecord, const Individual* person
         }
         insertBack(&res, resultAsArray[i]);
     }
+    free(resultAsArray);
     return res;
 }
 
-char* escapeString(const char* s) {
-    int len = strlen(s);
-    char* res = malloc(len * 2 + 1);
-    char* target = res;
-    for (const char* src = s; *src; src++) {
-        if (*src == '\"') {
-            *target++ = '\\';
-            *target++ = '\"';
-        } else {
-            *target++ = *src;
+/////// JSON emitter
+
+// first '"', '\\' or control character in [pos, end), 16 bytes at a time where SSE2 is available
+const char* findJsonSpecial(const char* pos, const char* end) {
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    for (; end - pos >= 16; pos += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)pos);
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash));
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+        int mask = _mm_movemask_epi8(special);
+        if (mask) {
+            return pos + __builtin_ctz(mask);
         }
     }
-    *target = 0;
-    return res;
+#endif
+    for (; pos < end; pos++) {
+        unsigned char c = (unsigned char)*pos;
+        if (c == '"' || c == '\\' || c < 0x20) {
+            return pos;
+        }
+    }
+    return end;
 }
 
-char* indToJSON(const Individual* ind) {
-    if (!ind) {
-        char* res = malloc(1);
-        res[0] = 0;
-        return res;
-    }
-    int len = 0;
-    char* escapedGivenName = NULL;
-    if (ind->givenName) {
-        escapedGivenName = escapeString(ind->givenName);
-        len += strlen(escapedGivenName);
+void appendJsonEscape(OutputBuffer* out, unsigned char c) {
+    char escape[6] = { '\\', (char)c, '0', '0', '0', '0' };
+    int len = 2;
+    switch (c) {
+    case '"': case '\\': break;
+    case '\n': escape[1] = 'n'; break;
+    case '\r': escape[1] = 'r'; break;
+    case '\t': escape[1] = 't'; break;
+    default:
+        escape[1] = 'u';
+        escape[4] = "0123456789abcdef"[c >> 4];
+        escape[5] = "0123456789abcdef"[c & 15];
+        len = 6;
     }
-    char* escapedSurname = NULL;
-    if (ind->surname) {
-        escapedSurname = escapeString(ind->surname);
-        len += strlen(escapedSurname);
-    }
-    len += 64;
-    char* res = malloc(len);
-    sprintf(res, "{\"givenName\":\"%s\",\"surname\":\"%s\"}",
-            escapedGivenName ? escapedGivenName : "\"\"",
-            escapedSurname ? escapedSurname : "\"\"");
-    if (escapedGivenName) {
-        free(escapedGivenName);
-    }
-    if (escapedSurname) {
-        free(escapedSurname);
-    }
-    return res;
+    appendOutput(out, escape, len);
 }
 
-char* readJsonString(const char** cursor) {
-    // *cursor[0] must be '"'
-    const char* pos = *cursor;
-    pos++;
-    int actualLen = 0;
-    for (; *pos != '\"'; actualLen++) {
-        if (*pos == '\\') {
-            pos += 2;
-        } else {
-            pos++;
+// writes str as a JSON string straight into out, copying the runs between special characters
+// with a single memcpy each; NULL is written as ""
+void appendJsonString(OutputBuffer* out, const char* str) {
+    appendOutputChar(out, '"');
+    if (str) {
+        const char* end = str + strlen(str);
+        for (const char* pos = str; pos < end; pos++) {
+            const char* special = findJsonSpecial(pos, end);
+            appendOutput(out, pos, special - pos);
+            if (special == end) {
+                break;
+            }
+            pos = special;
+            appendJsonEscape(out, (unsigned char)*special);
         }
     }
-    char* res = malloc(actualLen + 1);
-    char* target = res;
-    for (; *pos != '\"'; actualLen++) {
-        if (*pos == '\\') {
-            *target++ = *(pos + 1);
-            pos += 2;
+    appendOutputChar(out, '"');
+}
+
+// writes ,"key": (or "key": for the first member of an object)
+void appendJsonKey(OutputBuffer* out, const char* key, bool first) {
+    if (!first) {
+        appendOutputChar(out, ',');
+    }
+    appendOutputChar(out, '"');
+    appendOutputString(out, key);
+    appendOutputString(out, "\":");
+}
+
+void appendJsonName(OutputBuffer* out, const Individual* ind, bool first) {
+    appendJsonKey(out, "givenName", first);
+    appendJsonString(out, ind->givenName);
+    appendJsonKey(out, "surname", false);
+    appendJsonString(out, ind->surname);
+}
+
+void appendJsonFields(OutputBuffer* out, List fields) {
+    appendJsonKey(out, "fields", false);
+    appendOutputChar(out, '[');
+    bool first = true;
+    ListIterator it = createIterator(fields);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        Field* field = (Field*)data;
+        appendOutputString(out, first ? "{" : ",{");
+        first = false;
+        appendJsonKey(out, "tag", true);
+        appendJsonString(out, field->tag);
+        appendJsonKey(out, "value", false);
+        appendJsonString(out, field->value);
+        appendOutputChar(out, '}');
+    }
+    appendOutputChar(out, ']');
+}
+
+void appendJsonEvents(OutputBuffer* out, List events) {
+    appendJsonKey(out, "events", false);
+    appendOutputChar(out, '[');
+    bool first = true;
+    ListIterator it = createIterator(events);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        Event* event = (Event*)data;
+        appendOutputString(out, first ? "{" : ",{");
+        first = false;
+        appendJsonKey(out, "type", true);
+        appendJsonString(out, event->type);
+        appendJsonKey(out, "date", false);
+        appendJsonString(out, event->date);
+        appendJsonKey(out, "place", false);
+        appendJsonString(out, event->place);
+        appendJsonFields(out, event->otherFields);
+        appendOutputChar(out, '}');
+    }
+    appendOutputChar(out, ']');
+}
+
+// writes ,"key":[n,...] with the numbers of the linked records that are in the object
+void appendJsonLinks(OutputBuffer* out, const char* key, List records, const PointerMap* numbers) {
+    appendJsonKey(out, key, false);
+    appendOutputChar(out, '[');
+    bool first = true;
+    ListIterator it = createIterator(records);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        int number = getPointer(numbers, data);
+        if (number >= 0) {
+            if (!first) {
+                appendOutputChar(out, ',');
+            }
+            first = false;
+            appendOutputNumber(out, number);
+        }
+    }
+    appendOutputChar(out, ']');
+}
+
+void appendJsonMember(OutputBuffer* out, const char* key, bool first, const Individual* member, const PointerMap* numbers) {
+    appendJsonKey(out, key, first);
+    int number = member ? getPointer(numbers, member) : -1;
+    if (number >= 0) {
+        appendOutputNumber(out, number);
+    } else {
+        appendOutputString(out, "null");
+    }
+}
+
+// the whole object; records link to each other by their position in the individuals and families arrays
+void appendJsonGEDCOM(OutputBuffer* out, const GEDCOMobject* obj) {
+    PointerMap individualNumbers;
+    PointerMap familyNumbers;
+    initPointerMap(&individualNumbers, getLength(obj->individuals));
+    initPointerMap(&familyNumbers, getLength(obj->families));
+    int counter = 0;
+    ListIterator it = createIterator(obj->individuals);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        putPointer(&individualNumbers, data, counter++);
+    }
+    counter = 0;
+    it = createIterator(obj->families);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        putPointer(&familyNumbers, data, counter++);
+    }
+
+    appendOutputChar(out, '{');
+    appendJsonKey(out, "header", true);
+    appendOutputChar(out, '{');
+    appendJsonKey(out, "source", true);
+    appendJsonString(out, obj->header->source);
+    appendJsonKey(out, "gedcVersion", false);
+    char version[32];
+    snprintf(version, sizeof(version), "%g", obj->header->gedcVersion);
+    appendOutputString(out, version);
+    appendJsonKey(out, "encoding", false);
+    appendJsonString(out, endodingToStr(obj->header->encoding));
+    appendJsonFields(out, obj->header->otherFields);
+    appendOutputChar(out, '}');
+
+    Submitter* submitter = obj->submitter ? obj->submitter : obj->header->submitter;
+    appendJsonKey(out, "submitter", false);
+    if (submitter) {
+        appendOutputChar(out, '{');
+        appendJsonKey(out, "name", true);
+        appendJsonString(out, submitter->submitterName);
+        appendJsonKey(out, "address", false);
+        appendJsonString(out, submitter->address);
+        appendJsonFields(out, submitter->otherFields);
+        appendOutputChar(out, '}');
+    } else {
+        appendOutputString(out, "null");
+    }
+
+    appendJsonKey(out, "individuals", false);
+    appendOutputChar(out, '[');
+    bool first = true;
+    it = createIterator(obj->individuals);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        Individual* indi = (Individual*)data;
+        appendOutputString(out, first ? "{" : ",{");
+        first = false;
+        appendJsonName(out, indi, true);
+        appendJsonEvents(out, indi->events);
+        appendJsonFields(out, indi->otherFields);
+        appendJsonLinks(out, "families", indi->families, &familyNumbers);
+        appendOutputChar(out, '}');
+    }
+    appendOutputChar(out, ']');
+
+    appendJsonKey(out, "families", false);
+    appendOutputChar(out, '[');
+    first = true;
+    it = createIterator(obj->families);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        Family* family = (Family*)data;
+        appendOutputString(out, first ? "{" : ",{");
+        first = false;
+        appendJsonMember(out, "husband", true, family->husband, &individualNumbers);
+        appendJsonMember(out, "wife", false, family->wife, &individualNumbers);
+        appendJsonLinks(out, "children", family->children, &individualNumbers);
+        appendJsonEvents(out, family->events);
+        appendJsonFields(out, family->otherFields);
+        appendOutputChar(out, '}');
+    }
+    appendOutputString(out, "]}");
+
+    deletePointerMap(&individualNumbers);
+    deletePointerMap(&familyNumbers);
+}
+
+// ends a memory buffer and hands its text to the caller
+char* takeOutputString(OutputBuffer* out) {
+    reserveOutput(out, 1);
+    out->text.str[out->text.length] = '\0';
+    return takeBuilderString(&out->text);
+}
+
+char* GEDCOMtoJSON(const GEDCOMobject* obj) {
+    OutputBuffer out;
+    initOutputBuffer(&out, -1);
+    if (obj && obj->header) {
+        appendJsonGEDCOM(&out, obj);
+    }
+    return takeOutputString(&out);
+}
+
+GEDCOMerror writeGEDCOMJSON(FILE* file, const GEDCOMobject* obj) {
+    if (!file || !obj || !obj->header) {
+        return createError(WRITE_ERROR, 0);
+    }
+    // output goes around stdio, after what is already buffered there
+    if (fflush(file)) {
+        return createError(WRITE_ERROR, 0);
+    }
+    OutputBuffer out;
+    initOutputBuffer(&out, fileno(file));
+    appendJsonGEDCOM(&out, obj);
+    flushOutput(&out);
+    GEDCOMerror res = outputStatus(&out);
+    deleteOutputBuffer(&out);
+    return res;
+}
+
+char* indToJSON(const Individual* ind) {
+    OutputBuffer out;
+    initOutputBuffer(&out, -1);
+    if (ind) {
+        appendOutputChar(&out, '{');
+        appendJsonName(&out, ind, true);
+        appendOutputChar(&out, '}');
+    }
+    return takeOutputString(&out);
+}
+
+void appendJsonIndividuals(OutputBuffer* out, List iList) {
+    appendOutputChar(out, '[');
+    bool first = true;
+    ListIterator it = createIterator(iList);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        appendOutputString(out, first ? "{" : ",{");
+        first = false;
+        appendJsonName(out, (Individual*)data, true);
+        appendOutputChar(out, '}');
+    }
+    appendOutputChar(out, ']');
+}
+
+/////// NDJSON export
+
+// upper bound on the number of shard files of one export
+#define MAX_NDJSON_SHARDS 4096
+
+// an xref as a JSON string, or null for records that are not in the object
+void appendJsonXref(OutputBuffer* out, char prefix, int number, const char* id) {
+    if (number < 0) {
+        appendOutputString(out, "null");
+    } else if (number) {
+        appendOutputChar(out, '"');
+        appendXref(out, prefix, number);
+        appendOutputChar(out, '"');
+    } else {
+        appendJsonString(out, id);
+    }
+}
+
+int individualXrefOrNull(XrefTable* xrefs, const Individual* indi) {
+    return indi ? individualXref(xrefs, indi) : -1;
+}
+
+void appendJsonXrefList(OutputBuffer* out, const char* key, XrefTable* xrefs, List records, bool families) {
+    appendJsonKey(out, key, false);
+    appendOutputChar(out, '[');
+    bool first = true;
+    ListIterator it = createIterator(records);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        int number = families ? familyXref(xrefs, data) : individualXref(xrefs, data);
+        if (number >= 0) {
+            if (!first) {
+                appendOutputChar(out, ',');
+            }
+            first = false;
+            appendJsonXref(out, families ? 'F' : 'I', number, families ? ((FamilyWithIds*)data)->id : ((IndividualWithId*)data)->id);
+        }
+    }
+    appendOutputChar(out, ']');
+}
+
+// one line per record, with the xrefs writeGEDCOM would give it and its links
+void appendNdjsonRecord(OutputBuffer* out, XrefTable* xrefs, void* record, bool isFamily) {
+    appendOutputChar(out, '{');
+    appendJsonKey(out, "type", true);
+    if (!isFamily) {
+        IndividualWithId* indi = (IndividualWithId*)record;
+        appendOutputString(out, "\"INDI\"");
+        appendJsonKey(out, "xref", false);
+        appendJsonXref(out, 'I', individualXref(xrefs, record), indi->id);
+        appendJsonName(out, &indi->individual, false);
+        appendJsonEvents(out, indi->individual.events);
+        appendJsonFields(out, indi->individual.otherFields);
+        appendJsonXrefList(out, "families", xrefs, indi->individual.families, true);
+    } else {
+        FamilyWithIds* family = (FamilyWithIds*)record;
+        Individual* husband = family->family.husband;
+        Individual* wife = family->family.wife;
+        appendOutputString(out, "\"FAM\"");
+        appendJsonKey(out, "xref", false);
+        appendJsonXref(out, 'F', familyXref(xrefs, record), family->id);
+        appendJsonKey(out, "husband", false);
+        appendJsonXref(out, 'I', individualXrefOrNull(xrefs, husband), husband ? ((IndividualWithId*)husband)->id : NULL);
+        appendJsonKey(out, "wife", false);
+        appendJsonXref(out, 'I', individualXrefOrNull(xrefs, wife), wife ? ((IndividualWithId*)wife)->id : NULL);
+        appendJsonXrefList(out, "children", xrefs, family->family.children, false);
+        appendJsonEvents(out, family->family.events);
+        appendJsonFields(out, family->family.otherFields);
+    }
+    appendOutputString(out, "}\n");
+}
+
+GEDCOMerror writeGEDCOMNDJSON(int fd, const GEDCOMobject* obj) {
+    if (fd < 0 || !obj) {
+        return createError(WRITE_ERROR, 0);
+    }
+    XrefTable xrefs;
+    initXrefTable(&xrefs, obj, keepsSourceXrefs(obj));
+    OutputBuffer out;
+    initOutputBuffer(&out, fd);
+    ListIterator it = createIterator(obj->individuals);
+    for (void* data = nextElement(&it); data && !out.failed; data = nextElement(&it)) {
+        appendNdjsonRecord(&out, &xrefs, data, false);
+    }
+    it = createIterator(obj->families);
+    for (void* data = nextElement(&it); data && !out.failed; data = nextElement(&it)) {
+        appendNdjsonRecord(&out, &xrefs, data, true);
+    }
+    flushOutput(&out);
+    GEDCOMerror res = outputStatus(&out);
+    deleteOutputBuffer(&out);
+    deleteXrefTable(&xrefs);
+    return res;
+}
+
+// a contiguous range of records written to its own file
+typedef struct {
+    char* fileName;
+    XrefTable* xrefs;
+    void** records;
+    int individualCount;
+    int first;
+    int last;
+    GEDCOMerror result;
+} NdjsonShard;
+
+void* writeNdjsonShard(void* arg) {
+    NdjsonShard* shard = (NdjsonShard*)arg;
+    int fd = open(shard->fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        shard->result = createError(INV_FILE, 0);
+        return NULL;
+    }
+    OutputBuffer out;
+    initOutputBuffer(&out, fd);
+    for (int i = shard->first; i < shard->last && !out.failed; i++) {
+        appendNdjsonRecord(&out, shard->xrefs, shard->records[i], i >= shard->individualCount);
+    }
+    flushOutput(&out);
+    shard->result = outputStatus(&out);
+    deleteOutputBuffer(&out);
+    if (close(fd) && shard->result.type == OK) {
+        shard->result = createError(WRITE_ERROR, 0);
+    }
+    return NULL;
+}
+
+GEDCOMerror writeGEDCOMNDJSONshards(const char* prefix, const GEDCOMobject* obj, int shards) {
+    if (!prefix || !obj || shards < 1 || shards > MAX_NDJSON_SHARDS) {
+        return createError(WRITE_ERROR, 0);
+    }
+    XrefTable xrefs;
+    initXrefTable(&xrefs, obj, keepsSourceXrefs(obj));
+    int individualCount = getLength(obj->individuals);
+    int recordCount = individualCount + getLength(obj->families);
+    void** records = collectRecords(obj);
+    NdjsonShard* parts = malloc(shards * sizeof(NdjsonShard));
+    size_t nameSize = strlen(prefix) + 32;
+    for (int n = 0; n < shards; n++) {
+        parts[n].fileName = malloc(nameSize);
+        snprintf(parts[n].fileName, nameSize, "%s.%d.ndjson", prefix, n);
+        parts[n].xrefs = &xrefs;
+        parts[n].records = records;
+        parts[n].individualCount = individualCount;
+        parts[n].first = (int)((long long)recordCount * n / shards);
+        parts[n].last = (int)((long long)recordCount * (n + 1) / shards);
+    }
+
+    // at most MAX_WRITER_THREADS files are open at once; the first of each round runs on the calling thread
+    pthread_t workers[MAX_WRITER_THREADS];
+    bool started[MAX_WRITER_THREADS];
+    for (int base = 0; base < shards; base += MAX_WRITER_THREADS) {
+        int running = shards - base < MAX_WRITER_THREADS ? shards - base : MAX_WRITER_THREADS;
+        for (int t = 1; t < running; t++) {
+            started[t] = !pthread_create(&workers[t], NULL, &writeNdjsonShard, &parts[base + t]);
+            if (!started[t]) {
+                writeNdjsonShard(&parts[base + t]);
+            }
+        }
+        writeNdjsonShard(&parts[base]);
+        for (int t = 1; t < running; t++) {
+            if (started[t]) {
+                pthread_join(workers[t], NULL);
+            }
+        }
+    }
+
+    GEDCOMerror res = createError(OK, 0);
+    for (int n = 0; n < shards; n++) {
+        if (res.type == OK) {
+            res = parts[n].result;
+        }
+        free(parts[n].fileName);
+    }
+    free(parts);
+    free(records);
+    deleteXrefTable(&xrefs);
+    return res;
+}
+
+/////// TSV export for LOAD DATA INFILE
+
+// a field in the default LOAD DATA format: tab separated, backslash escaped, \N for NULL
+void appendTsvField(OutputBuffer* out, const char* value, bool last) {
+    if (!value) {
+        appendOutputString(out, "\\N");
+    }
+    for (const char* pos = value; pos && *pos;) {
+        size_t run = strcspn(pos, "\\\t\n\r");
+        appendOutput(out, pos, run);
+        pos += run;
+        if (*pos) {
+            appendOutputChar(out, '\\');
+            appendOutputChar(out, *pos == '\t' ? 't' : *pos == '\n' ? 'n' : *pos == '\r' ? 'r' : '\\');
+            pos++;
+        }
+    }
+    appendOutputChar(out, last ? '\n' : '\t');
+}
+
+void appendTsvNumber(OutputBuffer* out, long long value, bool last) {
+    if (value < 0) {
+        appendOutputChar(out, '-');
+        value = -value;
+    }
+    appendOutputNumber(out, (unsigned long long)value);
+    appendOutputChar(out, last ? '\n' : '\t');
+}
+
+GEDCOMerror writeGEDCOMfileTSV(int fd, const GEDCOMobject* obj, const char* fileName, int fileId) {
+    if (fd < 0 || !obj || !obj->header || !fileName) {
+        return createError(WRITE_ERROR, 0);
+    }
+    Submitter* submitter = obj->submitter ? obj->submitter : obj->header->submitter;
+    char version[32];
+    snprintf(version, sizeof(version), "%g", obj->header->gedcVersion);
+    OutputBuffer out;
+    initOutputBuffer(&out, fd);
+    appendTsvNumber(&out, fileId, false);
+    appendTsvField(&out, fileName, false);
+    appendTsvField(&out, obj->header->source, false);
+    appendTsvField(&out, version, false);
+    appendTsvField(&out, endodingToStr(obj->header->encoding), false);
+    appendTsvField(&out, submitter ? submitter->submitterName : NULL, false);
+    appendTsvField(&out, submitter ? submitter->address : NULL, false);
+    appendTsvNumber(&out, getLength(obj->individuals), false);
+    appendTsvNumber(&out, getLength(obj->families), true);
+    flushOutput(&out);
+    GEDCOMerror res = outputStatus(&out);
+    deleteOutputBuffer(&out);
+    return res;
+}
+
+// counts member unless it was already seen for the person numbered stamp
+int countFamilyMember(PointerMap* seen, const Individual* member, int stamp) {
+    if (!member || getPointer(seen, member) == stamp) {
+        return 0;
+    }
+    putPointer(seen, member, stamp);
+    return 1;
+}
+
+GEDCOMerror writeGEDCOMindividualsTSV(int fd, const GEDCOMobject* obj, int fileId) {
+    if (fd < 0 || !obj) {
+        return createError(WRITE_ERROR, 0);
+    }
+    // the person each member was last counted for, so nobody is counted twice
+    PointerMap seen;
+    initPointerMap(&seen, getLength(obj->individuals));
+    OutputBuffer out;
+    initOutputBuffer(&out, fd);
+    int stamp = 0;
+    ListIterator it = createIterator(obj->individuals);
+    for (void* data = nextElement(&it); data && !out.failed; data = nextElement(&it), stamp++) {
+        Individual* indi = (Individual*)data;
+        const char* sex = NULL;
+        char sexValue[2] = { 0, 0 };
+        ListIterator fieldIt = createIterator(indi->otherFields);
+        for (void* fieldData = nextElement(&fieldIt); fieldData && !sex; fieldData = nextElement(&fieldIt)) {
+            Field* field = (Field*)fieldData;
+            if (!strcmp(field->tag, "SEX") && field->value && field->value[0]) {
+                sexValue[0] = field->value[0];
+                sex = sexValue;
+            }
+        }
+        // distinct people of all the families the person belongs to, the person included
+        int familySize = 0;
+        ListIterator familyIt = createIterator(indi->families);
+        for (void* familyData = nextElement(&familyIt); familyData; familyData = nextElement(&familyIt)) {
+            Family* family = (Family*)familyData;
+            familySize += countFamilyMember(&seen, family->husband, stamp);
+            familySize += countFamilyMember(&seen, family->wife, stamp);
+            ListIterator childIt = createIterator(family->children);
+            for (void* child = nextElement(&childIt); child; child = nextElement(&childIt)) {
+                familySize += countFamilyMember(&seen, child, stamp);
+            }
+        }
+        appendTsvField(&out, indi->surname, false);
+        appendTsvField(&out, indi->givenName, false);
+        appendTsvField(&out, sex, false);
+        appendTsvNumber(&out, familySize, false);
+        appendTsvNumber(&out, fileId, true);
+    }
+    flushOutput(&out);
+    GEDCOMerror res = outputStatus(&out);
+    deleteOutputBuffer(&out);
+    deletePointerMap(&seen);
+    return res;
+}
+
+/////// quick scan
+
+// what FileProbe.onRecord is called for
+enum {PROBED_INDIVIDUAL, PROBED_FAMILY, PROBED_PARSED};
+
+// HEAD and SUBM go through the parser into obj; of the other records only the first line is read
+typedef struct {
+    GEDCOMobject* obj;
+    ParserScope scopes[MAX_PARSER_DEEP];
+    // inside HEAD or SUBM
+    bool parsing;
+    bool finished;
+    int prevLevel;
+    int individualCount;
+    int familyCount;
+    // when set, called with the level 0 line and the xref of every individual, family and parsed record
+    void (*onRecord)(void* context, const char* line, const char* xref, const char* xrefEnd, int kind);
+    void* context;
+} FileProbe;
+
+void initFileProbe(FileProbe* probe) {
+    probe->obj = malloc(sizeof(GEDCOMobject));
+    initGEDCOMobject(probe->obj);
+    probe->scopes[0].receiver = probe->obj;
+    probe->scopes[0].enter = &GEDCOMobjectEnter;
+    probe->parsing = true;
+    probe->finished = false;
+    probe->prevLevel = -1;
+    probe->individualCount = probe->familyCount = 0;
+    probe->onRecord = NULL;
+    probe->context = NULL;
+}
+
+// a line of HEAD or SUBM, checked like createGEDCOM does; line numbers are not counted
+GEDCOMerror probeParsedLine(FileProbe* probe, const char* start, const char* lineEnd) {
+    char line[256];
+    size_t len = lineEnd - start;
+    if (len > 255) {
+        return createError(INV_RECORD, -1);
+    }
+    memcpy(line, start, len);
+    line[len] = '\0';
+    int level = atoi(line);
+    if (level && !probe->obj->header) {
+        return createError(INV_HEADER, -1);
+    }
+    if (level < 0 || level > probe->prevLevel + 1 || level >= MAX_PARSER_DEEP - 1) {
+        return createError(INV_RECORD, -1);
+    }
+    probe->prevLevel = level;
+    ParserScope* scope = probe->scopes + level;
+    return scope->enter(scope->receiver, line, scope + 1);
+}
+
+// the first line of a record; lineEnd - start >= 2
+GEDCOMerror probeRecord(FileProbe* probe, const char* start, const char* lineEnd) {
+    if (lineEnd - start >= 6 && !memcmp(start, "0 TRLR", 6)) {
+        probe->finished = true;
+        return createError(OK, 0);
+    }
+    const char* word = start + 1;
+    for (; word < lineEnd && isspace((unsigned char)*word); word++);
+    const char* wordEnd = word;
+    for (; wordEnd < lineEnd && !isspace((unsigned char)*wordEnd); wordEnd++);
+    const char* type = wordEnd;
+    for (; type < lineEnd && isspace((unsigned char)*type); type++);
+    const char* typeEnd = type;
+    for (; typeEnd < lineEnd && !isspace((unsigned char)*typeEnd); typeEnd++);
+
+    probe->parsing = !probe->obj->header || wordIs(word, wordEnd, "HEAD") || wordIs(type, typeEnd, "SUBM");
+    if (probe->parsing) {
+        if (probe->onRecord) {
+            probe->onRecord(probe->context, start, word, wordEnd, PROBED_PARSED);
+        }
+        return probeParsedLine(probe, start, lineEnd);
+    }
+    if (!headerIsComplete(probe->obj->header)) {
+        return createError(INV_HEADER, -1);
+    }
+    if (type == typeEnd) {
+        return createError(INV_GEDCOM, -1);
+    }
+    bool isIndividual = wordIs(type, typeEnd, "INDI");
+    bool isFamily = wordIs(type, typeEnd, "FAM");
+    probe->individualCount += isIndividual;
+    probe->familyCount += isFamily;
+    if ((isIndividual || isFamily) && probe->onRecord) {
+        probe->onRecord(probe->context, start, word, wordEnd, isFamily ? PROBED_FAMILY : PROBED_INDIVIDUAL);
+    }
+    probe->prevLevel = 0;
+    return createError(OK, 0);
+}
+
+// text starts at a line start and ends at a line end; the bodies of counted records are jumped over
+GEDCOMerror probeText(FileProbe* probe, const char* pos, const char* end) {
+    GEDCOMerror res = createError(OK, 0);
+    while (pos < end && !probe->finished && res.type == OK) {
+        if (*pos == '\n' || *pos == '\r') {
+            pos++;
+            continue;
+        }
+        const char* lineEnd = findLineEnd(pos, end);
+        if (lineEnd - pos >= 2 && pos[0] == '0' && pos[1] == ' ') {
+            res = probeRecord(probe, pos, lineEnd);
+        } else if (probe->parsing) {
+            res = probeParsedLine(probe, pos, lineEnd);
+        }
+        pos = probe->parsing ? lineEnd : findLevelZeroLine(lineEnd, end);
+    }
+    return res;
+}
+
+// maps a whole file for reading; an empty file gives NULL and size 0. info may be NULL
+GEDCOMerror mapTextFile(const char* fileName, const char** image, size_t* size, struct stat* info) {
+    *image = NULL;
+    *size = 0;
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) {
+        return createError(INV_FILE, -1);
+    }
+    struct stat st;
+    if (!info) {
+        info = &st;
+    }
+    if (fstat(fd, info)) {
+        close(fd);
+        return createError(INV_FILE, -1);
+    }
+    if (info->st_size) {
+        void* mapped = mmap(NULL, info->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            close(fd);
+            return createError(INV_FILE, -1);
+        }
+        *image = mapped;
+        *size = info->st_size;
+        madvise(mapped, *size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    return createError(OK, 0);
+}
+
+GEDCOMerror probeMappedFile(FileProbe* probe, const char* fileName) {
+    const char* image;
+    size_t size;
+    GEDCOMerror res = mapTextFile(fileName, &image, &size, NULL);
+    if (res.type == OK && image) {
+        res = probeText(probe, image, image + size);
+        munmap((void*)image, size);
+    }
+    return res;
+}
+
+GEDCOMerror probeCompressedFile(FileProbe* probe, const char* fileName) {
+    LineInput input;
+    GEDCOMerror res = openLineInput(&input, (char*)fileName);
+    while (res.type == OK && !probe->finished && nextInputChunk(&input)) {
+        res = probeText(probe, input.position, input.position + strlen(input.position));
+    }
+    if (res.type == OK && !probe->finished && lineInputFailed(&input)) {
+        res = createError(INV_FILE, -1);
+    }
+    closeLineInput(&input);
+    return res;
+}
+
+// the checks createGEDCOM makes after the last line
+GEDCOMerror finishProbe(FileProbe* probe) {
+    if (!probe->finished || !probe->obj->submitter) {
+        return createError(INV_GEDCOM, -1);
+    }
+    if (!probe->obj->header->submitter) {
+        return createError(INV_HEADER, -1);
+    }
+    return createError(OK, 0);
+}
+
+GEDCOMerror probeGEDCOM(const char* fileName, GEDCOMsummary* summary) {
+    if (!summary || !isGEDCOMfileName(fileName)) {
+        return createError(INV_FILE, -1);
+    }
+    FileProbe probe;
+    initFileProbe(&probe);
+    GEDCOMerror res = isCompressedName(fileName) ? probeCompressedFile(&probe, fileName) : probeMappedFile(&probe, fileName);
+    if (res.type == OK) {
+        res = finishProbe(&probe);
+    }
+    GEDCOMobject* obj = probe.obj;
+    if (res.type == OK) {
+        memcpy(summary->source, obj->header->source, sizeof(summary->source));
+        summary->source[sizeof(summary->source) - 1] = '\0';
+        summary->gedcVersion = obj->header->gedcVersion;
+        summary->encoding = obj->header->encoding;
+        memcpy(summary->submitterName, obj->submitter->submitterName, sizeof(summary->submitterName));
+        summary->submitterName[sizeof(summary->submitterName) - 1] = '\0';
+        snprintf(summary->submitterAddress, sizeof(summary->submitterAddress), "%s", obj->submitter->address);
+        summary->individualCount = probe.individualCount;
+        summary->familyCount = probe.familyCount;
+    }
+    deleteGEDCOM(obj);
+    return res;
+}
+
+char* summaryToJSON(const GEDCOMsummary* summary) {
+    OutputBuffer out;
+    initOutputBuffer(&out, -1);
+    if (summary) {
+        appendOutputChar(&out, '{');
+        appendJsonKey(&out, "source", true);
+        appendJsonString(&out, summary->source);
+        appendJsonKey(&out, "gedcVersion", false);
+        char version[32];
+        snprintf(version, sizeof(version), "%g", summary->gedcVersion);
+        appendOutputString(&out, version);
+        appendJsonKey(&out, "encoding", false);
+        appendJsonString(&out, endodingToStr(summary->encoding));
+        appendJsonKey(&out, "submitterName", false);
+        appendJsonString(&out, summary->submitterName);
+        appendJsonKey(&out, "submitterAddress", false);
+        appendJsonString(&out, summary->submitterAddress);
+        appendJsonKey(&out, "individualCount", false);
+        appendOutputNumber(&out, summary->individualCount);
+        appendJsonKey(&out, "familyCount", false);
+        appendOutputNumber(&out, summary->familyCount);
+        appendOutputChar(&out, '}');
+    }
+    return takeOutputString(&out);
+}
+
+/////// lazy loading
+
+#define LAZY_INDEX_MAGIC "GEDIDX"
+#define LAZY_INDEX_VERSION 1
+#define LAZY_INDEX_BYTE_ORDER 0x01020304u
+// the source is recognized by its size, modification time and a hash of these parts of it
+#define INDEX_SAMPLES 64
+#define INDEX_SAMPLE_SIZE 4096
+// in the links of a family: no husband or wife
+#define NO_RECORD 0xffffffffu
+// a link to an xref that no record has; linking the record fails
+#define MISSING_RECORD 0xfffffffeu
+
+// the tables of a lazily opened file, and the sections of its sidecar index
+enum {
+    INDEX_OFFSETS, INDEX_HASHES, INDEX_SLOTS, INDEX_LINK_STARTS, INDEX_LINKS, INDEX_PARSED, INDEX_SECTION_COUNT
+};
+
+typedef struct {
+    uint64_t offset;
+    uint64_t size;
+} IndexSection;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t fileSize;
+    uint64_t sourceSize;
+    int64_t sourceSeconds;
+    int64_t sourceNanoseconds;
+    uint64_t sourceHash;
+    uint32_t individualCount;
+    uint32_t familyCount;
+    IndexSection sections[INDEX_SECTION_COUNT];
+} LazyIndexHeader;
+
+struct gedcomLazy {
+    const char* image;
+    size_t size;
+    // parser.obj holds the header, the submitter and every record parsed so far
+    FileProbe parser;
+    // records are numbered in file order, individuals first and families after them
+    uint32_t individualCount;
+    uint32_t familyCount;
+    // offset of the level 0 line and hash of the xref of every record
+    const uint64_t* offsets;
+    const uint32_t* hashes;
+    // open addressing table of record number + 1; 0 is free
+    const uint32_t* slots;
+    uint32_t slotMask;
+    // links of record n are links[linkStarts[n]] to links[linkStarts[n + 1] - 1]:
+    // the families of an individual; the husband, wife and children of a family
+    const uint32_t* linkStarts;
+    const uint32_t* links;
+    uint32_t linkCount;
+    // offsets of the HEAD and SUBM records
+    const uint64_t* parsedOffsets;
+    uint32_t parsedCount;
+    // where the tables are built, unless they are mapped from the sidecar index
+    StringBuilder tables[INDEX_SECTION_COUNT];
+    const char* indexImage;
+    size_t indexSize;
+    // parsed record, or NULL before the first access
+    void** records;
+    bool* linked;
+    // parsed record -> record number
+    PointerMap numbers;
+};
+
+uint32_t xrefHash(const char* xref, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)xref[i]) * 16777619u;
+    }
+    return h;
+}
+
+uint64_t hashBytes(uint64_t h, const char* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)data[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+// hash of the start, the end and INDEX_SAMPLES evenly spaced parts of the source
+uint64_t sampleSourceHash(const char* image, size_t size) {
+    uint64_t h = 14695981039346656037ull;
+    if (size <= (INDEX_SAMPLES + 2) * INDEX_SAMPLE_SIZE) {
+        return hashBytes(h, image, size);
+    }
+    h = hashBytes(h, image, INDEX_SAMPLE_SIZE);
+    for (int i = 1; i <= INDEX_SAMPLES; i++) {
+        h = hashBytes(h, image + size / (INDEX_SAMPLES + 1) * i, INDEX_SAMPLE_SIZE);
+    }
+    return hashBytes(h, image + size - INDEX_SAMPLE_SIZE, INDEX_SAMPLE_SIZE);
+}
+
+// the xref on the level 0 line of a record
+const char* lazyXref(const GEDCOMlazy* lazy, uint64_t offset, size_t* len) {
+    const char* end = lazy->image + lazy->size;
+    const char* xref = lazy->image + (offset < lazy->size ? offset : lazy->size);
+    xref += xref < end;
+    for (; xref < end && isspace((unsigned char)*xref); xref++);
+    const char* xrefEnd = xref;
+    for (; xrefEnd < end && !isspace((unsigned char)*xrefEnd); xrefEnd++);
+    *len = xrefEnd - xref;
+    return xref;
+}
+
+bool isLazyFamily(const GEDCOMlazy* lazy, uint32_t number) {
+    return number >= lazy->individualCount;
+}
+
+// record number of the xref among individuals or families, or -1
+int64_t findLazyRecord(const GEDCOMlazy* lazy, const char* xref, size_t len, bool isFamily) {
+    uint32_t total = lazy->individualCount + lazy->familyCount;
+    uint32_t hash = xrefHash(xref, len);
+    // bounded, since a damaged index may have no free slot
+    uint32_t pos = hash & lazy->slotMask;
+    for (uint32_t probes = 0; probes <= lazy->slotMask && lazy->slots[pos]; probes++, pos = (pos + 1) & lazy->slotMask) {
+        uint32_t number = lazy->slots[pos] - 1;
+        if (number >= total || isLazyFamily(lazy, number) != isFamily || lazy->hashes[number] != hash) {
+            continue;
+        }
+        size_t foundLen;
+        const char* found = lazyXref(lazy, lazy->offsets[number], &foundLen);
+        if (foundLen == len && !memcmp(found, xref, len)) {
+            return number;
+        }
+    }
+    return -1;
+}
+
+/////// building the index
+
+// the level 0 lines found by the scan: offset and xref hash of individuals and families, offsets of HEAD and SUBM
+typedef struct {
+    GEDCOMlazy* lazy;
+    StringBuilder records[2];
+} LazyScan;
+
+void addLazyRecord(void* context, const char* line, const char* xref, const char* xrefEnd, int kind) {
+    LazyScan* scan = (LazyScan*)context;
+    uint64_t entry[2] = { line - scan->lazy->image, xrefHash(xref, xrefEnd - xref) };
+    if (kind == PROBED_PARSED) {
+        appendToBuilder(&scan->lazy->tables[INDEX_PARSED], (const char*)entry, sizeof(uint64_t));
+    } else {
+        appendToBuilder(&scan->records[kind == PROBED_FAMILY], (const char*)entry, sizeof(entry));
+    }
+}
+
+void appendLink(StringBuilder* links, uint32_t link) {
+    appendToBuilder(links, (const char*)&link, sizeof(link));
+}
+
+// the links of a record, read from its level 1 lines the way IndiEnter and FamilyEnter read them
+void appendLazyLinks(const GEDCOMlazy* lazy, uint32_t number, StringBuilder* links) {
+    bool isFamily = isLazyFamily(lazy, number);
+    size_t first = links->length;
+    if (isFamily) {
+        appendLink(links, NO_RECORD);
+        appendLink(links, NO_RECORD);
+    }
+    const char* end = lazy->image + lazy->size;
+    const char* pos = findLineEnd(lazy->image + lazy->offsets[number], end);
+    for (;;) {
+        for (; pos < end && (*pos == '\n' || *pos == '\r'); pos++);
+        if (end - pos < 2 || (pos[0] == '0' && pos[1] == ' ')) {
+            break;
+        }
+        const char* lineEnd = findLineEnd(pos, end);
+        char line[256];
+        size_t len = lineEnd - pos;
+        // a longer line makes the record invalid when it is parsed
+        if (len < sizeof(line)) {
+            memcpy(line, pos, len);
+            line[len] = '\0';
+        }
+        if (len < sizeof(line) && atoi(line) == 1) {
+            char* tag = skipSpaces(skipWord(line));
+            char* tagEnd = skipWord(tag);
+            char* value = skipSpaces(tagEnd);
+            char* valueEnd = skipWord(value);
+            *tagEnd = '\0';
+            int64_t found = findLazyRecord(lazy, value, valueEnd - value, !isFamily);
+            uint32_t link = found < 0 ? MISSING_RECORD : (uint32_t)found;
+            if (!isFamily && (!strcmp(tag, "FAMS") || !strcmp(tag, "FAMC"))) {
+                appendLink(links, link);
+            } else if (isFamily && (!strcmp(tag, "HUSB") || !strcmp(tag, "WIFE"))) {
+                // the last line wins, as in FamilyEnter
+                memcpy(links->str + first + (tag[0] == 'W') * sizeof(uint32_t), &link, sizeof(link));
+            } else if (isFamily && !strcmp(tag, "CHIL")) {
+                appendLink(links, link);
+            }
+        }
+        pos = lineEnd;
+    }
+}
+
+// scans the source and builds every table; xrefs that appear twice resolve to the first record, like findIndiById
+GEDCOMerror buildLazyIndex(GEDCOMlazy* lazy) {
+    LazyScan scan;
+    scan.lazy = lazy;
+    initStringBuilder(&scan.records[0], 0);
+    initStringBuilder(&scan.records[1], 0);
+    lazy->parser.onRecord = &addLazyRecord;
+    lazy->parser.context = &scan;
+    GEDCOMerror res = probeText(&lazy->parser, lazy->image, lazy->image + lazy->size);
+    lazy->parser.onRecord = NULL;
+
+    lazy->individualCount = scan.records[0].length / (2 * sizeof(uint64_t));
+    lazy->familyCount = scan.records[1].length / (2 * sizeof(uint64_t));
+    uint32_t total = lazy->individualCount + lazy->familyCount;
+    for (int i = 0; i < 2; i++) {
+        const uint64_t* entries = (const uint64_t*)scan.records[i].str;
+        for (size_t n = 0; n < scan.records[i].length / sizeof(uint64_t); n += 2) {
+            uint32_t hash = (uint32_t)entries[n + 1];
+            appendToBuilder(&lazy->tables[INDEX_OFFSETS], (const char*)(entries + n), sizeof(uint64_t));
+            appendToBuilder(&lazy->tables[INDEX_HASHES], (const char*)&hash, sizeof(hash));
+        }
+        deleteStringBuilder(&scan.records[i]);
+    }
+    lazy->offsets = (const uint64_t*)lazy->tables[INDEX_OFFSETS].str;
+    lazy->hashes = (const uint32_t*)lazy->tables[INDEX_HASHES].str;
+    if (res.type != OK) {
+        return res;
+    }
+
+    uint32_t capacity = 16;
+    while (capacity < total * 2) {
+        capacity <<= 1;
+    }
+    StringBuilder* slots = &lazy->tables[INDEX_SLOTS];
+    reserveStringBuilder(slots, capacity * sizeof(uint32_t));
+    memset(slots->str, 0, capacity * sizeof(uint32_t));
+    slots->length = capacity * sizeof(uint32_t);
+    lazy->slots = (const uint32_t*)slots->str;
+    lazy->slotMask = capacity - 1;
+    for (uint32_t number = 0; number < total; number++) {
+        size_t len;
+        const char* xref = lazyXref(lazy, lazy->offsets[number], &len);
+        if (findLazyRecord(lazy, xref, len, isLazyFamily(lazy, number)) >= 0) {
+            continue;
+        }
+        uint32_t pos = lazy->hashes[number] & lazy->slotMask;
+        while (lazy->slots[pos]) {
+            pos = (pos + 1) & lazy->slotMask;
+        }
+        ((uint32_t*)slots->str)[pos] = number + 1;
+    }
+
+    StringBuilder* links = &lazy->tables[INDEX_LINKS];
+    for (uint32_t number = 0; number < total; number++) {
+        appendLink(&lazy->tables[INDEX_LINK_STARTS], links->length / sizeof(uint32_t));
+        appendLazyLinks(lazy, number, links);
+    }
+    appendLink(&lazy->tables[INDEX_LINK_STARTS], links->length / sizeof(uint32_t));
+    lazy->linkStarts = (const uint32_t*)lazy->tables[INDEX_LINK_STARTS].str;
+    lazy->links = (const uint32_t*)links->str;
+    lazy->linkCount = links->length / sizeof(uint32_t);
+    lazy->parsedOffsets = (const uint64_t*)lazy->tables[INDEX_PARSED].str;
+    lazy->parsedCount = lazy->tables[INDEX_PARSED].length / sizeof(uint64_t);
+    return finishProbe(&lazy->parser);
+}
+
+void initLazyIndexHeader(LazyIndexHeader* header, const GEDCOMlazy* lazy, const struct stat* source) {
+    memset(header, 0, sizeof(LazyIndexHeader));
+    memcpy(header->magic, LAZY_INDEX_MAGIC, sizeof(LAZY_INDEX_MAGIC));
+    header->version = LAZY_INDEX_VERSION;
+    header->byteOrder = LAZY_INDEX_BYTE_ORDER;
+    header->sourceSize = lazy->size;
+    header->sourceSeconds = source->st_mtim.tv_sec;
+    header->sourceNanoseconds = source->st_mtim.tv_nsec;
+    header->sourceHash = sampleSourceHash(lazy->image, lazy->size);
+    header->individualCount = lazy->individualCount;
+    header->familyCount = lazy->familyCount;
+}
+
+// written next to the target and renamed, like a snapshot; a failure only means the index is built again next time
+void writeLazyIndex(const GEDCOMlazy* lazy, const char* indexName, const struct stat* source) {
+    LazyIndexHeader header;
+    initLazyIndexHeader(&header, lazy, source);
+    uint64_t offset = sizeof(LazyIndexHeader);
+    for (int i = 0; i < INDEX_SECTION_COUNT; i++) {
+        offset = (offset + 7) & ~(uint64_t)7;
+        header.sections[i].offset = offset;
+        header.sections[i].size = lazy->tables[i].length;
+        offset += lazy->tables[i].length;
+    }
+    header.fileSize = offset;
+
+    char* tempName = malloc(strlen(indexName) + 8);
+    sprintf(tempName, "%s.XXXXXX", indexName);
+    int fd = mkstemp(tempName);
+    bool written = fd >= 0 && writeAllAt(fd, (const char*)&header, sizeof(header), 0);
+    for (int i = 0; i < INDEX_SECTION_COUNT && written; i++) {
+        written = writeAllAt(fd, lazy->tables[i].str, lazy->tables[i].length, header.sections[i].offset);
+    }
+    if (fd >= 0) {
+        written = written && !ftruncate(fd, header.fileSize) && !fchmod(fd, 0644);
+        written = !close(fd) && written && !rename(tempName, indexName);
+        if (!written) {
+            unlink(tempName);
+        }
+    }
+    free(tempName);
+}
+
+// points a table into the index, checking that it lies in the file and holds count values
+bool mapIndexSection(const LazyIndexHeader* header, size_t size, int section, size_t valueSize, uint64_t count, const void** table) {
+    const IndexSection* info = &header->sections[section];
+    if (info->offset % 8 || info->offset > size || info->size > size - info->offset || info->size != count * valueSize) {
+        return false;
+    }
+    *table = (const char*)header + info->offset;
+    return true;
+}
+
+// uses the sidecar index if it was made for this version of the source.  Only the header of the index is checked;
+// every number read from its tables is checked where it is used
+bool loadLazyIndex(GEDCOMlazy* lazy, const char* indexName, const struct stat* source) {
+    const char* image;
+    size_t size;
+    if (mapTextFile(indexName, &image, &size, NULL).type != OK || !image) {
+        return false;
+    }
+    const LazyIndexHeader* header = (const LazyIndexHeader*)image;
+    LazyIndexHeader expected;
+    initLazyIndexHeader(&expected, lazy, source);
+    bool valid = size >= sizeof(LazyIndexHeader) && !memcmp(header, &expected, offsetof(LazyIndexHeader, fileSize)) &&
+        header->fileSize == size && header->sourceSize == expected.sourceSize &&
+        header->sourceSeconds == expected.sourceSeconds && header->sourceNanoseconds == expected.sourceNanoseconds &&
+        header->sourceHash == expected.sourceHash;
+    if (valid) {
+        uint64_t total = (uint64_t)header->individualCount + header->familyCount;
+        uint64_t slotCount = header->sections[INDEX_SLOTS].size / sizeof(uint32_t);
+        uint64_t linkCount = header->sections[INDEX_LINKS].size / sizeof(uint32_t);
+        uint64_t parsedCount = header->sections[INDEX_PARSED].size / sizeof(uint64_t);
+        valid = total < MISSING_RECORD && slotCount >= 16 && !(slotCount & (slotCount - 1)) && slotCount <= UINT32_MAX &&
+            linkCount < UINT32_MAX && parsedCount && parsedCount < UINT32_MAX &&
+            mapIndexSection(header, size, INDEX_OFFSETS, sizeof(uint64_t), total, (const void**)&lazy->offsets) &&
+            mapIndexSection(header, size, INDEX_HASHES, sizeof(uint32_t), total, (const void**)&lazy->hashes) &&
+            mapIndexSection(header, size, INDEX_SLOTS, sizeof(uint32_t), slotCount, (const void**)&lazy->slots) &&
+            mapIndexSection(header, size, INDEX_LINK_STARTS, sizeof(uint32_t), total + 1, (const void**)&lazy->linkStarts) &&
+            mapIndexSection(header, size, INDEX_LINKS, sizeof(uint32_t), linkCount, (const void**)&lazy->links) &&
+            mapIndexSection(header, size, INDEX_PARSED, sizeof(uint64_t), parsedCount, (const void**)&lazy->parsedOffsets);
+        lazy->individualCount = header->individualCount;
+        lazy->familyCount = header->familyCount;
+        lazy->slotMask = slotCount - 1;
+        lazy->linkCount = linkCount;
+        lazy->parsedCount = parsedCount;
+    }
+    if (!valid) {
+        munmap((void*)image, size);
+        return false;
+    }
+    madvise((void*)image, size, MADV_RANDOM);
+    lazy->indexImage = image;
+    lazy->indexSize = size;
+    return true;
+}
+
+/////// records on demand
+
+// feeds the lines of the record at offset through the parser
+GEDCOMerror parseLazyLines(GEDCOMlazy* lazy, uint64_t offset) {
+    if (offset >= lazy->size) {
+        return createError(INV_RECORD, -1);
+    }
+    const char* pos = lazy->image + offset;
+    const char* end = lazy->image + lazy->size;
+    lazy->parser.prevLevel = -1;
+    GEDCOMerror res;
+    do {
+        const char* lineEnd = findLineEnd(pos, end);
+        res = probeParsedLine(&lazy->parser, pos, lineEnd);
+        for (pos = lineEnd; pos < end && (*pos == '\n' || *pos == '\r'); pos++);
+    } while (res.type == OK && end - pos >= 2 && !(pos[0] == '0' && pos[1] == ' '));
+    return res;
+}
+
+// parses a record into parser.obj on first access; NULL if its lines are invalid
+void* parseLazyRecord(GEDCOMlazy* lazy, uint32_t number) {
+    if (number >= lazy->individualCount + lazy->familyCount) {
+        return NULL;
+    }
+    if (lazy->records[number]) {
+        return lazy->records[number];
+    }
+    GEDCOMobject* obj = lazy->parser.obj;
+    List* list = isLazyFamily(lazy, number) ? &obj->families : &obj->individuals;
+    int length = getLength(*list);
+    GEDCOMerror res = parseLazyLines(lazy, lazy->offsets[number]);
+    void* record = getLength(*list) != length ? getFromBack(*list) : NULL;
+    if (res.type != OK && record) {
+        list->deleteData(deleteDataFromList(list, record));
+    }
+    if (res.type != OK || !record) {
+        return NULL;
+    }
+    lazy->records[number] = record;
+    putPointer(&lazy->numbers, record, number);
+    return record;
+}
+
+// the linked record, parsed; NULL if the link is to a missing or invalid record or one of the wrong type
+void* parseLazyLink(GEDCOMlazy* lazy, uint32_t link, bool isFamily) {
+    if (link >= lazy->individualCount + lazy->familyCount || isLazyFamily(lazy, link) != isFamily) {
+        return NULL;
+    }
+    return parseLazyRecord(lazy, link);
+}
+
+// fills in the links of a parsed record, parsing the records it links to
+bool linkLazyRecord(GEDCOMlazy* lazy, uint32_t number) {
+    if (lazy->linked[number]) {
+        return true;
+    }
+    uint32_t start = lazy->linkStarts[number];
+    uint32_t end = lazy->linkStarts[number + 1];
+    bool isFamily = isLazyFamily(lazy, number);
+    bool valid = start <= end && end <= lazy->linkCount && (!isFamily || end - start >= 2);
+    if (!isFamily) {
+        IndividualWithId* indi = (IndividualWithId*)lazy->records[number];
+        for (uint32_t i = start; i < end && valid; i++) {
+            void* family = parseLazyLink(lazy, lazy->links[i], true);
+            if (family) {
+                insertBack(&indi->individual.families, family);
+            }
+            valid = family != NULL;
+        }
+        if (!valid) {
+            clearList(&indi->individual.families);
+        }
+    } else {
+        Family* family = (Family*)lazy->records[number];
+        for (uint32_t i = start; i < end && valid; i++) {
+            uint32_t link = lazy->links[i];
+            if (i < start + 2 && link == NO_RECORD) {
+                continue;
+            }
+            Individual* member = parseLazyLink(lazy, link, false);
+            if (i == start) {
+                family->husband = member;
+            } else if (i == start + 1) {
+                family->wife = member;
+            } else if (member) {
+                insertBack(&family->children, member);
+            }
+            valid = member != NULL;
+        }
+        if (!valid) {
+            family->husband = family->wife = NULL;
+            clearList(&family->children);
+        }
+    }
+    lazy->linked[number] = valid;
+    return valid;
+}
+
+void* getLinkedLazyRecord(GEDCOMlazy* lazy, int64_t number) {
+    if (number < 0 || !parseLazyRecord(lazy, number) || !linkLazyRecord(lazy, number)) {
+        return NULL;
+    }
+    return lazy->records[number];
+}
+
+GEDCOMerror createLazyGEDCOM(char* fileName, GEDCOMlazy** lazy) {
+    if (!lazy) {
+        return createError(INV_FILE, -1);
+    }
+    *lazy = NULL;
+    if (!isGEDCOMfileName(fileName) || isCompressedName(fileName)) {
+        return createError(INV_FILE, -1);
+    }
+    GEDCOMlazy* res = calloc(1, sizeof(GEDCOMlazy));
+    initFileProbe(&res->parser);
+    for (int i = 0; i < INDEX_SECTION_COUNT; i++) {
+        initStringBuilder(&res->tables[i], 0);
+    }
+    initPointerMap(&res->numbers, 0);
+    struct stat source;
+    GEDCOMerror err = mapTextFile(fileName, &res->image, &res->size, &source);
+    if (err.type == OK && !res->image) {
+        err = createError(INV_GEDCOM, -1);
+    }
+    char* indexName = malloc(strlen(fileName) + 4);
+    sprintf(indexName, "%sidx", fileName);
+    if (err.type == OK && loadLazyIndex(res, indexName, &source)) {
+        // only the header and the submitter are read from the source
+        for (uint32_t i = 0; i < res->parsedCount && err.type == OK; i++) {
+            err = parseLazyLines(res, res->parsedOffsets[i]);
+        }
+        res->parser.finished = true;
+        if (err.type == OK) {
+            err = finishProbe(&res->parser);
+        }
+    } else if (err.type == OK) {
+        err = buildLazyIndex(res);
+        if (err.type == OK) {
+            writeLazyIndex(res, indexName, &source);
+        }
+    }
+    free(indexName);
+    if (err.type != OK) {
+        deleteLazyGEDCOM(res);
+        return err;
+    }
+    // from here on records are read one at a time
+    madvise((void*)res->image, res->size, MADV_RANDOM);
+    uint32_t total = res->individualCount + res->familyCount;
+    res->records = calloc(total + 1, sizeof(void*));
+    res->linked = calloc(total + 1, sizeof(bool));
+    *lazy = res;
+    return err;
+}
+
+void deleteLazyGEDCOM(GEDCOMlazy* lazy) {
+    if (!lazy) {
+        return;
+    }
+    if (lazy->image) {
+        munmap((void*)lazy->image, lazy->size);
+    }
+    if (lazy->indexImage) {
+        munmap((void*)lazy->indexImage, lazy->indexSize);
+    }
+    deleteGEDCOM(lazy->parser.obj);
+    for (int i = 0; i < INDEX_SECTION_COUNT; i++) {
+        deleteStringBuilder(&lazy->tables[i]);
+    }
+    free(lazy->records);
+    free(lazy->linked);
+    deletePointerMap(&lazy->numbers);
+    free(lazy);
+}
+
+const Header* getLazyHeader(const GEDCOMlazy* lazy) {
+    return lazy->parser.obj->header;
+}
+
+int getLazyIndividualCount(const GEDCOMlazy* lazy) {
+    return lazy->individualCount;
+}
+
+int getLazyFamilyCount(const GEDCOMlazy* lazy) {
+    return lazy->familyCount;
+}
+
+Individual* getLazyIndividual(GEDCOMlazy* lazy, const char* xref) {
+    if (!xref) {
+        return NULL;
+    }
+    return getLinkedLazyRecord(lazy, findLazyRecord(lazy, xref, strlen(xref), false));
+}
+
+Family* getLazyFamily(GEDCOMlazy* lazy, const char* xref) {
+    if (!xref) {
+        return NULL;
+    }
+    return getLinkedLazyRecord(lazy, findLazyRecord(lazy, xref, strlen(xref), true));
+}
+
+Individual* getLazyIndividualAt(GEDCOMlazy* lazy, int n) {
+    if (n < 0 || (uint32_t)n >= lazy->individualCount) {
+        return NULL;
+    }
+    return getLinkedLazyRecord(lazy, n);
+}
+
+Family* getLazyFamilyAt(GEDCOMlazy* lazy, int n) {
+    if (n < 0 || (uint32_t)n >= lazy->familyCount) {
+        return NULL;
+    }
+    return getLinkedLazyRecord(lazy, (int64_t)lazy->individualCount + n);
+}
+
+Individual* linkLazyIndividual(GEDCOMlazy* lazy, Individual* individual) {
+    int number = individual ? getPointer(&lazy->numbers, individual) : -1;
+    return number >= 0 && !isLazyFamily(lazy, number) ? getLinkedLazyRecord(lazy, number) : NULL;
+}
+
+Family* linkLazyFamily(GEDCOMlazy* lazy, Family* family) {
+    int number = family ? getPointer(&lazy->numbers, family) : -1;
+    return number >= 0 && isLazyFamily(lazy, number) ? getLinkedLazyRecord(lazy, number) : NULL;
+}
+
+/////// JSON reader
+
+typedef struct {
+    const char* pos;
+    const char* end;
+    bool failed;
+} JsonReader;
+
+// nesting allowed in values we skip
+#define MAX_JSON_DEPTH 64
+
+void initJsonReader(JsonReader* reader, const char* str) {
+    reader->pos = str;
+    reader->end = str + strlen(str);
+    reader->failed = false;
+}
+
+void skipJsonSpace(JsonReader* reader) {
+    while (reader->pos < reader->end && (*reader->pos == ' ' || *reader->pos == '\n' || *reader->pos == '\r' || *reader->pos == '\t')) {
+        reader->pos++;
+    }
+}
+
+// consumes c if it is the next character after whitespace
+bool acceptJson(JsonReader* reader, char c) {
+    skipJsonSpace(reader);
+    if (!reader->failed && reader->pos < reader->end && *reader->pos == c) {
+        reader->pos++;
+        return true;
+    }
+    return false;
+}
+
+bool expectJson(JsonReader* reader, char c) {
+    if (!acceptJson(reader, c)) {
+        reader->failed = true;
+    }
+    return !reader->failed;
+}
+
+// reads 4 hex digits, -1 if they are not
+long readJsonHex(const char* pos) {
+    long res = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = pos[i];
+        int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (digit < 0) {
+            return -1;
+        }
+        res = res * 16 + digit;
+    }
+    return res;
+}
+
+char* appendUtf8(char* target, long code) {
+    if (code < 0x80) {
+        *target++ = (char)code;
+    } else if (code < 0x800) {
+        *target++ = (char)(0xc0 | (code >> 6));
+        *target++ = (char)(0x80 | (code & 0x3f));
+    } else if (code < 0x10000) {
+        *target++ = (char)(0xe0 | (code >> 12));
+        *target++ = (char)(0x80 | ((code >> 6) & 0x3f));
+        *target++ = (char)(0x80 | (code & 0x3f));
+    } else {
+        *target++ = (char)(0xf0 | (code >> 18));
+        *target++ = (char)(0x80 | ((code >> 12) & 0x3f));
+        *target++ = (char)(0x80 | ((code >> 6) & 0x3f));
+        *target++ = (char)(0x80 | (code & 0x3f));
+    }
+    return target;
+}
+
+// decodes the escaped text in [pos, end) into target, which has room for end - pos bytes;
+// returns the end of the decoded text or NULL if an escape is invalid
+char* decodeJsonEscapes(const char* pos, const char* end, char* target) {
+    while (pos < end) {
+        const char* special = findJsonSpecial(pos, end);
+        memcpy(target, pos, special - pos);
+        target += special - pos;
+        if (special == end) {
+            break;
+        }
+        // only backslashes are left inside a string
+        pos = special + 2;
+        switch (special[1]) {
+        case '"': *target++ = '"'; break;
+        case '\\': *target++ = '\\'; break;
+        case '/': *target++ = '/'; break;
+        case 'b': *target++ = '\b'; break;
+        case 'f': *target++ = '\f'; break;
+        case 'n': *target++ = '\n'; break;
+        case 'r': *target++ = '\r'; break;
+        case 't': *target++ = '\t'; break;
+        case 'u': {
+            long code = end - pos >= 4 ? readJsonHex(pos) : -1;
+            pos += 4;
+            if (code >= 0xd800 && code < 0xdc00) {
+                long low = end - pos >= 6 && pos[0] == '\\' && pos[1] == 'u' ? readJsonHex(pos + 2) : -1;
+                if (low < 0xdc00 || low >= 0xe000) {
+                    return NULL;
+                }
+                code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                pos += 6;
+            } else if (code >= 0xdc00 && code < 0xe000) {
+                return NULL;
+            }
+            // a NUL would end the C string early
+            if (code <= 0) {
+                return NULL;
+            }
+            target = appendUtf8(target, code);
+            break;
+        }
+        default:
+            return NULL;
+        }
+    }
+    return target;
+}
+
+// reads a string value into a new string; the decoded text is never longer than its source
+char* readJsonString(JsonReader* reader) {
+    if (!expectJson(reader, '"')) {
+        return NULL;
+    }
+    const char* start = reader->pos;
+    const char* pos = start;
+    bool escaped = false;
+    for (;;) {
+        pos = findJsonSpecial(pos, reader->end);
+        if (pos == reader->end || *pos != '\\') {
+            break;
+        }
+        escaped = true;
+        // the escaped character can not close the string
+        pos = pos + 2 <= reader->end ? pos + 2 : reader->end;
+    }
+    if (pos == reader->end || *pos != '"') {
+        reader->failed = true;
+        return NULL;
+    }
+    char* res = malloc(pos - start + 1);
+    char* target = res + (pos - start);
+    if (!escaped) {
+        memcpy(res, start, pos - start);
+    } else if (!(target = decodeJsonEscapes(start, pos, res))) {
+        free(res);
+        reader->failed = true;
+        return NULL;
+    }
+    *target = '\0';
+    reader->pos = pos + 1;
+    return res;
+}
+
+// reads an object key into key; keys that do not fit are cut, so they match nothing we look for
+void readJsonKey(JsonReader* reader, char* key, size_t size) {
+    key[0] = '\0';
+    char* value = readJsonString(reader);
+    if (value) {
+        strncpy(key, value, size - 1);
+        key[size - 1] = '\0';
+        free(value);
+    }
+}
+
+// moves to the next member of an object whose '{' has been read; false at the closing '}' or on error
+bool nextJsonMember(JsonReader* reader, char* key, size_t size, bool* first) {
+    if (acceptJson(reader, '}')) {
+        return false;
+    }
+    if (!*first && !expectJson(reader, ',')) {
+        return false;
+    }
+    *first = false;
+    readJsonKey(reader, key, size);
+    return expectJson(reader, ':');
+}
+
+// moves to the next element of an array whose '[' has been read; false at the closing ']' or on error
+bool nextJsonElement(JsonReader* reader, bool* first) {
+    if (acceptJson(reader, ']')) {
+        return false;
+    }
+    if (!*first && !expectJson(reader, ',')) {
+        return false;
+    }
+    *first = false;
+    return !reader->failed;
+}
+
+bool acceptJsonLiteral(JsonReader* reader, const char* literal) {
+    skipJsonSpace(reader);
+    size_t len = strlen(literal);
+    if (!reader->failed && (size_t)(reader->end - reader->pos) >= len && !memcmp(reader->pos, literal, len)) {
+        reader->pos += len;
+        return true;
+    }
+    return false;
+}
+
+bool readJsonNumber(JsonReader* reader, double* value) {
+    skipJsonSpace(reader);
+    const char* pos = reader->pos;
+    if (pos < reader->end && *pos == '-') {
+        pos++;
+    }
+    const char* digits = pos;
+    while (pos < reader->end && isdigit((unsigned char)*pos)) {
+        pos++;
+    }
+    bool valid = pos > digits && (*digits != '0' || pos == digits + 1);
+    if (valid && pos < reader->end && *pos == '.') {
+        digits = ++pos;
+        while (pos < reader->end && isdigit((unsigned char)*pos)) {
+            pos++;
+        }
+        valid = pos > digits;
+    }
+    if (valid && pos < reader->end && (*pos == 'e' || *pos == 'E')) {
+        pos++;
+        if (pos < reader->end && (*pos == '+' || *pos == '-')) {
+            pos++;
+        }
+        digits = pos;
+        while (pos < reader->end && isdigit((unsigned char)*pos)) {
+            pos++;
+        }
+        valid = pos > digits;
+    }
+    if (!valid || reader->failed) {
+        reader->failed = true;
+        return false;
+    }
+    // the input ends with a NUL, so strtod stops at pos at the latest
+    *value = strtod(reader->pos, NULL);
+    reader->pos = pos;
+    return true;
+}
+
+void skipJsonValue(JsonReader* reader, int depth) {
+    skipJsonSpace(reader);
+    if (reader->failed || reader->pos == reader->end || depth > MAX_JSON_DEPTH) {
+        reader->failed = true;
+        return;
+    }
+    char key[1];
+    bool first = true;
+    double number;
+    switch (*reader->pos) {
+    case '"':
+        free(readJsonString(reader));
+        break;
+    case '{':
+        reader->pos++;
+        while (nextJsonMember(reader, key, sizeof(key), &first)) {
+            skipJsonValue(reader, depth + 1);
+        }
+        break;
+    case '[':
+        reader->pos++;
+        while (nextJsonElement(reader, &first)) {
+            skipJsonValue(reader, depth + 1);
+        }
+        break;
+    default:
+        if (!acceptJsonLiteral(reader, "true") && !acceptJsonLiteral(reader, "false") && !acceptJsonLiteral(reader, "null")) {
+            readJsonNumber(reader, &number);
+        }
+    }
+}
+
+// a string, or null for an empty one; replaces *target
+void readJsonText(JsonReader* reader, char** target) {
+    char* value = acceptJsonLiteral(reader, "null") ? calloc(1, 1) : readJsonString(reader);
+    if (value) {
+        free(*target);
+        *target = value;
+    }
+}
+
+// a record position, or null (-1)
+int readJsonIndex(JsonReader* reader) {
+    double value;
+    if (acceptJsonLiteral(reader, "null")) {
+        return -1;
+    }
+    if (readJsonNumber(reader, &value) && (value < 0 || value >= INT_MAX || value != (int)value)) {
+        reader->failed = true;
+    }
+    return reader->failed ? -1 : (int)value;
+}
+
+// positions read from the input, resolved to records once everything has been read
+typedef struct {
+    int* values;
+    int length;
+    int allocated;
+} JsonLinks;
+
+void addJsonLink(JsonLinks* links, int from, int to) {
+    if (links->length + 2 > links->allocated) {
+        links->allocated = links->allocated ? links->allocated * 2 : 64;
+        links->values = realloc(links->values, links->allocated * sizeof(int));
+    }
+    links->values[links->length++] = from;
+    links->values[links->length++] = to;
+}
+
+void readJsonFields(JsonReader* reader, List* fields) {
+    bool firstField = true;
+    if (!expectJson(reader, '[')) {
+        return;
+    }
+    while (nextJsonElement(reader, &firstField)) {
+        Field* field = malloc(sizeof(Field));
+        field->tag = calloc(1, 1);
+        field->value = calloc(1, 1);
+        insertBack(fields, field);
+        char key[16];
+        bool first = true;
+        if (!expectJson(reader, '{')) {
+            return;
+        }
+        while (nextJsonMember(reader, key, sizeof(key), &first)) {
+            if (!strcmp(key, "tag")) {
+                readJsonText(reader, &field->tag);
+            } else if (!strcmp(key, "value")) {
+                readJsonText(reader, &field->value);
+            } else {
+                skipJsonValue(reader, 0);
+            }
+        }
+    }
+}
+
+void readJsonEvents(JsonReader* reader, List* events) {
+    bool firstEvent = true;
+    if (!expectJson(reader, '[')) {
+        return;
+    }
+    while (nextJsonElement(reader, &firstEvent)) {
+        Event* event = malloc(sizeof(Event));
+        event->type[0] = '\0';
+        event->date = NULL;
+        event->place = NULL;
+        event->otherFields = initializeList(&printField, &deleteField, &compareFields);
+        insertBack(events, event);
+        char key[16];
+        bool first = true;
+        if (!expectJson(reader, '{')) {
+            return;
+        }
+        while (nextJsonMember(reader, key, sizeof(key), &first)) {
+            if (!strcmp(key, "type")) {
+                char* type = readJsonString(reader);
+                if (type) {
+                    strncpy(event->type, type, sizeof(event->type) - 1);
+                    event->type[sizeof(event->type) - 1] = '\0';
+                    free(type);
+                }
+            } else if (!strcmp(key, "date")) {
+                readJsonText(reader, &event->date);
+            } else if (!strcmp(key, "place")) {
+                readJsonText(reader, &event->place);
+            } else if (!strcmp(key, "fields")) {
+                readJsonFields(reader, &event->otherFields);
+            } else {
+                skipJsonValue(reader, 0);
+            }
+        }
+        // like the parser, leave out what is not given
+        if (event->date && !event->date[0]) {
+            free(event->date);
+            event->date = NULL;
+        }
+        if (event->place && !event->place[0]) {
+            free(event->place);
+            event->place = NULL;
+        }
+    }
+}
+
+IndividualWithId* newJsonIndividual(void) {
+    // individuals in a GEDCOMobject are always IndividualWithId
+    IndividualWithId* indi = malloc(sizeof(IndividualWithId));
+    indi->id[0] = '\0';
+    indi->listOfFamiliesIds = initializeList(&printId, &deleteId, &compareId);
+    indi->source.start = indi->source.end = -1;
+    indi->modified = true;
+    indi->individual.givenName = calloc(1, 1);
+    indi->individual.surname = calloc(1, 1);
+    indi->individual.events = initializeList(&printEvent, &deleteEvent, &compareEvents);
+    indi->individual.families = initializeList(&printFamily, &doNotDelete, &compareFamilies);
+    indi->individual.otherFields = initializeList(&printField, &deleteField, &compareFields);
+    return indi;
+}
+
+// the fields GEDCOMtoJSON writes for an individual; family positions go to links when it is given
+void readJsonIndividual(JsonReader* reader, Individual* indi, int number, JsonLinks* links) {
+    char key[16];
+    bool first = true;
+    if (!expectJson(reader, '{')) {
+        return;
+    }
+    while (nextJsonMember(reader, key, sizeof(key), &first)) {
+        if (!strcmp(key, "givenName")) {
+            readJsonText(reader, &indi->givenName);
+        } else if (!strcmp(key, "surname")) {
+            readJsonText(reader, &indi->surname);
+        } else if (!strcmp(key, "events")) {
+            readJsonEvents(reader, &indi->events);
+        } else if (!strcmp(key, "fields")) {
+            readJsonFields(reader, &indi->otherFields);
+        } else if (!strcmp(key, "families") && links) {
+            bool firstFamily = true;
+            if (expectJson(reader, '[')) {
+                while (nextJsonElement(reader, &firstFamily)) {
+                    addJsonLink(links, number, readJsonIndex(reader));
+                }
+            }
+        } else {
+            skipJsonValue(reader, 0);
+        }
+    }
+}
+
+Individual* JSONtoInd(const char* str) {
+    if (!str) {
+        return NULL;
+    }
+    JsonReader reader;
+    initJsonReader(&reader, str);
+    IndividualWithId* indi = newJsonIndividual();
+    readJsonIndividual(&reader, &indi->individual, 0, NULL);
+    skipJsonSpace(&reader);
+    if (reader.failed || reader.pos != reader.end) {
+        deleteIndividual(indi);
+        return NULL;
+    }
+    return &indi->individual;
+}
+
+typedef struct {
+    // pairs of individual and family positions
+    JsonLinks personFamilies;
+    // husband and wife positions, two per family
+    JsonLinks spouses;
+    // pairs of family and child positions
+    JsonLinks children;
+} JsonFamilyLinks;
+
+void readJsonFamily(JsonReader* reader, Family* family, int number, JsonFamilyLinks* links) {
+    char key[16];
+    bool first = true;
+    int husband = -1;
+    int wife = -1;
+    if (!expectJson(reader, '{')) {
+        return;
+    }
+    while (nextJsonMember(reader, key, sizeof(key), &first)) {
+        if (!strcmp(key, "husband")) {
+            husband = readJsonIndex(reader);
+        } else if (!strcmp(key, "wife")) {
+            wife = readJsonIndex(reader);
+        } else if (!strcmp(key, "children")) {
+            bool firstChild = true;
+            if (expectJson(reader, '[')) {
+                while (nextJsonElement(reader, &firstChild)) {
+                    addJsonLink(&links->children, number, readJsonIndex(reader));
+                }
+            }
+        } else if (!strcmp(key, "events")) {
+            readJsonEvents(reader, &family->events);
+        } else if (!strcmp(key, "fields")) {
+            readJsonFields(reader, &family->otherFields);
+        } else {
+            skipJsonValue(reader, 0);
+        }
+    }
+    addJsonLink(&links->spouses, husband, wife);
+}
+
+// links the records by the positions read; false if one is out of range
+bool resolveJsonLinks(GEDCOMobject* obj, JsonFamilyLinks* links) {
+    int individualCount = getLength(obj->individuals);
+    int familyCount = getLength(obj->families);
+    Individual** people = malloc((individualCount + 1) * sizeof(Individual*));
+    Family** families = malloc((familyCount + 1) * sizeof(Family*));
+    int counter = 0;
+    ListIterator it = createIterator(obj->individuals);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        people[counter++] = (Individual*)data;
+    }
+    counter = 0;
+    it = createIterator(obj->families);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        families[counter++] = (Family*)data;
+    }
+    bool res = true;
+    for (int i = 0; i < links->personFamilies.length && res; i += 2) {
+        int family = links->personFamilies.values[i + 1];
+        if ((res = family >= 0 && family < familyCount)) {
+            insertBack(&people[links->personFamilies.values[i]]->families, families[family]);
+        }
+    }
+    for (int f = 0; f < familyCount && res; f++) {
+        int husband = links->spouses.values[2 * f];
+        int wife = links->spouses.values[2 * f + 1];
+        if ((res = husband < individualCount && wife < individualCount)) {
+            families[f]->husband = husband >= 0 ? people[husband] : NULL;
+            families[f]->wife = wife >= 0 ? people[wife] : NULL;
+        }
+    }
+    for (int i = 0; i < links->children.length && res; i += 2) {
+        int child = links->children.values[i + 1];
+        if ((res = child >= 0 && child < individualCount)) {
+            insertBack(&families[links->children.values[i]]->children, people[child]);
+        }
+    }
+    free(people);
+    free(families);
+    return res;
+}
+
+void setJsonSubmitterAddress(GEDCOMobject* obj, const char* address) {
+    obj->submitter = realloc(obj->submitter, sizeof(Submitter) + strlen(address) + 1);
+    strcpy(obj->submitter->address, address);
+}
+
+void readJsonHeaderMember(JsonReader* reader, GEDCOMobject* obj, const char* key) {
+    Header* header = obj->header;
+    if (!strcmp(key, "source")) {
+        char* value = readJsonString(reader);
+        if (value) {
+            strncpy(header->source, value, sizeof(header->source) - 1);
+            header->source[sizeof(header->source) - 1] = '\0';
+            free(value);
+        }
+    } else if (!strcmp(key, "gedcVersion")) {
+        // the web form sends the version as a string
+        double version;
+        skipJsonSpace(reader);
+        if (reader->pos < reader->end && *reader->pos == '"') {
+            char* value = readJsonString(reader);
+            header->gedcVersion = value ? atof(value) : 0.0f;
+            free(value);
+        } else if (readJsonNumber(reader, &version)) {
+            header->gedcVersion = (float)version;
+        }
+    } else if (!strcmp(key, "encoding")) {
+        char* value = readJsonString(reader);
+        if (value) {
+            parseEncoding(value, &header->encoding);
+            free(value);
+        }
+    } else if (!strcmp(key, "fields")) {
+        readJsonFields(reader, &header->otherFields);
+    } else {
+        skipJsonValue(reader, 0);
+    }
+}
+
+void readJsonSubmitterMember(JsonReader* reader, GEDCOMobject* obj, const char* key) {
+    if (!strcmp(key, "name") || !strcmp(key, "subName")) {
+        char* value = readJsonString(reader);
+        if (value) {
+            strncpy(obj->submitter->submitterName, value, sizeof(obj->submitter->submitterName) - 1);
+            obj->submitter->submitterName[sizeof(obj->submitter->submitterName) - 1] = '\0';
+            free(value);
+        }
+    } else if (!strcmp(key, "address") || !strcmp(key, "subAddress")) {
+        char* value = readJsonString(reader);
+        if (value) {
+            setJsonSubmitterAddress(obj, value);
+            free(value);
+        }
+    } else if (!strcmp(key, "fields")) {
+        readJsonFields(reader, &obj->submitter->otherFields);
+    } else {
+        skipJsonValue(reader, 0);
+    }
+}
+
+// reads "key": { ... } members through readMember; null leaves the defaults
+void readJsonSection(JsonReader* reader, GEDCOMobject* obj, void (*readMember)(JsonReader*, GEDCOMobject*, const char*)) {
+    char key[16];
+    bool first = true;
+    if (acceptJsonLiteral(reader, "null") || !expectJson(reader, '{')) {
+        return;
+    }
+    while (nextJsonMember(reader, key, sizeof(key), &first)) {
+        readMember(reader, obj, key);
+    }
+}
+
+GEDCOMobject* JSONtoGEDCOM(const char* str) {
+    if (!str) {
+        return NULL;
+    }
+    GEDCOMobject* res = malloc(sizeof(GEDCOMobject));
+    initGEDCOMobject(res);
+    HeaderWithSubmitterId* header = malloc(sizeof(HeaderWithSubmitterId));
+    header->submitterId[0] = '\0';
+    header->source = NULL;
+    initHeader(&header->header);
+    res->header = &header->header;
+    res->submitter = malloc(sizeof(Submitter) + 1);
+    res->submitter->submitterName[0] = '\0';
+    res->submitter->address[0] = '\0';
+    res->submitter->otherFields = initializeList(&printField, &deleteField, &compareFields);
+
+    JsonFamilyLinks links = {{NULL, 0, 0}, {NULL, 0, 0}, {NULL, 0, 0}};
+    JsonReader reader;
+    initJsonReader(&reader, str);
+    char key[16];
+    bool first = true;
+    if (expectJson(&reader, '{')) {
+        while (nextJsonMember(&reader, key, sizeof(key), &first)) {
+            if (!strcmp(key, "header")) {
+                readJsonSection(&reader, res, &readJsonHeaderMember);
+            } else if (!strcmp(key, "submitter")) {
+                readJsonSection(&reader, res, &readJsonSubmitterMember);
+            } else if (!strcmp(key, "subName") || !strcmp(key, "subAddress")) {
+                readJsonSubmitterMember(&reader, res, key);
+            } else if (!strcmp(key, "individuals")) {
+                bool firstIndividual = true;
+                if (expectJson(&reader, '[')) {
+                    while (nextJsonElement(&reader, &firstIndividual)) {
+                        IndividualWithId* indi = newJsonIndividual();
+                        insertBack(&res->individuals, indi);
+                        readJsonIndividual(&reader, &indi->individual, getLength(res->individuals) - 1, &links.personFamilies);
+                    }
+                }
+            } else if (!strcmp(key, "families")) {
+                bool firstFamily = true;
+                if (expectJson(&reader, '[')) {
+                    while (nextJsonElement(&reader, &firstFamily)) {
+                        FamilyWithIds* family = malloc(sizeof(FamilyWithIds));
+                        family->id[0] = '\0';
+                        family->husbandId = family->wifeId = NULL;
+                        family->childrenIds = initializeList(&printId, &deleteId, &compareId);
+                        family->source.start = family->source.end = -1;
+                        family->modified = true;
+                        family->family.husband = family->family.wife = NULL;
+                        family->family.children = initializeList(&printIndividual, &doNotDelete, &compareIndividuals);
+                        family->family.events = initializeList(&printEvent, &deleteEvent, &compareEvents);
+                        family->family.otherFields = initializeList(&printField, &deleteField, &compareFields);
+                        insertBack(&res->families, family);
+                        readJsonFamily(&reader, &family->family, getLength(res->families) - 1, &links);
+                    }
+                }
+            } else {
+                readJsonHeaderMember(&reader, res, key);
+            }
+        }
+    }
+    skipJsonSpace(&reader);
+    bool valid = !reader.failed && reader.pos == reader.end && resolveJsonLinks(res, &links);
+    free(links.personFamilies.values);
+    free(links.spouses.values);
+    free(links.children.values);
+    if (!valid) {
+        deleteGEDCOM(res);
+        return NULL;
+    }
+    res->header->submitter = res->submitter;
+    return res;
+}
+
+void addIndividual(GEDCOMobject* obj, const Individual* toBeAdded) {
+    if (!obj || !toBeAdded) {
+        return;
+    }
+    insertBack(&obj->individuals, (void*)toBeAdded);
+}
+
+void markIndividualModified(Individual* person) {
+    if (person) {
+        ((IndividualWithId*)person)->modified = true;
+    }
+}
+
+void markFamilyModified(Family* family) {
+    if (family) {
+        ((FamilyWithIds*)family)->modified = true;
+    }
+}
+
+char* iListToJSON(List iList) {
+    OutputBuffer out;
+    initOutputBuffer(&out, -1);
+    appendJsonIndividuals(&out, iList);
+    return takeOutputString(&out);
+}
+
+char* gListToJSON(List gList) {
+    OutputBuffer out;
+    initOutputBuffer(&out, -1);
+    appendOutputChar(&out, '[');
+    bool first = true;
+    ListIterator it = createIterator(gList);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        if (!first) {
+            appendOutputChar(&out, ',');
+        }
+        first = false;
+        appendJsonIndividuals(&out, *(List*)data);
+    }
+    appendOutputChar(&out, ']');
+    return takeOutputString(&out);
+}
+
+void deleteGeneration(void* toBeDeleted) {
+    clearList((List*)toBeDeleted);
+    free(toBeDeleted);
+}
+int compareGenerations(const void* first,const void* second) {
+    return comparePointers(first, second);
+}
+char* printGeneration(void* toBePrinted) {
+    return toString(*(List*)toBePrinted);
+}
+
+//////// relationship calculator
+
+typedef struct {
+    const Individual* person;
+    int generation;
+    int previous;
+} SearchNode;
+
+// one side of the bidirectional search, visited maps person to its index in nodes
+typedef struct {
+    SearchNode* nodes;
+    int count;
+    int allocated;
+    int frontierStart;
+    int level;
+    PointerMap visited;
+} SearchSide;
+
+void initSearchSide(SearchSide* side, const Individual* person) {
+    side->allocated = 64;
+    side->nodes = malloc(side->allocated * sizeof(SearchNode));
+    side->nodes[0].person = person;
+    side->nodes[0].generation = 0;
+    side->nodes[0].previous = -1;
+    side->count = 1;
+    side->frontierStart = 0;
+    side->level = 0;
+    initPointerMap(&side->visited, 64);
+    putPointer(&side->visited, person, 0);
+}
+
+void deleteSearchSide(SearchSide* side) {
+    free(side->nodes);
+    deletePointerMap(&side->visited);
+}
+
+void addSearchNode(SearchSide* side, const Individual* person, int previous) {
+    if (side->count == side->allocated) {
+        side->allocated *= 2;
+        side->nodes = realloc(side->nodes, side->allocated * sizeof(SearchNode));
+    }
+    SearchNode* node = side->nodes + side->count;
+    node->person = person;
+    node->generation = side->nodes[previous].generation + 1;
+    node->previous = previous;
+    putPointer(&side->visited, person, side->count);
+    side->count++;
+}
+
+// moves the side one generation up; returns the best total distance seen so far
+int expandSearchSide(SearchSide* side, const SearchSide* other, int best) {
+    int frontierEnd = side->count;
+    for (int i = side->frontierStart; i < frontierEnd; i++) {
+        const Individual* person = side->nodes[i].person;
+        ListIterator it = createIterator(person->families);
+        for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+            Family* family = (Family*)data;
+            if (!findElement(family->children, &pointersAreEqual, person)) {
+                continue;
+            }
+            Individual* parents[2] = { family->husband, family->wife };
+            for (int j = 0; j < 2; j++) {
+                if (!parents[j] || getPointer(&side->visited, parents[j]) >= 0) {
+                    continue;
+                }
+                addSearchNode(side, parents[j], i);
+                int otherIndex = getPointer(&other->visited, parents[j]);
+                if (otherIndex >= 0) {
+                    int distance = side->nodes[i].generation + 1 + other->nodes[otherIndex].generation;
+                    if (distance < best) {
+                        best = distance;
+                    }
+                }
+            }
+        }
+    }
+    side->frontierStart = frontierEnd;
+    side->level++;
+    return best;
+}
+
+bool searchSideExhausted(const SearchSide* side, int maxGen) {
+    return side->frontierStart == side->count || side->level >= maxGen;
+}
+
+void classifyRelationship(Relationship* rel) {
+    int up = rel->generationsFromFirst;
+    int down = rel->generationsFromSecond;
+    rel->degree = (up && down) ? (up < down ? up : down) - 1 : 0;
+    rel->removal = abs(up - down);
+    if (!up && !down) {
+        rel->type = REL_SELF;
+    } else if (!up) {
+        rel->type = REL_ANCESTOR;
+    } else if (!down) {
+        rel->type = REL_DESCENDANT;
+    } else if (up == 1 && down == 1) {
+        rel->type = REL_SIBLING;
+    } else if (up == 1) {
+        rel->type = REL_AUNT_UNCLE;
+    } else if (down == 1) {
+        rel->type = REL_NIECE_NEPHEW;
+    } else {
+        rel->type = REL_COUSIN;
+    }
+}
+
+Relationship getRelationship(const GEDCOMobject* familyRecord, const Individual* first, const Individual* second, int maxGen) {
+    Relationship rel;
+    rel.type = REL_NONE;
+    rel.generationsFromFirst = rel.generationsFromSecond = -1;
+    rel.degree = rel.removal = 0;
+    rel.commonAncestors = initializeList(&printIndividual, &doNotDelete, &compareIndividuals);
+    rel.path = initializeList(&printIndividual, &doNotDelete, &compareIndividuals);
+    if (!familyRecord || !first || !second) {
+        return rel;
+    }
+    if (maxGen <= 0 || maxGen > LEVELS_LIMIT) {
+        maxGen = LEVELS_LIMIT;
+    }
+
+    SearchSide sides[2];
+    initSearchSide(&sides[0], first);
+    initSearchSide(&sides[1], second);
+
+    int best = INT_MAX;
+    if (first == second) {
+        best = 0;
+    }
+    // every common ancestor not seen by both sides yet is further than the lower of the two levels,
+    // so once best is within that bound all nearest common ancestors are known
+    while (true) {
+        bool done0 = searchSideExhausted(&sides[0], maxGen);
+        bool done1 = searchSideExhausted(&sides[1], maxGen);
+        if (done0 && done1) {
+            break;
+        }
+        int bound0 = done0 ? INT_MAX : sides[0].level;
+        int bound1 = done1 ? INT_MAX : sides[1].level;
+        if (best <= (bound0 < bound1 ? bound0 : bound1)) {
+            break;
+        }
+        // grow the side that is behind, or the cheaper one on a tie
+        int s;
+        if (done0 || done1) {
+            s = done0 ? 1 : 0;
+        } else if (sides[0].level != sides[1].level) {
+            s = sides[0].level < sides[1].level ? 0 : 1;
+        } else {
+            s = (sides[0].count - sides[0].frontierStart) <= (sides[1].count - sides[1].frontierStart) ? 0 : 1;
+        }
+        best = expandSearchSide(&sides[s], &sides[1 - s], best);
+    }
+
+    if (best != INT_MAX) {
+        // pick the most balanced apex among the nearest ones
+        int apex = -1;
+        int apexOther = -1;
+        for (int i = 0; i < sides[0].count; i++) {
+            int j = getPointer(&sides[1].visited, sides[0].nodes[i].person);
+            if (j < 0 || sides[0].nodes[i].generation + sides[1].nodes[j].generation != best) {
+                continue;
+            }
+            if (apex < 0 || abs(sides[0].nodes[i].generation - sides[1].nodes[j].generation) <
+                    abs(sides[0].nodes[apex].generation - sides[1].nodes[apexOther].generation)) {
+                apex = i;
+                apexOther = j;
+            }
+        }
+        rel.generationsFromFirst = sides[0].nodes[apex].generation;
+        rel.generationsFromSecond = sides[1].nodes[apexOther].generation;
+        classifyRelationship(&rel);
+
+        for (int i = 0; i < sides[0].count; i++) {
+            int j = getPointer(&sides[1].visited, sides[0].nodes[i].person);
+            if (j >= 0 && sides[0].nodes[i].generation == rel.generationsFromFirst &&
+                    sides[1].nodes[j].generation == rel.generationsFromSecond) {
+                insertBack(&rel.commonAncestors, (void*)sides[0].nodes[i].person);
+            }
+        }
+
+        for (int i = apex; i >= 0; i = sides[0].nodes[i].previous) {
+            insertFront(&rel.path, (void*)sides[0].nodes[i].person);
+        }
+        for (int j = sides[1].nodes[apexOther].previous; j >= 0; j = sides[1].nodes[j].previous) {
+            insertBack(&rel.path, (void*)sides[1].nodes[j].person);
+        }
+    }
+
+    deleteSearchSide(&sides[0]);
+    deleteSearchSide(&sides[1]);
+    return rel;
+}
+
+void clearRelationship(Relationship* rel) {
+    clearList(&rel->commonAncestors);
+    clearList(&rel->path);
+}
+
+//////// record index
+
+// array view of a GEDCOMobject: record numbers are positions in the individuals/families lists
+// and all links are stored as record numbers in CSR arrays
+struct recordIndex {
+    int individualCount;
+    int familyCount;
+    Individual** individuals;
+    Family** families;
+    PointerMap individualNumbers;
+    PointerMap familyNumbers;
+    // -1 if the family has no such spouse or it is not part of the object
+    int* husband;
+    int* wife;
+    // children of family f are children[childStart[f]] .. children[childStart[f + 1] - 1]
+    int* childStart;
+    int* children;
+    // families where individual i is a child / a spouse, in the order of the families list
+    int* parentFamilyStart;
+    int* parentFamilies;
+    int* spouseFamilyStart;
+    int* spouseFamilies;
+};
+
+int* countsToStarts(int* counts, int n) {
+    int* starts = malloc((n + 1) * sizeof(int));
+    starts[0] = 0;
+    for (int i = 0; i < n; i++) {
+        starts[i + 1] = starts[i] + counts[i];
+        counts[i] = starts[i];
+    }
+    return starts;
+}
+
+RecordIndex* createRecordIndex(const GEDCOMobject* obj) {
+    RecordIndex* index = malloc(sizeof(RecordIndex));
+    index->individualCount = getLength(obj->individuals);
+    index->familyCount = getLength(obj->families);
+    index->individuals = malloc((index->individualCount + 1) * sizeof(Individual*));
+    index->families = malloc((index->familyCount + 1) * sizeof(Family*));
+    initPointerMap(&index->individualNumbers, index->individualCount);
+    initPointerMap(&index->familyNumbers, index->familyCount);
+
+    int counter = 0;
+    ListIterator it = createIterator(obj->individuals);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        index->individuals[counter] = (Individual*)data;
+        putPointer(&index->individualNumbers, data, counter++);
+    }
+    counter = 0;
+    it = createIterator(obj->families);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        index->families[counter] = (Family*)data;
+        putPointer(&index->familyNumbers, data, counter++);
+    }
+
+    int nIndi = index->individualCount;
+    int nFam = index->familyCount;
+    index->husband = malloc((nFam + 1) * sizeof(int));
+    index->wife = malloc((nFam + 1) * sizeof(int));
+    int* childCounts = calloc(nFam + 1, sizeof(int));
+    int* parentCounts = calloc(nIndi + 1, sizeof(int));
+    int* spouseCounts = calloc(nIndi + 1, sizeof(int));
+    for (int f = 0; f < nFam; f++) {
+        Family* family = index->families[f];
+        index->husband[f] = family->husband ? getPointer(&index->individualNumbers, family->husband) : -1;
+        index->wife[f] = family->wife ? getPointer(&index->individualNumbers, family->wife) : -1;
+        if (index->husband[f] >= 0) {
+            spouseCounts[index->husband[f]]++;
+        }
+        if (index->wife[f] >= 0 && index->wife[f] != index->husband[f]) {
+            spouseCounts[index->wife[f]]++;
+        }
+        it = createIterator(family->children);
+        for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+            int child = getPointer(&index->individualNumbers, data);
+            if (child >= 0) {
+                childCounts[f]++;
+                parentCounts[child]++;
+            }
+        }
+    }
+    index->childStart = countsToStarts(childCounts, nFam);
+    index->parentFamilyStart = countsToStarts(parentCounts, nIndi);
+    index->spouseFamilyStart = countsToStarts(spouseCounts, nIndi);
+    index->children = malloc((index->childStart[nFam] + 1) * sizeof(int));
+    index->parentFamilies = malloc((index->parentFamilyStart[nIndi] + 1) * sizeof(int));
+    index->spouseFamilies = malloc((index->spouseFamilyStart[nIndi] + 1) * sizeof(int));
+    // the counts now hold the next free slot of every record
+    for (int f = 0; f < nFam; f++) {
+        if (index->husband[f] >= 0) {
+            index->spouseFamilies[spouseCounts[index->husband[f]]++] = f;
+        }
+        if (index->wife[f] >= 0 && index->wife[f] != index->husband[f]) {
+            index->spouseFamilies[spouseCounts[index->wife[f]]++] = f;
+        }
+        it = createIterator(index->families[f]->children);
+        for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+            int child = getPointer(&index->individualNumbers, data);
+            if (child >= 0) {
+                index->children[childCounts[f]++] = child;
+                index->parentFamilies[parentCounts[child]++] = f;
+            }
+        }
+    }
+    free(childCounts);
+    free(parentCounts);
+    free(spouseCounts);
+    return index;
+}
+
+void deleteRecordIndex(RecordIndex* index) {
+    if (!index) {
+        return;
+    }
+    free(index->individuals);
+    free(index->families);
+    deletePointerMap(&index->individualNumbers);
+    deletePointerMap(&index->familyNumbers);
+    free(index->husband);
+    free(index->wife);
+    free(index->childStart);
+    free(index->children);
+    free(index->parentFamilyStart);
+    free(index->parentFamilies);
+    free(index->spouseFamilyStart);
+    free(index->spouseFamilies);
+    free(index);
+}
+
+// distinct children of an individual over all families where it is a spouse;
+// stamp must have individualCount entries and is marked with mark
+int collectChildren(const RecordIndex* index, int person, int* stamp, int mark, int* out) {
+    int count = 0;
+    for (int i = index->spouseFamilyStart[person]; i < index->spouseFamilyStart[person + 1]; i++) {
+        int f = index->spouseFamilies[i];
+        for (int j = index->childStart[f]; j < index->childStart[f + 1]; j++) {
+            int child = index->children[j];
+            if (stamp[child] != mark) {
+                stamp[child] = mark;
+                out[count++] = child;
+            }
+        }
+    }
+    return count;
+}
+
+// distinct parents of an individual over all families where it is a child
+int collectParents(const RecordIndex* index, int person, int* stamp, int mark, int* out) {
+    int count = 0;
+    for (int i = index->parentFamilyStart[person]; i < index->parentFamilyStart[person + 1]; i++) {
+        int f = index->parentFamilies[i];
+        int parents[2] = { index->husband[f], index->wife[f] };
+        for (int j = 0; j < 2; j++) {
+            if (parents[j] >= 0 && stamp[parents[j]] != mark) {
+                stamp[parents[j]] = mark;
+                out[count++] = parents[j];
+            }
+        }
+    }
+    return count;
+}
+
+//////// whole tree statistics
+
+// 4096 one-byte registers per sketch give a standard error of about 1.6%
+#define HLL_BITS 12
+#define HLL_REGISTERS (1 << HLL_BITS)
+
+uint64_t mixBits(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+void addToSketch(uint8_t* sketch, int record) {
+    uint64_t h = mixBits((uint64_t)record);
+    int reg = (int)(h >> (64 - HLL_BITS));
+    uint64_t rest = (h << HLL_BITS) | (1ULL << (HLL_BITS - 1));
+    uint8_t rank = (uint8_t)(__builtin_clzll(rest) + 1);
+    if (sketch[reg] < rank) {
+        sketch[reg] = rank;
+    }
+}
+
+void mergeSketch(uint8_t* target, const uint8_t* source) {
+    for (int i = 0; i < HLL_REGISTERS; i++) {
+        if (target[i] < source[i]) {
+            target[i] = source[i];
+        }
+    }
+}
+
+// ln(x) for x >= 1 without libm: x = 2^k * f with f in [1, 2), and ln(f) = 2 atanh((f - 1) / (f + 1))
+double naturalLog(double x) {
+    int k = 0;
+    for (; x >= 2.0; x /= 2.0, k++);
+    double z = (x - 1.0) / (x + 1.0);
+    double power = z;
+    double sum = 0.0;
+    for (int i = 1; i < 40; i += 2, power *= z * z) {
+        sum += power / i;
+    }
+    return k * 0.6931471805599453 + 2.0 * sum;
+}
+
+unsigned int estimateSketch(const uint8_t* sketch) {
+    double sum = 0.0;
+    int empty = 0;
+    for (int i = 0; i < HLL_REGISTERS; i++) {
+        sum += 1.0 / (double)(1ULL << sketch[i]);
+        empty += !sketch[i];
+    }
+    double m = HLL_REGISTERS;
+    double estimate = (0.7213 / (1.0 + 1.079 / m)) * m * m / sum;
+    // the raw estimate is biased for sets up to a few times the register count; count empty registers there
+    if (estimate <= 2.5 * m && empty) {
+        estimate = m * naturalLog(m / empty);
+    }
+    return (unsigned int)(estimate + 0.5);
+}
+
+// sets up to this size stay exact in approximate mode
+#define EXACT_SET_LIMIT 1024
+
+// set of record numbers reachable from one person; members is used for exact sets, sketch for approximate ones
+typedef struct {
+    int* members;
+    int count;
+    uint8_t* sketch;
+    int pendingReaders;
+} ReachSet;
+
+void releaseReachSet(ReachSet* set) {
+    if (--set->pendingReaders <= 0) {
+        free(set->members);
+        free(set->sketch);
+        set->members = NULL;
+        set->sketch = NULL;
+    }
+}
+
+// builds the reach set of person from the sets of its neighbours (children or parents)
+void buildReachSet(ReachSet* sets, int person, const int* neighbours, int count, bool approximate, int* stamp, int* buffer) {
+    ReachSet* set = sets + person;
+    bool useSketch = false;
+    for (int i = 0; i < count && approximate; i++) {
+        useSketch = useSketch || sets[neighbours[i]].sketch;
+    }
+    if (useSketch) {
+        set->sketch = calloc(HLL_REGISTERS, 1);
+        for (int i = 0; i < count; i++) {
+            ReachSet* other = sets + neighbours[i];
+            addToSketch(set->sketch, neighbours[i]);
+            if (other->sketch) {
+                mergeSketch(set->sketch, other->sketch);
+            }
+            for (int j = 0; other->members && j < other->count; j++) {
+                addToSketch(set->sketch, other->members[j]);
+            }
+            releaseReachSet(other);
+        }
+        set->count = (int)estimateSketch(set->sketch);
+        return;
+    }
+
+    int size = 0;
+    int mark = -(person + 1);
+    for (int i = 0; i < count; i++) {
+        ReachSet* other = sets + neighbours[i];
+        if (stamp[neighbours[i]] != mark) {
+            stamp[neighbours[i]] = mark;
+            buffer[size++] = neighbours[i];
+        }
+        for (int j = 0; other->members && j < other->count; j++) {
+            if (stamp[other->members[j]] != mark) {
+                stamp[other->members[j]] = mark;
+                buffer[size++] = other->members[j];
+            }
+        }
+        releaseReachSet(other);
+    }
+    set->count = size;
+    if (approximate && size > EXACT_SET_LIMIT) {
+        set->sketch = calloc(HLL_REGISTERS, 1);
+        for (int i = 0; i < size; i++) {
+            addToSketch(set->sketch, buffer[i]);
+        }
+    } else {
+        set->members = malloc((size + 1) * sizeof(int));
+        memcpy(set->members, buffer, size * sizeof(int));
+    }
+}
+
+IndividualStats* getTreeStats(const GEDCOMobject* obj, bool approximate) {
+    if (!obj || !getLength(obj->individuals)) {
+        return NULL;
+    }
+    RecordIndex* index = createRecordIndex(obj);
+    int n = index->individualCount;
+    IndividualStats* stats = calloc(n, sizeof(IndividualStats));
+    // stamp holds positive marks while collecting neighbours and negative ones while merging sets
+    int* stamp = calloc(n, sizeof(int));
+    int* neighbours = malloc(n * sizeof(int));
+    int* buffer = malloc(n * sizeof(int));
+    int* childrenStart = malloc((n + 1) * sizeof(int));
+    int* parentsStart = malloc((n + 1) * sizeof(int));
+    int* inDegree = calloc(n, sizeof(int));
+
+    // distinct parent -> child edges; each person is a neighbour at most once per person
+    int edges = 0;
+    for (int i = 0; i < n; i++) {
+        edges += collectChildren(index, i, stamp, i + 1, neighbours);
+    }
+    int* childEdges = malloc((edges + 1) * sizeof(int));
+    int* parentEdges = malloc((edges + 1) * sizeof(int));
+    memset(stamp, 0, n * sizeof(int));
+    childrenStart[0] = parentsStart[0] = 0;
+    for (int i = 0; i < n; i++) {
+        int count = collectChildren(index, i, stamp, i + 1, childEdges + childrenStart[i]);
+        childrenStart[i + 1] = childrenStart[i] + count;
+        stats[i].children = count;
+    }
+    memset(stamp, 0, n * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        int count = collectParents(index, i, stamp, i + 1, parentEdges + parentsStart[i]);
+        parentsStart[i + 1] = parentsStart[i] + count;
+        inDegree[i] = count;
+    }
+
+    // Kahn's algorithm; people on a pedigree cycle never reach in-degree zero
+    int* order = malloc(n * sizeof(int));
+    int ordered = 0;
+    for (int i = 0; i < n; i++) {
+        if (!inDegree[i]) {
+            order[ordered++] = i;
+        }
+    }
+    for (int k = 0; k < ordered; k++) {
+        int person = order[k];
+        for (int j = childrenStart[person]; j < childrenStart[person + 1]; j++) {
+            int child = childEdges[j];
+            if (stats[child].generation < stats[person].generation + 1) {
+                stats[child].generation = stats[person].generation + 1;
+            }
+            if (!--inDegree[child]) {
+                order[ordered++] = child;
+            }
+        }
+    }
+    // nobody on a cycle or below one is ordered, and their counts would have no end
+    if (ordered < n) {
+        free(stats);
+        stats = NULL;
+        goto clearAndReturn;
+    }
+
+    ReachSet* sets = calloc(n, sizeof(ReachSet));
+    memset(stamp, 0, n * sizeof(int));
+
+    // ancestors: parents come before children in the order
+    for (int i = 0; i < n; i++) {
+        sets[i].pendingReaders = childrenStart[i + 1] - childrenStart[i];
+    }
+    for (int k = 0; k < ordered; k++) {
+        int person = order[k];
+        buildReachSet(sets, person, parentEdges + parentsStart[person], parentsStart[person + 1] - parentsStart[person],
+                approximate, stamp, buffer);
+        stats[person].ancestors = sets[person].count;
+        if (!sets[person].pendingReaders) {
+            releaseReachSet(sets + person);
+        }
+    }
+
+    // descendants: walk the same order backwards
+    memset(sets, 0, n * sizeof(ReachSet));
+    memset(stamp, 0, n * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        sets[i].pendingReaders = parentsStart[i + 1] - parentsStart[i];
+    }
+    for (int k = ordered - 1; k >= 0; k--) {
+        int person = order[k];
+        buildReachSet(sets, person, childEdges + childrenStart[person], childrenStart[person + 1] - childrenStart[person],
+                approximate, stamp, buffer);
+        stats[person].descendants = sets[person].count;
+        if (!sets[person].pendingReaders) {
+            releaseReachSet(sets + person);
+        }
+    }
+
+    free(sets);
+clearAndReturn:
+    free(order);
+    free(childEdges);
+    free(parentEdges);
+    free(childrenStart);
+    free(parentsStart);
+    free(inDegree);
+    free(buffer);
+    free(neighbours);
+    free(stamp);
+    deleteRecordIndex(index);
+    return stats;
+}
+
+//////// compressed record sets
+
+// roaring-style set of record numbers: one chunk per 65536 records, stored as a sorted array
+// while sparse and as a plain bitmap once it holds more than CHUNK_ARRAY_LIMIT members
+#define CHUNK_ARRAY_LIMIT 4096
+#define CHUNK_WORDS 1024
+
+typedef struct {
+    uint16_t key;
+    int count;
+    uint16_t* values;
+    uint64_t* bits;
+} SetChunk;
+
+struct individualSet {
+    SetChunk* chunks;
+    int chunkCount;
+    int allocated;
+};
+
+IndividualSet* createIndividualSet(void) {
+    IndividualSet* set = malloc(sizeof(IndividualSet));
+    set->allocated = 4;
+    set->chunks = malloc(set->allocated * sizeof(SetChunk));
+    set->chunkCount = 0;
+    return set;
+}
+
+void deleteIndividualSet(IndividualSet* set) {
+    if (!set) {
+        return;
+    }
+    for (int i = 0; i < set->chunkCount; i++) {
+        free(set->chunks[i].values);
+        free(set->chunks[i].bits);
+    }
+    free(set->chunks);
+    free(set);
+}
+
+// index of the chunk with the given key, or -(insertion point) - 1
+int findSetChunk(const IndividualSet* set, uint16_t key) {
+    int low = 0;
+    int high = set->chunkCount - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        if (set->chunks[mid].key == key) {
+            return mid;
+        }
+        if (set->chunks[mid].key < key) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return -low - 1;
+}
+
+SetChunk* insertSetChunk(IndividualSet* set, int position, uint16_t key) {
+    if (set->chunkCount == set->allocated) {
+        set->allocated *= 2;
+        set->chunks = realloc(set->chunks, set->allocated * sizeof(SetChunk));
+    }
+    memmove(set->chunks + position + 1, set->chunks + position, (set->chunkCount - position) * sizeof(SetChunk));
+    set->chunkCount++;
+    SetChunk* chunk = set->chunks + position;
+    chunk->key = key;
+    chunk->count = 0;
+    chunk->values = malloc(16 * sizeof(uint16_t));
+    chunk->bits = NULL;
+    return chunk;
+}
+
+void chunkToBitmap(SetChunk* chunk) {
+    chunk->bits = calloc(CHUNK_WORDS, sizeof(uint64_t));
+    for (int i = 0; i < chunk->count; i++) {
+        chunk->bits[chunk->values[i] >> 6] |= 1ULL << (chunk->values[i] & 63);
+    }
+    free(chunk->values);
+    chunk->values = NULL;
+}
+
+void chunkToArray(SetChunk* chunk) {
+    chunk->values = malloc((chunk->count + 1) * sizeof(uint16_t));
+    int counter = 0;
+    for (int w = 0; w < CHUNK_WORDS; w++) {
+        for (uint64_t word = chunk->bits[w]; word; word &= word - 1) {
+            chunk->values[counter++] = (uint16_t)(w * 64 + __builtin_ctzll(word));
+        }
+    }
+    free(chunk->bits);
+    chunk->bits = NULL;
+}
+
+bool chunkContains(const SetChunk* chunk, uint16_t value) {
+    if (chunk->bits) {
+        return (chunk->bits[value >> 6] >> (value & 63)) & 1;
+    }
+    int low = 0;
+    int high = chunk->count - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        if (chunk->values[mid] == value) {
+            return true;
+        }
+        if (chunk->values[mid] < value) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return false;
+}
+
+// returns false if the record was already in the set
+bool addToSet(IndividualSet* set, int record) {
+    uint16_t key = (uint16_t)(record >> 16);
+    uint16_t value = (uint16_t)(record & 0xffff);
+    int position = findSetChunk(set, key);
+    SetChunk* chunk = position >= 0 ? set->chunks + position : insertSetChunk(set, -position - 1, key);
+    if (chunk->bits) {
+        uint64_t mask = 1ULL << (value & 63);
+        if (chunk->bits[value >> 6] & mask) {
+            return false;
+        }
+        chunk->bits[value >> 6] |= mask;
+        chunk->count++;
+        return true;
+    }
+    int low = 0;
+    int high = chunk->count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (chunk->values[mid] < value) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low < chunk->count && chunk->values[low] == value) {
+        return false;
+    }
+    if (chunk->count == CHUNK_ARRAY_LIMIT) {
+        chunkToBitmap(chunk);
+        chunk->bits[value >> 6] |= 1ULL << (value & 63);
+        chunk->count++;
+        return true;
+    }
+    // arrays grow in powers of two
+    if (chunk->count >= 16 && !(chunk->count & (chunk->count - 1))) {
+        chunk->values = realloc(chunk->values, 2 * chunk->count * sizeof(uint16_t));
+    }
+    memmove(chunk->values + low + 1, chunk->values + low, (chunk->count - low) * sizeof(uint16_t));
+    chunk->values[low] = value;
+    chunk->count++;
+    return true;
+}
+
+bool setContains(const RecordIndex* index, const IndividualSet* set, const Individual* person) {
+    if (!index || !set || !person) {
+        return false;
+    }
+    int record = getPointer(&index->individualNumbers, person);
+    if (record < 0) {
+        return false;
+    }
+    int position = findSetChunk(set, (uint16_t)(record >> 16));
+    return position >= 0 && chunkContains(set->chunks + position, (uint16_t)(record & 0xffff));
+}
+
+int getSetSize(const IndividualSet* set) {
+    int size = 0;
+    for (int i = 0; set && i < set->chunkCount; i++) {
+        size += set->chunks[i].count;
+    }
+    return size;
+}
+
+typedef enum {SET_AND, SET_OR, SET_AND_NOT} SetOperation;
+
+void fillChunkWords(const SetChunk* chunk, uint64_t* words) {
+    if (!chunk) {
+        memset(words, 0, CHUNK_WORDS * sizeof(uint64_t));
+    } else if (chunk->bits) {
+        memcpy(words, chunk->bits, CHUNK_WORDS * sizeof(uint64_t));
+    } else {
+        memset(words, 0, CHUNK_WORDS * sizeof(uint64_t));
+        for (int i = 0; i < chunk->count; i++) {
+            words[chunk->values[i] >> 6] |= 1ULL << (chunk->values[i] & 63);
+        }
+    }
+}
+
+// combines two chunks with the same key (either may be NULL) and appends the result to target if not empty
+void combineChunks(IndividualSet* target, uint16_t key, const SetChunk* a, const SetChunk* b, SetOperation op) {
+    SetChunk result;
+    result.key = key;
+    result.count = 0;
+    result.values = NULL;
+    result.bits = NULL;
+    if ((!a || !a->bits) && (!b || !b->bits)) {
+        // both sparse: merge the sorted arrays
+        int na = a ? a->count : 0;
+        int nb = b ? b->count : 0;
+        result.values = malloc((na + nb + 1) * sizeof(uint16_t));
+        int i = 0;
+        int j = 0;
+        while (i < na || j < nb) {
+            if (j >= nb || (i < na && a->values[i] < b->values[j])) {
+                if (op != SET_AND) {
+                    result.values[result.count++] = a->values[i];
+                }
+                i++;
+            } else if (i >= na || b->values[j] < a->values[i]) {
+                if (op == SET_OR) {
+                    result.values[result.count++] = b->values[j];
+                }
+                j++;
+            } else {
+                if (op != SET_AND_NOT) {
+                    result.values[result.count++] = a->values[i];
+                }
+                i++;
+                j++;
+            }
+        }
+        if (result.count > CHUNK_ARRAY_LIMIT) {
+            chunkToBitmap(&result);
+        }
+    } else {
+        result.bits = malloc(CHUNK_WORDS * sizeof(uint64_t));
+        uint64_t* other = malloc(CHUNK_WORDS * sizeof(uint64_t));
+        fillChunkWords(a, result.bits);
+        fillChunkWords(b, other);
+        for (int w = 0; w < CHUNK_WORDS; w++) {
+            if (op == SET_AND) {
+                result.bits[w] &= other[w];
+            } else if (op == SET_OR) {
+                result.bits[w] |= other[w];
+            } else {
+                result.bits[w] &= ~other[w];
+            }
+            result.count += __builtin_popcountll(result.bits[w]);
+        }
+        free(other);
+        if (result.count <= CHUNK_ARRAY_LIMIT) {
+            chunkToArray(&result);
+        }
+    }
+    if (!result.count) {
+        free(result.values);
+        free(result.bits);
+        return;
+    }
+    if (target->chunkCount == target->allocated) {
+        target->allocated *= 2;
+        target->chunks = realloc(target->chunks, target->allocated * sizeof(SetChunk));
+    }
+    target->chunks[target->chunkCount++] = result;
+}
+
+IndividualSet* combineSets(const IndividualSet* a, const IndividualSet* b, SetOperation op) {
+    IndividualSet* res = createIndividualSet();
+    if (!a || !b) {
+        return res;
+    }
+    int i = 0;
+    int j = 0;
+    while (i < a->chunkCount || j < b->chunkCount) {
+        if (j >= b->chunkCount || (i < a->chunkCount && a->chunks[i].key < b->chunks[j].key)) {
+            if (op != SET_AND) {
+                combineChunks(res, a->chunks[i].key, a->chunks + i, NULL, op);
+            }
+            i++;
+        } else if (i >= a->chunkCount || b->chunks[j].key < a->chunks[i].key) {
+            if (op == SET_OR) {
+                combineChunks(res, b->chunks[j].key, NULL, b->chunks + j, op);
+            }
+            j++;
+        } else {
+            combineChunks(res, a->chunks[i].key, a->chunks + i, b->chunks + j, op);
+            i++;
+            j++;
+        }
+    }
+    return res;
+}
+
+IndividualSet* intersectSets(const IndividualSet* a, const IndividualSet* b) {
+    return combineSets(a, b, SET_AND);
+}
+
+IndividualSet* unionSets(const IndividualSet* a, const IndividualSet* b) {
+    return combineSets(a, b, SET_OR);
+}
+
+IndividualSet* subtractSets(const IndividualSet* a, const IndividualSet* b) {
+    return combineSets(a, b, SET_AND_NOT);
+}
+
+List setToList(const RecordIndex* index, const IndividualSet* set) {
+    List res = initializeList(&printIndividual, &doNotDelete, &compareIndividuals);
+    if (!index || !set) {
+        return res;
+    }
+    for (int i = 0; i < set->chunkCount; i++) {
+        const SetChunk* chunk = set->chunks + i;
+        int base = chunk->key << 16;
+        if (chunk->bits) {
+            for (int w = 0; w < CHUNK_WORDS; w++) {
+                for (uint64_t word = chunk->bits[w]; word; word &= word - 1) {
+                    insertBack(&res, index->individuals[base + w * 64 + __builtin_ctzll(word)]);
+                }
+            }
         } else {
-            *target++ = *pos++;
+            for (int j = 0; j < chunk->count; j++) {
+                insertBack(&res, index->individuals[base + chunk->values[j]]);
+            }
+        }
+    }
+    return res;
+}
+
+// breadth first walk over parent (up) or child (down) links; the set doubles as the visited marks
+IndividualSet* collectRelatives(const RecordIndex* index, const Individual* person, int maxGen, bool up) {
+    IndividualSet* set = createIndividualSet();
+    if (!index || !person) {
+        return set;
+    }
+    int start = getPointer(&index->individualNumbers, person);
+    if (start < 0) {
+        return set;
+    }
+    if (maxGen <= 0) {
+        maxGen = INT_MAX;
+    }
+    int allocated = 64;
+    int* queue = malloc(allocated * sizeof(int));
+    int queueEnd = 1;
+    queue[0] = start;
+    int levelEnd = 1;
+    int generation = 0;
+    for (int k = 0; k < queueEnd && generation < maxGen; k++) {
+        int current = queue[k];
+        int first = up ? index->parentFamilyStart[current] : index->spouseFamilyStart[current];
+        int last = up ? index->parentFamilyStart[current + 1] : index->spouseFamilyStart[current + 1];
+        for (int i = first; i < last; i++) {
+            int f = up ? index->parentFamilies[i] : index->spouseFamilies[i];
+            int relatives[2] = { index->husband[f], index->wife[f] };
+            const int* next = up ? relatives : index->children + index->childStart[f];
+            int count = up ? 2 : index->childStart[f + 1] - index->childStart[f];
+            for (int j = 0; j < count; j++) {
+                if (next[j] < 0 || !addToSet(set, next[j])) {
+                    continue;
+                }
+                if (queueEnd == allocated) {
+                    allocated *= 2;
+                    queue = realloc(queue, allocated * sizeof(int));
+                }
+                queue[queueEnd++] = next[j];
+            }
+        }
+        if (k + 1 == levelEnd) {
+            levelEnd = queueEnd;
+            generation++;
+        }
+    }
+    free(queue);
+    return set;
+}
+
+IndividualSet* getAncestorSet(const RecordIndex* index, const Individual* person, int maxGen) {
+    return collectRelatives(index, person, maxGen, true);
+}
+
+IndividualSet* getDescendantSet(const RecordIndex* index, const Individual* person, unsigned int maxGen) {
+    return collectRelatives(index, person, maxGen > INT_MAX ? 0 : (int)maxGen, false);
+}
+
+//////// batched descendant traversal
+
+// child frontiers shared by all queries of a batch; people are numbered on first sight, so
+// spouses and children that are not in the individuals list are handled like getDescendantListN does
+typedef struct {
+    PointerMap numbers;
+    const Individual** people;
+    int count;
+    int allocated;
+    // families where each person is a spouse, in the order of the families list
+    int* spouseFamilyStart;
+    int* spouseFamilies;
+    // children of every family as person numbers
+    int* childStart;
+    int* children;
+    // people numbered later (starting people outside the object) are not spouses anywhere
+    int spouseCount;
+    // memoized concatenated children of each person, computed on first expansion
+    int* frontierStart;
+    int* frontierLength;
+    int* frontiers;
+    int frontiersLength;
+    int frontiersAllocated;
+} ChildFrontiers;
+
+int numberPerson(ChildFrontiers* fr, const Individual* person) {
+    int number = getPointer(&fr->numbers, person);
+    if (number >= 0) {
+        return number;
+    }
+    if (fr->count == fr->allocated) {
+        fr->allocated *= 2;
+        fr->people = realloc(fr->people, fr->allocated * sizeof(Individual*));
+    }
+    fr->people[fr->count] = person;
+    putPointer(&fr->numbers, person, fr->count);
+    return fr->count++;
+}
+
+void initChildFrontiers(ChildFrontiers* fr, const GEDCOMobject* familyRecord) {
+    int individualCount = getLength(familyRecord->individuals);
+    int familyCount = getLength(familyRecord->families);
+    fr->allocated = individualCount + 16;
+    fr->count = 0;
+    fr->people = malloc(fr->allocated * sizeof(Individual*));
+    initPointerMap(&fr->numbers, fr->allocated);
+    ListIterator it = createIterator(familyRecord->individuals);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        numberPerson(fr, data);
+    }
+
+    int* husbands = malloc((familyCount + 1) * sizeof(int));
+    int* wives = malloc((familyCount + 1) * sizeof(int));
+    fr->childStart = malloc((familyCount + 1) * sizeof(int));
+    int childrenAllocated = 64;
+    fr->children = malloc(childrenAllocated * sizeof(int));
+    fr->childStart[0] = 0;
+    int f = 0;
+    it = createIterator(familyRecord->families);
+    for (void* data = nextElement(&it); data; data = nextElement(&it), f++) {
+        Family* family = (Family*)data;
+        husbands[f] = family->husband ? numberPerson(fr, family->husband) : -1;
+        wives[f] = family->wife ? numberPerson(fr, family->wife) : -1;
+        int next = fr->childStart[f];
+        ListIterator jt = createIterator(family->children);
+        for (void* ch = nextElement(&jt); ch; ch = nextElement(&jt)) {
+            if (next == childrenAllocated) {
+                childrenAllocated *= 2;
+                fr->children = realloc(fr->children, childrenAllocated * sizeof(int));
+            }
+            fr->children[next++] = numberPerson(fr, ch);
+        }
+        fr->childStart[f + 1] = next;
+    }
+
+    int* counts = calloc(fr->count + 1, sizeof(int));
+    for (f = 0; f < familyCount; f++) {
+        if (husbands[f] >= 0) {
+            counts[husbands[f]]++;
+        }
+        if (wives[f] >= 0 && wives[f] != husbands[f]) {
+            counts[wives[f]]++;
+        }
+    }
+    fr->spouseFamilyStart = countsToStarts(counts, fr->count);
+    fr->spouseFamilies = malloc((fr->spouseFamilyStart[fr->count] + 1) * sizeof(int));
+    for (f = 0; f < familyCount; f++) {
+        if (husbands[f] >= 0) {
+            fr->spouseFamilies[counts[husbands[f]]++] = f;
+        }
+        if (wives[f] >= 0 && wives[f] != husbands[f]) {
+            fr->spouseFamilies[counts[wives[f]]++] = f;
+        }
+    }
+    free(counts);
+    free(husbands);
+    free(wives);
+
+    fr->spouseCount = fr->count;
+    fr->frontierStart = malloc((fr->count + 1) * sizeof(int));
+    fr->frontierLength = malloc((fr->count + 1) * sizeof(int));
+    for (int i = 0; i < fr->count; i++) {
+        fr->frontierStart[i] = -1;
+    }
+    fr->frontiersAllocated = 64;
+    fr->frontiersLength = 0;
+    fr->frontiers = malloc(fr->frontiersAllocated * sizeof(int));
+}
+
+void deleteChildFrontiers(ChildFrontiers* fr) {
+    deletePointerMap(&fr->numbers);
+    free(fr->people);
+    free(fr->spouseFamilyStart);
+    free(fr->spouseFamilies);
+    free(fr->childStart);
+    free(fr->children);
+    free(fr->frontierStart);
+    free(fr->frontierLength);
+    free(fr->frontiers);
+}
+
+// children of a person in the order addDescendant visits them: spouse families in list order, then children in family order
+const int* getChildFrontier(ChildFrontiers* fr, int person, int* length) {
+    if (person >= fr->spouseCount) {
+        *length = 0;
+        return NULL;
+    }
+    if (fr->frontierStart[person] < 0) {
+        fr->frontierStart[person] = fr->frontiersLength;
+        for (int i = fr->spouseFamilyStart[person]; i < fr->spouseFamilyStart[person + 1]; i++) {
+            int f = fr->spouseFamilies[i];
+            int count = fr->childStart[f + 1] - fr->childStart[f];
+            while (fr->frontiersLength + count > fr->frontiersAllocated) {
+                fr->frontiersAllocated *= 2;
+                fr->frontiers = realloc(fr->frontiers, fr->frontiersAllocated * sizeof(int));
+            }
+            memcpy(fr->frontiers + fr->frontiersLength, fr->children + fr->childStart[f], count * sizeof(int));
+            fr->frontiersLength += count;
         }
+        fr->frontierLength[person] = fr->frontiersLength - fr->frontierStart[person];
     }
-    *target = '\0';
-    *cursor = pos;
-    return res;
+    *length = fr->frontierLength[person];
+    return fr->frontiers + fr->frontierStart[person];
 }
 
-Individual* JSONtoInd(const char* str) {
-    Individual* res = malloc(sizeof(Individual));
-    for (const char* current = str + 1; *current != '}';) {
-        char* fieldName = readJsonString(&current);
-        // current must refer to ":"
-        current++;
-        char* value = readJsonString(&current);
-        // current is ',' or '}'
-        if (!strcmp("givenName", fieldName)) {
-            res->givenName = value;
-        } else if (!strcmp("surname", fieldName)) {
-            res->surname = value;
-        } else {
-            free(value);
+List* getDescendantListsN(const GEDCOMobject* familyRecord, const Individual** people, int count, unsigned int maxGen) {
+    if (!familyRecord || !people || count <= 0) {
+        return NULL;
+    }
+    List* results = malloc(count * sizeof(List));
+    ChildFrontiers fr;
+    initChildFrontiers(&fr, familyRecord);
+    // starting people are numbered before any stamps are allocated, so the number space is final
+    int* starts = malloc(count * sizeof(int));
+    for (int q = 0; q < count; q++) {
+        starts[q] = people[q] ? numberPerson(&fr, people[q]) : -1;
+    }
+    int* stamp = calloc(fr.count + 1, sizeof(int));
+    int* current = malloc((fr.count + 1) * sizeof(int));
+    int* next = malloc((fr.count + 1) * sizeof(int));
+    int mark = 0;
+
+    for (int q = 0; q < count; q++) {
+        results[q] = initializeList(&printGeneration, &deleteGeneration, &compareGenerations);
+        if (starts[q] < 0) {
+            continue;
+        }
+        // a level of getDescendantListN is the previous level's children in order, without repeats
+        int currentLength = 1;
+        current[0] = starts[q];
+        for (unsigned int level = 0; level < maxGen && currentLength; level++) {
+            mark++;
+            int nextLength = 0;
+            for (int i = 0; i < currentLength; i++) {
+                int frontierLength;
+                const int* frontier = getChildFrontier(&fr, current[i], &frontierLength);
+                for (int j = 0; j < frontierLength; j++) {
+                    if (stamp[frontier[j]] != mark) {
+                        stamp[frontier[j]] = mark;
+                        next[nextLength++] = frontier[j];
+                    }
+                }
+            }
+            if (!nextLength) {
+                break;
+            }
+            List* generation = malloc(sizeof(List));
+            *generation = initializeList(&printIndividual, &doNotDelete, &compareIndividuals);
+            for (int i = 0; i < nextLength; i++) {
+                insertBack(generation, (void*)fr.people[next[i]]);
+            }
+            insertBack(&results[q], generation);
+            int* swap = current;
+            current = next;
+            next = swap;
+            currentLength = nextLength;
+        }
+    }
+
+    free(stamp);
+    free(current);
+    free(next);
+    free(starts);
+    deleteChildFrontiers(&fr);
+    return results;
+}
+
+//////// structural validation
+
+// link checks for a contiguous range of individuals and families; shards only read the index
+typedef struct {
+    const RecordIndex* index;
+    int firstIndividual;
+    int lastIndividual;
+    int firstFamily;
+    int lastFamily;
+    ErrorCode result;
+} ValidationShard;
+
+bool personInFamily(const Family* family, const Individual* person) {
+    return family->husband == person || family->wife == person || findElement(family->children, &pointersAreEqual, person);
+}
+
+void* validateShard(void* arg) {
+    ValidationShard* shard = (ValidationShard*)arg;
+    const RecordIndex* index = shard->index;
+    shard->result = OK;
+    // stamps for duplicate detection, marked with the record number + 1 of the current owner
+    int* individualStamp = calloc(index->individualCount + 1, sizeof(int));
+    int* familyStamp = calloc(index->familyCount + 1, sizeof(int));
+
+    for (int f = shard->firstFamily; f < shard->lastFamily && shard->result == OK; f++) {
+        Family* family = index->families[f];
+        if ((family->husband && index->husband[f] < 0) || (family->wife && index->wife[f] < 0)) {
+            shard->result = INV_RECORD;
+        } else if (family->husband && family->husband == family->wife) {
+            shard->result = INV_RECORD;
+        } else if (index->childStart[f + 1] - index->childStart[f] != getLength(family->children)) {
+            // a child that is not part of the object
+            shard->result = INV_RECORD;
+        }
+        for (int j = index->childStart[f]; j < index->childStart[f + 1] && shard->result == OK; j++) {
+            int child = index->children[j];
+            if (individualStamp[child] == f + 1) {
+                shard->result = INV_RECORD;
+            }
+            individualStamp[child] = f + 1;
+        }
+    }
+
+    memset(individualStamp, 0, (index->individualCount + 1) * sizeof(int));
+    for (int i = shard->firstIndividual; i < shard->lastIndividual && shard->result == OK; i++) {
+        Individual* person = index->individuals[i];
+        ListIterator it = createIterator(person->families);
+        for (void* data = nextElement(&it); data && shard->result == OK; data = nextElement(&it)) {
+            int f = getPointer(&index->familyNumbers, data);
+            if (f < 0 || familyStamp[f] == i + 1 || !personInFamily((Family*)data, person)) {
+                shard->result = INV_RECORD;
+            } else {
+                familyStamp[f] = i + 1;
+            }
+        }
+    }
+
+    free(individualStamp);
+    free(familyStamp);
+    return NULL;
+}
+
+#define RECORDS_PER_SHARD 16384
+#define MAX_VALIDATION_THREADS 16
+
+ErrorCode validateLinks(const RecordIndex* index) {
+    int records = index->individualCount > index->familyCount ? index->individualCount : index->familyCount;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > MAX_VALIDATION_THREADS) {
+        threads = MAX_VALIDATION_THREADS;
+    }
+    if (threads > records / RECORDS_PER_SHARD) {
+        threads = records / RECORDS_PER_SHARD;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    ValidationShard shards[MAX_VALIDATION_THREADS];
+    pthread_t workers[MAX_VALIDATION_THREADS];
+    bool started[MAX_VALIDATION_THREADS];
+    for (int t = 0; t < threads; t++) {
+        shards[t].index = index;
+        shards[t].firstIndividual = (int)((long long)index->individualCount * t / threads);
+        shards[t].lastIndividual = (int)((long long)index->individualCount * (t + 1) / threads);
+        shards[t].firstFamily = (int)((long long)index->familyCount * t / threads);
+        shards[t].lastFamily = (int)((long long)index->familyCount * (t + 1) / threads);
+        // the first shard runs on the calling thread, and so does any shard whose thread cannot be started
+        started[t] = t && !pthread_create(&workers[t], NULL, &validateShard, &shards[t]);
+        if (!started[t] && t) {
+            validateShard(&shards[t]);
+        }
+    }
+    validateShard(&shards[0]);
+
+    ErrorCode res = OK;
+    for (int t = 0; t < threads; t++) {
+        if (started[t]) {
+            pthread_join(workers[t], NULL);
+        }
+        if (shards[t].result != OK) {
+            res = shards[t].result;
         }
-        free(fieldName);
     }
     return res;
 }
 
-GEDCOMobject* JSONtoGEDCOM(const char* str) {
-    GEDCOMobject* res = malloc(sizeof(GEDCOMobject));
-    initGEDCOMobject(res);
-    res->submitter = malloc(sizeof(Submitter));
-    memset(res->submitter, 0, sizeof(Submitter));
-    res->submitter->otherFields = initializeList(&printField, &deleteField, &compareFields);
-    for (const char* current = str + 1; *current != '}';) {
-        char* fieldName = readJsonString(&current);
-        // current must refer to ":"
-        current++;
-        char* value = readJsonString(&current);
-        // current is ',' or '}'
-        if (!strcmp("source", fieldName)) {
-            strncpy(res->header->source, value, sizeof(res->header->source));
-            free(value);
-        } else if (!strcmp("gedcVersion", fieldName)) {
-            res->header->gedcVersion = atof(value);
-            free(value);
-        } else if (!strcmp("encoding", fieldName)) {
-            parseEncoding(value, &res->header->encoding);
-            free(value);
-        } else if (!strcmp("subName", fieldName)) {
-            strncpy(res->submitter->submitterName, value, sizeof(res->submitter->submitterName));
-            free(value);
-        } else if (!strcmp("subAddress", fieldName)) {
-            int len = strlen(value);
-            res->submitter = realloc(res->submitter, sizeof(Submitter) + len + 1);
-            strncpy(res->submitter->address, value, len);
-            free(value);
-        } else {
-            free(value);
+// iterative Tarjan SCC over distinct parent -> child edges; true if someone is their own ancestor
+bool hasPedigreeCycle(const RecordIndex* index) {
+    int n = index->individualCount;
+    int* stamp = calloc(n + 1, sizeof(int));
+    int* edgeStart = malloc((n + 1) * sizeof(int));
+    int edgesAllocated = n + 16;
+    int* edges = malloc(edgesAllocated * sizeof(int));
+    int* children = malloc((n + 1) * sizeof(int));
+    edgeStart[0] = 0;
+    for (int i = 0; i < n; i++) {
+        int count = collectChildren(index, i, stamp, i + 1, children);
+        if (edgeStart[i] + count > edgesAllocated) {
+            edgesAllocated = 2 * (edgeStart[i] + count);
+            edges = realloc(edges, edgesAllocated * sizeof(int));
         }
-        free(fieldName);
+        memcpy(edges + edgeStart[i], children, count * sizeof(int));
+        edgeStart[i + 1] = edgeStart[i] + count;
     }
-    res->header->submitter = res->submitter;
+
+    int* order = malloc((n + 1) * sizeof(int));
+    int* low = malloc((n + 1) * sizeof(int));
+    bool* onStack = calloc(n + 1, sizeof(bool));
+    int* stack = malloc((n + 1) * sizeof(int));
+    int* callStack = malloc((n + 1) * sizeof(int));
+    int* nextEdge = malloc((n + 1) * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        order[i] = -1;
+    }
+    int counter = 0;
+    int stackSize = 0;
+    bool cycle = false;
+
+    for (int root = 0; root < n && !cycle; root++) {
+        if (order[root] >= 0) {
+            continue;
+        }
+        int depth = 0;
+        callStack[depth++] = root;
+        order[root] = low[root] = counter++;
+        nextEdge[root] = edgeStart[root];
+        stack[stackSize++] = root;
+        onStack[root] = true;
+        while (depth && !cycle) {
+            int v = callStack[depth - 1];
+            if (nextEdge[v] < edgeStart[v + 1]) {
+                int w = edges[nextEdge[v]++];
+                if (w == v) {
+                    cycle = true;
+                } else if (order[w] < 0) {
+                    order[w] = low[w] = counter++;
+                    nextEdge[w] = edgeStart[w];
+                    stack[stackSize++] = w;
+                    onStack[w] = true;
+                    callStack[depth++] = w;
+                } else if (onStack[w] && order[w] < low[v]) {
+                    low[v] = order[w];
+                }
+                continue;
+            }
+            depth--;
+            if (depth && low[v] < low[callStack[depth - 1]]) {
+                low[callStack[depth - 1]] = low[v];
+            }
+            if (low[v] == order[v]) {
+                // v is the root of a component; more than one member means a cycle
+                int size = 0;
+                int w;
+                do {
+                    w = stack[--stackSize];
+                    onStack[w] = false;
+                    size++;
+                } while (w != v);
+                cycle = size > 1;
+            }
+        }
+    }
+
+    free(stamp);
+    free(edgeStart);
+    free(edges);
+    free(children);
+    free(order);
+    free(low);
+    free(onStack);
+    free(stack);
+    free(callStack);
+    free(nextEdge);
+    return cycle;
+}
+
+ErrorCode validateStructure(const GEDCOMobject* obj) {
+    RecordIndex* index = createRecordIndex(obj);
+    ErrorCode res = OK;
+    // the same record added twice
+    if (index->individualNumbers.count != index->individualCount || index->familyNumbers.count != index->familyCount) {
+        res = INV_RECORD;
+    }
+    if (res == OK) {
+        res = validateLinks(index);
+    }
+    if (res == OK && hasPedigreeCycle(index)) {
+        res = INV_RECORD;
+    }
+    deleteRecordIndex(index);
     return res;
 }
 
-void addIndividual(GEDCOMobject* obj, const Individual* toBeAdded) {
-    if (!obj || !toBeAdded) {
-        return;
+//////// binary snapshot
+
+// The file is a SnapshotHeader followed by 8-byte aligned sections of fixed size records.
+// Records refer to each other by index and to strings by offset into the string section,
+// so a mapped file is used as it is, without any fixing up
+#define SNAPSHOT_MAGIC "GEDSNAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+#define NO_STRING 0xffffffffu
+
+_Static_assert(sizeof(unsigned int) == sizeof(uint32_t), "snapshot links are read as unsigned int");
+
+typedef struct {
+    uint32_t first;
+    uint32_t count;
+} SnapshotSpan;
+
+typedef struct {
+    uint32_t tag;
+    uint32_t value;
+} SnapshotField;
+
+typedef struct {
+    uint32_t type;
+    uint32_t date;
+    uint32_t place;
+    SnapshotSpan fields;
+} SnapshotEvent;
+
+typedef struct {
+    uint32_t givenName;
+    uint32_t surname;
+    SnapshotSpan families;
+    SnapshotSpan events;
+    SnapshotSpan fields;
+} SnapshotIndividual;
+
+typedef struct {
+    int32_t husband;
+    int32_t wife;
+    SnapshotSpan children;
+    SnapshotSpan events;
+    SnapshotSpan fields;
+} SnapshotFamily;
+
+enum {
+    SECTION_INDIVIDUALS, SECTION_FAMILIES, SECTION_EVENTS, SECTION_FIELDS, SECTION_LINKS, SECTION_STRINGS, SECTION_COUNT
+};
+
+typedef struct {
+    uint64_t offset;
+    uint64_t size;
+} SnapshotSection;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t fileSize;
+    float gedcVersion;
+    int32_t encoding;
+    uint32_t source;
+    uint32_t submitterName;
+    uint32_t submitterAddress;
+    uint32_t hasSubmitter;
+    SnapshotSpan headerFields;
+    SnapshotSpan submitterFields;
+    SnapshotSection sections[SECTION_COUNT];
+} SnapshotHeader;
+
+struct gedcomSnapshot {
+    void* image;
+    size_t size;
+    const SnapshotHeader* header;
+    const SnapshotIndividual* individuals;
+    uint32_t individualCount;
+    const SnapshotFamily* families;
+    uint32_t familyCount;
+    const SnapshotEvent* events;
+    uint32_t eventCount;
+    const SnapshotField* fields;
+    uint32_t fieldCount;
+    const uint32_t* links;
+    uint32_t linkCount;
+    const char* strings;
+    uint64_t stringsSize;
+};
+
+// sections are built in memory buffers; equal strings are stored once
+typedef struct {
+    OutputBuffer sections[SECTION_COUNT];
+    uint32_t* stringSlots;
+    uint32_t stringCapacity;
+    uint32_t stringCount;
+    PointerMap individualNumbers;
+    PointerMap familyNumbers;
+} SnapshotBuilder;
+
+uint32_t stringHash(const char* str) {
+    uint32_t h = 2166136261u;
+    for (; *str; str++) {
+        h = (h ^ (unsigned char)*str) * 16777619u;
     }
-    insertBack(&obj->individuals, (void*)toBeAdded);
+    return h;
 }
 
-char* iListToJSON(List iList) {
-    DynBuffer buffer;
-    initDynBuffer(&buffer);
-    sprintfDyn(&buffer, 0, "[");
-    ListIterator it = createIterator(iList);
-    bool first = true;
-    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
-        if (!first) {
-            sprintfDyn(&buffer, 0, ",");
+// slots hold string offset + 1, 0 marks an empty slot
+void growStringSlots(SnapshotBuilder* builder) {
+    uint32_t* oldSlots = builder->stringSlots;
+    uint32_t oldCapacity = builder->stringCapacity;
+    builder->stringCapacity = oldCapacity ? oldCapacity * 2 : 1024;
+    builder->stringSlots = calloc(builder->stringCapacity, sizeof(uint32_t));
+    const char* strings = builder->sections[SECTION_STRINGS].text.str;
+    for (uint32_t i = 0; i < oldCapacity; i++) {
+        if (oldSlots[i]) {
+            uint32_t pos = stringHash(strings + oldSlots[i] - 1) & (builder->stringCapacity - 1);
+            while (builder->stringSlots[pos]) {
+                pos = (pos + 1) & (builder->stringCapacity - 1);
+            }
+            builder->stringSlots[pos] = oldSlots[i];
         }
-        Individual* indi = (Individual*)data;
-        char* indiBuf = indToJSON(indi);
-        sprintfDyn(&buffer, 0, indiBuf);
-        free(indiBuf);
-        first = false;
     }
-    sprintfDyn(&buffer, 0, "]");
-    return buffer.str;
+    free(oldSlots);
 }
 
-char* gListToJSON(List gList) {
-    DynBuffer buffer;
-    initDynBuffer(&buffer);
-    sprintfDyn(&buffer, 0, "[");
-    ListIterator it = createIterator(gList);
-    bool first = true;
+uint32_t internString(SnapshotBuilder* builder, const char* str) {
+    if (!str) {
+        return NO_STRING;
+    }
+    if ((builder->stringCount + 1) * 2 > builder->stringCapacity) {
+        growStringSlots(builder);
+    }
+    OutputBuffer* strings = &builder->sections[SECTION_STRINGS];
+    uint32_t pos = stringHash(str) & (builder->stringCapacity - 1);
+    for (; builder->stringSlots[pos]; pos = (pos + 1) & (builder->stringCapacity - 1)) {
+        if (!strcmp(strings->text.str + builder->stringSlots[pos] - 1, str)) {
+            return builder->stringSlots[pos] - 1;
+        }
+    }
+    size_t offset = strings->text.length;
+    size_t len = strlen(str) + 1;
+    if (offset + len >= NO_STRING) {
+        strings->failed = true;
+        return NO_STRING;
+    }
+    appendOutput(strings, str, len);
+    builder->stringSlots[pos] = (uint32_t)offset + 1;
+    builder->stringCount++;
+    return (uint32_t)offset;
+}
+
+uint32_t sectionCount(const OutputBuffer* section, size_t recordSize) {
+    return (uint32_t)(section->text.length / recordSize);
+}
+
+SnapshotSpan addSnapshotFields(SnapshotBuilder* builder, List fields) {
+    OutputBuffer* section = &builder->sections[SECTION_FIELDS];
+    SnapshotSpan span = { sectionCount(section, sizeof(SnapshotField)), 0 };
+    ListIterator it = createIterator(fields);
     for (void* data = nextElement(&it); data; data = nextElement(&it)) {
-        List* list = (List*)data;
-        if (!first) {
-            sprintfDyn(&buffer, 0, ",");
+        SnapshotField field = { internString(builder, ((Field*)data)->tag), internString(builder, ((Field*)data)->value) };
+        appendOutput(section, (const char*)&field, sizeof(field));
+        span.count++;
+    }
+    return span;
+}
+
+SnapshotSpan addSnapshotEvents(SnapshotBuilder* builder, List events) {
+    OutputBuffer* section = &builder->sections[SECTION_EVENTS];
+    // event fields go first, so the events of a record stay contiguous
+    ListIterator it = createIterator(events);
+    int count = 0;
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        count++;
+    }
+    SnapshotEvent* pending = malloc((count + 1) * sizeof(SnapshotEvent));
+    it = createIterator(events);
+    for (int i = 0; i < count; i++) {
+        Event* event = (Event*)nextElement(&it);
+        pending[i].type = internString(builder, event->type);
+        pending[i].date = internString(builder, event->date);
+        pending[i].place = internString(builder, event->place);
+        pending[i].fields = addSnapshotFields(builder, event->otherFields);
+    }
+    SnapshotSpan span = { sectionCount(section, sizeof(SnapshotEvent)), (uint32_t)count };
+    appendOutput(section, (const char*)pending, count * sizeof(SnapshotEvent));
+    free(pending);
+    return span;
+}
+
+void addSnapshotLink(SnapshotBuilder* builder, SnapshotSpan* span, int number) {
+    if (number >= 0) {
+        uint32_t link = (uint32_t)number;
+        appendOutput(&builder->sections[SECTION_LINKS], (const char*)&link, sizeof(link));
+        span->count++;
+    }
+}
+
+void addSnapshotIndividual(SnapshotBuilder* builder, const Individual* person) {
+    SnapshotIndividual record;
+    record.givenName = internString(builder, person->givenName);
+    record.surname = internString(builder, person->surname);
+    record.families.first = sectionCount(&builder->sections[SECTION_LINKS], sizeof(uint32_t));
+    record.families.count = 0;
+    ListIterator it = createIterator(person->families);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        addSnapshotLink(builder, &record.families, getPointer(&builder->familyNumbers, data));
+    }
+    record.events = addSnapshotEvents(builder, person->events);
+    record.fields = addSnapshotFields(builder, person->otherFields);
+    appendOutput(&builder->sections[SECTION_INDIVIDUALS], (const char*)&record, sizeof(record));
+}
+
+void addSnapshotFamily(SnapshotBuilder* builder, const Family* family) {
+    SnapshotFamily record;
+    record.husband = family->husband ? getPointer(&builder->individualNumbers, family->husband) : -1;
+    record.wife = family->wife ? getPointer(&builder->individualNumbers, family->wife) : -1;
+    record.children.first = sectionCount(&builder->sections[SECTION_LINKS], sizeof(uint32_t));
+    record.children.count = 0;
+    ListIterator it = createIterator(family->children);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        addSnapshotLink(builder, &record.children, getPointer(&builder->individualNumbers, data));
+    }
+    record.events = addSnapshotEvents(builder, family->events);
+    record.fields = addSnapshotFields(builder, family->otherFields);
+    appendOutput(&builder->sections[SECTION_FAMILIES], (const char*)&record, sizeof(record));
+}
+
+GEDCOMerror saveSnapshot(const char* fileName, const GEDCOMobject* obj) {
+    if (!fileName || !obj || !obj->header) {
+        return createError(WRITE_ERROR, 0);
+    }
+    SnapshotBuilder builder;
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        initOutputBuffer(&builder.sections[i], -1);
+    }
+    builder.stringSlots = NULL;
+    builder.stringCapacity = builder.stringCount = 0;
+    growStringSlots(&builder);
+    initPointerMap(&builder.individualNumbers, getLength(obj->individuals));
+    initPointerMap(&builder.familyNumbers, getLength(obj->families));
+    int counter = 0;
+    ListIterator it = createIterator(obj->individuals);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        putPointer(&builder.individualNumbers, data, counter++);
+    }
+    counter = 0;
+    it = createIterator(obj->families);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        putPointer(&builder.familyNumbers, data, counter++);
+    }
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.gedcVersion = obj->header->gedcVersion;
+    header.encoding = obj->header->encoding;
+    header.source = internString(&builder, obj->header->source);
+    header.headerFields = addSnapshotFields(&builder, obj->header->otherFields);
+    Submitter* submitter = obj->submitter ? obj->submitter : obj->header->submitter;
+    header.hasSubmitter = submitter != NULL;
+    if (submitter) {
+        header.submitterName = internString(&builder, submitter->submitterName);
+        header.submitterAddress = internString(&builder, submitter->address);
+        header.submitterFields = addSnapshotFields(&builder, submitter->otherFields);
+    }
+    it = createIterator(obj->individuals);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        addSnapshotIndividual(&builder, (Individual*)data);
+    }
+    it = createIterator(obj->families);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        addSnapshotFamily(&builder, (Family*)data);
+    }
+
+    uint64_t offset = sizeof(SnapshotHeader);
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        offset = (offset + 7) & ~(uint64_t)7;
+        header.sections[i].offset = offset;
+        header.sections[i].size = builder.sections[i].text.length;
+        offset += builder.sections[i].text.length;
+    }
+    header.fileSize = offset;
+
+    // written next to the target and renamed, so a mapped snapshot is never changed under a reader
+    GEDCOMerror res = createError(OK, 0);
+    char* tempName = malloc(strlen(fileName) + 8);
+    sprintf(tempName, "%s.XXXXXX", fileName);
+    int fd = mkstemp(tempName);
+    if (fd < 0) {
+        res = createError(INV_FILE, 0);
+    }
+    bool written = fd >= 0 && !builder.sections[SECTION_STRINGS].failed &&
+        writeAllAt(fd, (const char*)&header, sizeof(header), 0);
+    for (int i = 0; i < SECTION_COUNT && written; i++) {
+        written = writeAllAt(fd, builder.sections[i].text.str, builder.sections[i].text.length, header.sections[i].offset);
+    }
+    if (fd >= 0) {
+        written = written && !ftruncate(fd, header.fileSize) && !fchmod(fd, 0644);
+        written = !close(fd) && written && !rename(tempName, fileName);
+        if (!written) {
+            unlink(tempName);
+            res = createError(WRITE_ERROR, 0);
         }
-        char* buf = iListToJSON(*list);
-        sprintfDyn(&buffer, 0, buf);
-        free(buf);
-        first = false;
     }
-    sprintfDyn(&buffer, 0, "]");
-    return buffer.str;
+
+    free(tempName);
+    free(builder.stringSlots);
+    deletePointerMap(&builder.individualNumbers);
+    deletePointerMap(&builder.familyNumbers);
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        deleteOutputBuffer(&builder.sections[i]);
+    }
+    return res;
 }
 
-void deleteGeneration(void* toBeDeleted) {
-    clearList((List*)toBeDeleted);
-    free(toBeDeleted);
+// maps a section, checking that it lies in the file and holds whole records
+bool mapSnapshotSection(const GEDCOMsnapshot* snapshot, int section, size_t recordSize, const void** records, uint32_t* count) {
+    const SnapshotSection* info = &snapshot->header->sections[section];
+    if (info->offset % 8 || info->offset > snapshot->size || info->size > snapshot->size - info->offset ||
+        info->size % recordSize || info->size / recordSize >= NO_STRING) {
+        return false;
+    }
+    *records = (const char*)snapshot->image + info->offset;
+    *count = (uint32_t)(info->size / recordSize);
+    return true;
 }
-int compareGenerations(const void* first,const void* second) {
-    return comparePointers(first, second);
+
+GEDCOMerror loadSnapshot(const char* fileName, GEDCOMsnapshot** snapshot) {
+    if (!fileName || !snapshot) {
+        return createError(INV_FILE, -1);
+    }
+    *snapshot = NULL;
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) {
+        return createError(INV_FILE, -1);
+    }
+    struct stat info;
+    if (fstat(fd, &info) || (size_t)info.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return createError(INV_FILE, -1);
+    }
+    void* image = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        return createError(INV_FILE, -1);
+    }
+
+    GEDCOMsnapshot* res = malloc(sizeof(GEDCOMsnapshot));
+    res->image = image;
+    res->size = info.st_size;
+    res->header = (const SnapshotHeader*)image;
+    const SnapshotHeader* header = res->header;
+    uint32_t stringsSize = 0;
+    const void* strings = NULL;
+    bool valid = !memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) &&
+        header->version == SNAPSHOT_VERSION && header->byteOrder == SNAPSHOT_BYTE_ORDER &&
+        header->fileSize == res->size &&
+        mapSnapshotSection(res, SECTION_INDIVIDUALS, sizeof(SnapshotIndividual), (const void**)&res->individuals, &res->individualCount) &&
+        mapSnapshotSection(res, SECTION_FAMILIES, sizeof(SnapshotFamily), (const void**)&res->families, &res->familyCount) &&
+        mapSnapshotSection(res, SECTION_EVENTS, sizeof(SnapshotEvent), (const void**)&res->events, &res->eventCount) &&
+        mapSnapshotSection(res, SECTION_FIELDS, sizeof(SnapshotField), (const void**)&res->fields, &res->fieldCount) &&
+        mapSnapshotSection(res, SECTION_LINKS, sizeof(uint32_t), (const void**)&res->links, &res->linkCount) &&
+        mapSnapshotSection(res, SECTION_STRINGS, 1, &strings, &stringsSize) &&
+        // every string ends inside the section
+        stringsSize && !((const char*)strings)[stringsSize - 1];
+    if (!valid) {
+        munmap(image, res->size);
+        free(res);
+        return createError(INV_GEDCOM, -1);
+    }
+    res->strings = strings;
+    res->stringsSize = stringsSize;
+    *snapshot = res;
+    return createError(OK, 0);
 }
-char* printGeneration(void* toBePrinted) {
-    return toString(*(List*)toBePrinted);
+
+void closeSnapshot(GEDCOMsnapshot* snapshot) {
+    if (snapshot) {
+        munmap(snapshot->image, snapshot->size);
+        free(snapshot);
+    }
+}
+
+// accessors check every index read from the image, so a damaged file gives NULL or -1 instead of a crash
+
+const char* snapshotString(const GEDCOMsnapshot* snapshot, uint32_t offset) {
+    return offset < snapshot->stringsSize ? snapshot->strings + offset : NULL;
+}
+
+bool snapshotSpanIsValid(SnapshotSpan span, uint32_t count) {
+    return span.first <= count && span.count <= count - span.first;
+}
+
+const SnapshotIndividual* snapshotIndividual(const GEDCOMsnapshot* snapshot, int person) {
+    return snapshot && person >= 0 && (uint32_t)person < snapshot->individualCount ? snapshot->individuals + person : NULL;
+}
+
+const SnapshotFamily* snapshotFamily(const GEDCOMsnapshot* snapshot, int family) {
+    return snapshot && family >= 0 && (uint32_t)family < snapshot->familyCount ? snapshot->families + family : NULL;
+}
+
+int snapshotLink(const GEDCOMsnapshot* snapshot, SnapshotSpan span, int n, uint32_t limit) {
+    if (!snapshotSpanIsValid(span, snapshot->linkCount) || n < 0 || (uint32_t)n >= span.count) {
+        return -1;
+    }
+    uint32_t link = snapshot->links[span.first + n];
+    return link < limit ? (int)link : -1;
+}
+
+int getSnapshotIndividualCount(const GEDCOMsnapshot* snapshot) {
+    return snapshot ? (int)snapshot->individualCount : 0;
+}
+
+int getSnapshotFamilyCount(const GEDCOMsnapshot* snapshot) {
+    return snapshot ? (int)snapshot->familyCount : 0;
+}
+
+const char* getSnapshotGivenName(const GEDCOMsnapshot* snapshot, int person) {
+    const SnapshotIndividual* record = snapshotIndividual(snapshot, person);
+    return record ? snapshotString(snapshot, record->givenName) : NULL;
+}
+
+const char* getSnapshotSurname(const GEDCOMsnapshot* snapshot, int person) {
+    const SnapshotIndividual* record = snapshotIndividual(snapshot, person);
+    return record ? snapshotString(snapshot, record->surname) : NULL;
+}
+
+int getSnapshotPersonFamilyCount(const GEDCOMsnapshot* snapshot, int person) {
+    const SnapshotIndividual* record = snapshotIndividual(snapshot, person);
+    return record && snapshotSpanIsValid(record->families, snapshot->linkCount) ? (int)record->families.count : 0;
+}
+
+int getSnapshotPersonFamily(const GEDCOMsnapshot* snapshot, int person, int n) {
+    const SnapshotIndividual* record = snapshotIndividual(snapshot, person);
+    return record ? snapshotLink(snapshot, record->families, n, snapshot->familyCount) : -1;
+}
+
+int getSnapshotHusband(const GEDCOMsnapshot* snapshot, int family) {
+    const SnapshotFamily* record = snapshotFamily(snapshot, family);
+    return record && record->husband >= 0 && (uint32_t)record->husband < snapshot->individualCount ? record->husband : -1;
+}
+
+int getSnapshotWife(const GEDCOMsnapshot* snapshot, int family) {
+    const SnapshotFamily* record = snapshotFamily(snapshot, family);
+    return record && record->wife >= 0 && (uint32_t)record->wife < snapshot->individualCount ? record->wife : -1;
+}
+
+int getSnapshotChildCount(const GEDCOMsnapshot* snapshot, int family) {
+    const SnapshotFamily* record = snapshotFamily(snapshot, family);
+    return record && snapshotSpanIsValid(record->children, snapshot->linkCount) ? (int)record->children.count : 0;
+}
+
+int getSnapshotChild(const GEDCOMsnapshot* snapshot, int family, int n) {
+    const SnapshotFamily* record = snapshotFamily(snapshot, family);
+    return record ? snapshotLink(snapshot, record->children, n, snapshot->individualCount) : -1;
+}
+
+SnapshotSpan snapshotEventSpan(const GEDCOMsnapshot* snapshot, int record, bool isFamily) {
+    SnapshotSpan none = { 0, 0 };
+    if (isFamily) {
+        const SnapshotFamily* family = snapshotFamily(snapshot, record);
+        return family && snapshotSpanIsValid(family->events, snapshot->eventCount) ? family->events : none;
+    }
+    const SnapshotIndividual* person = snapshotIndividual(snapshot, record);
+    return person && snapshotSpanIsValid(person->events, snapshot->eventCount) ? person->events : none;
+}
+
+int getSnapshotEventCount(const GEDCOMsnapshot* snapshot, int record, bool isFamily) {
+    return (int)snapshotEventSpan(snapshot, record, isFamily).count;
+}
+
+bool getSnapshotEvent(const GEDCOMsnapshot* snapshot, int record, bool isFamily, int n,
+                      const char** type, const char** date, const char** place) {
+    SnapshotSpan span = snapshotEventSpan(snapshot, record, isFamily);
+    if (n < 0 || (uint32_t)n >= span.count) {
+        return false;
+    }
+    const SnapshotEvent* event = snapshot->events + span.first + n;
+    *type = snapshotString(snapshot, event->type);
+    *date = snapshotString(snapshot, event->date);
+    *place = snapshotString(snapshot, event->place);
+    return *type != NULL;
+}
+
+//// converting a snapshot back to a GEDCOMobject
+
+char* copySnapshotString(const GEDCOMsnapshot* snapshot, uint32_t offset) {
+    const char* str = snapshotString(snapshot, offset);
+    if (!str) {
+        return NULL;
+    }
+    size_t len = strlen(str) + 1;
+    char* res = malloc(len);
+    memcpy(res, str, len);
+    return res;
+}
+
+void copySnapshotFields(const GEDCOMsnapshot* snapshot, SnapshotSpan span, List* target) {
+    if (!snapshotSpanIsValid(span, snapshot->fieldCount)) {
+        return;
+    }
+    for (uint32_t i = span.first; i < span.first + span.count; i++) {
+        char* tag = copySnapshotString(snapshot, snapshot->fields[i].tag);
+        char* value = copySnapshotString(snapshot, snapshot->fields[i].value);
+        if (!tag || !value) {
+            free(tag);
+            free(value);
+            continue;
+        }
+        Field* field = malloc(sizeof(Field));
+        field->tag = tag;
+        field->value = value;
+        insertBack(target, field);
+    }
+}
+
+void copySnapshotEvents(const GEDCOMsnapshot* snapshot, SnapshotSpan span, List* target) {
+    if (!snapshotSpanIsValid(span, snapshot->eventCount)) {
+        return;
+    }
+    for (uint32_t i = span.first; i < span.first + span.count; i++) {
+        const SnapshotEvent* record = snapshot->events + i;
+        const char* type = snapshotString(snapshot, record->type);
+        if (!type) {
+            continue;
+        }
+        Event* event = malloc(sizeof(Event));
+        memset(event, 0, sizeof(Event));
+        strncpy(event->type, type, sizeof(event->type) - 1);
+        event->date = copySnapshotString(snapshot, record->date);
+        event->place = copySnapshotString(snapshot, record->place);
+        event->otherFields = initializeList(&printField, &deleteField, &compareFields);
+        copySnapshotFields(snapshot, record->fields, &event->otherFields);
+        insertBack(target, event);
+    }
+}
+
+GEDCOMobject* snapshotToGEDCOM(const GEDCOMsnapshot* snapshot) {
+    if (!snapshot) {
+        return NULL;
+    }
+    const SnapshotHeader* info = snapshot->header;
+    GEDCOMobject* obj = malloc(sizeof(GEDCOMobject));
+    initGEDCOMobject(obj);
+    HeaderWithSubmitterId* header = malloc(sizeof(HeaderWithSubmitterId));
+    header->submitterId[0] = '\0';
+    header->source = NULL;
+    initHeader(&header->header);
+    const char* source = snapshotString(snapshot, info->source);
+    strncpy(header->header.source, source ? source : "", sizeof(header->header.source) - 1);
+    header->header.source[sizeof(header->header.source) - 1] = '\0';
+    header->header.gedcVersion = info->gedcVersion;
+    header->header.encoding = (CharSet)info->encoding;
+    copySnapshotFields(snapshot, info->headerFields, &header->header.otherFields);
+    obj->header = &header->header;
+    if (info->hasSubmitter) {
+        const char* name = snapshotString(snapshot, info->submitterName);
+        const char* address = snapshotString(snapshot, info->submitterAddress);
+        address = address ? address : "";
+        obj->submitter = malloc(sizeof(Submitter) + strlen(address) + 1);
+        strncpy(obj->submitter->submitterName, name ? name : "", sizeof(obj->submitter->submitterName) - 1);
+        obj->submitter->submitterName[sizeof(obj->submitter->submitterName) - 1] = '\0';
+        strcpy(obj->submitter->address, address);
+        obj->submitter->otherFields = initializeList(&printField, &deleteField, &compareFields);
+        copySnapshotFields(snapshot, info->submitterFields, &obj->submitter->otherFields);
+        obj->header->submitter = obj->submitter;
+    }
+
+    int individualCount = getSnapshotIndividualCount(snapshot);
+    int familyCount = getSnapshotFamilyCount(snapshot);
+    IndividualWithId** people = malloc((individualCount + 1) * sizeof(IndividualWithId*));
+    FamilyWithIds** families = malloc((familyCount + 1) * sizeof(FamilyWithIds*));
+    for (int i = 0; i < individualCount; i++) {
+        const SnapshotIndividual* record = snapshot->individuals + i;
+        IndividualWithId* indi = malloc(sizeof(IndividualWithId));
+        indi->id[0] = '\0';
+        indi->listOfFamiliesIds = initializeList(&printId, &deleteId, &compareId);
+        indi->source.start = indi->source.end = -1;
+        indi->modified = false;
+        indi->individual.givenName = copySnapshotString(snapshot, record->givenName);
+        indi->individual.surname = copySnapshotString(snapshot, record->surname);
+        indi->individual.families = initializeList(&printFamily, &doNotDelete, &compareFamilies);
+        indi->individual.otherFields = initializeList(&printField, &deleteField, &compareFields);
+        indi->individual.events = initializeList(&printEvent, &deleteEvent, &compareEvents);
+        copySnapshotEvents(snapshot, record->events, &indi->individual.events);
+        copySnapshotFields(snapshot, record->fields, &indi->individual.otherFields);
+        insertBack(&obj->individuals, indi);
+        people[i] = indi;
+    }
+    for (int f = 0; f < familyCount; f++) {
+        const SnapshotFamily* record = snapshot->families + f;
+        FamilyWithIds* family = malloc(sizeof(FamilyWithIds));
+        family->id[0] = '\0';
+        family->husbandId = family->wifeId = NULL;
+        family->childrenIds = initializeList(&printId, &deleteId, &compareId);
+        family->source.start = family->source.end = -1;
+        family->modified = false;
+        int husband = getSnapshotHusband(snapshot, f);
+        int wife = getSnapshotWife(snapshot, f);
+        family->family.husband = husband >= 0 ? &people[husband]->individual : NULL;
+        family->family.wife = wife >= 0 ? &people[wife]->individual : NULL;
+        family->family.children = initializeList(&printIndividual, &doNotDelete, &compareIndividuals);
+        family->family.otherFields = initializeList(&printField, &deleteField, &compareFields);
+        family->family.events = initializeList(&printEvent, &deleteEvent, &compareEvents);
+        int childCount = getSnapshotChildCount(snapshot, f);
+        for (int n = 0; n < childCount; n++) {
+            int child = getSnapshotChild(snapshot, f, n);
+            if (child >= 0) {
+                insertBack(&family->family.children, people[child]);
+            }
+        }
+        copySnapshotEvents(snapshot, record->events, &family->family.events);
+        copySnapshotFields(snapshot, record->fields, &family->family.otherFields);
+        insertBack(&obj->families, family);
+        families[f] = family;
+    }
+    for (int i = 0; i < individualCount; i++) {
+        int count = getSnapshotPersonFamilyCount(snapshot, i);
+        for (int n = 0; n < count; n++) {
+            int f = getSnapshotPersonFamily(snapshot, i, n);
+            if (f >= 0) {
+                insertBack(&people[i]->individual.families, families[f]);
+            }
+        }
+    }
+    free(people);
+    free(families);
+    return obj;
 }
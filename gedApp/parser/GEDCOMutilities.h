@@ -146,19 +146,61 @@ typedef struct {
 //***************************************** GEDCOOM object functions *****************************************
 
 /** Function to create a GEDCOM object based on the contents of an GEDCOM file.
- *@pre File name cannot be an empty string or NULL.  File name must have the .ged extension.
+ *@pre File name cannot be an empty string or NULL.  File name must have the .ged extension, or .ged.gz for a
+ gzip-compressed file when the library is built with -DHAVE_ZLIB and linked with -lz; such files are decompressed on a
+ second thread while parsing.  Without that flag, which no build in this repository sets, .ged.gz names are INV_FILE.
  File represented by this name must exist and must be readable.
  *@post Either:
  A valid GEDCOM has been created, its address was stored in the variable obj, and OK was returned
  or
  An error occurred, the GEDCOM was not created, all temporary memory was freed, obj was set to NULL, and the
  appropriate error code was returned
+ Records other than HEAD, SUBM, INDI and FAM are skipped up to the next level 0 line without reading their lines,
+ so errors inside them are not reported.
  *@return the error code indicating success or the error encountered when parsing the GEDCOM
  *@param fileName - a string containing the name of the GEDCOM file
  *@param a double pointer to a GEDCOMobject struct that needs to be allocated
  **/
 GEDCOMerror createGEDCOM(char* fileName, GEDCOMobject** obj);
 
+//What createGEDCOMwithOptions keeps of a file.  Everything that is left out is skipped without being copied.
+typedef struct {
+    //Individual and family records.  Links to records that are left out are dropped.
+    bool    individuals;
+    bool    families;
+
+    //Events of individuals and families, and their DATE, PLAC and other lines
+    bool    events;
+    bool    eventDates;
+    bool    eventPlaces;
+    bool    eventFields;
+
+    //otherFields of the header, submitter, individuals and families; if fieldTags is not NULL, only fields with
+    //one of its tags are kept.  fieldTags ends with NULL.
+    bool    otherFields;
+    const char* const* fieldTags;
+
+    //The ADDR line of the submitter and the lines below it
+    bool    submitterAddress;
+} ParseOptions;
+
+/** Function for setting options that keep everything, so that callers only change what they leave out
+ *@param options - a pointer to the options
+ **/
+void initParseOptions(ParseOptions* options);
+
+/** Function for creating a GEDCOMobject with only the parts of the file selected by options.  Lines that are left
+ *out are skipped with all the lines below them, and are not checked.  The header and the submitter are always read.
+ *The object is written by writeGEDCOM from its records, never by copying records from the file.
+ *@pre as for createGEDCOM
+ *@post as for createGEDCOM
+ *@return the error code indicating success or the error encountered when parsing the GEDCOM
+ *@param fileName - a string containing the name of the GEDCOM file
+ *@param obj - a double pointer to a GEDCOMobject struct that needs to be allocated
+ *@param options - what to keep; NULL keeps everything and checks every line, like createGEDCOM
+ **/
+GEDCOMerror createGEDCOMwithOptions(char* fileName, GEDCOMobject** obj, const ParseOptions* options);
+
 
 /** Function to create a string representation of a GEDCOMobject.
  *@pre GEDCOMobject object exists, is not null, and is valid
@@ -216,6 +258,13 @@ List getDescendants(const GEDCOMobject* familyRecord, const Individual* person);
 // ****************************** A2 functions ******************************
 
 /** Function to writing a GEDCOMobject into a file in GEDCOM format.
+ *If obj was parsed from a file that has not changed since, records that were not modified
+ *are copied from that file byte for byte and keep their xrefs; see markIndividualModified. The other lines then end
+ *like the lines of that file. fileName may be the file obj was parsed from: that file is then written under a
+ *temporary name next to it, with its mode and, where allowed, its owner, and replaces it when complete, which
+ *needs write access to its directory and ends any hard links to it. Symbolic links to it are kept.
+ *Any other file is truncated and written in place.
+ *A fileName ending in .gz is written gzip-compressed when the library is built with -DHAVE_ZLIB, and is INV_FILE otherwise.
  *@pre GEDCOMobject object exists, is not null, and is valid
  *@post GEDCOMobject has not been modified in any way, and a file representing the
  GEDCOMobject contents in GEDCOM format has been created
@@ -224,6 +273,18 @@ List getDescendants(const GEDCOMobject* familyRecord, const Individual* person);
  **/
 GEDCOMerror writeGEDCOM(char* fileName, const GEDCOMobject* obj);
 
+/** Function to write a GEDCOMobject like writeGEDCOM, with records formatted by several threads.
+ *Each thread formats a range of records into its own buffer, and the buffers are written in order at their offsets.
+ *The file is byte-identical to the one writeGEDCOM writes.
+ *@pre GEDCOMobject object exists, is not null, and is valid
+ *@post GEDCOMobject has not been modified in any way, and the file has been created
+ *@return the error code indicating success or the error encountered when writing
+ *@param fileName - name of the file to write
+ *@param obj - a pointer to a GEDCOMobject struct
+ *@param threads - number of threads to use; 0 or less uses one per processor
+ **/
+GEDCOMerror writeGEDCOMthreaded(char* fileName, const GEDCOMobject* obj, int threads);
+
 /** Function for validating an existing GEDCOM object
  *@pre GEDCOM object exists and is not null
  *@post GEDCOM object has not been modified in any way
@@ -284,6 +345,24 @@ GEDCOMobject* JSONtoGEDCOM(const char* str);
 **/
 void addIndividual(GEDCOMobject* obj, const Individual* toBeAdded);
 
+/** Function for flagging an Individual whose names, events or fields were changed after parsing,
+ *so writeGEDCOM formats it instead of copying its original lines. Changes to its list of families are detected without it.
+ *@pre person is an Individual of a GEDCOMobject
+ *@post person will be formatted by writeGEDCOM
+ *@return void
+ *@param person - a pointer to an Individual struct
+**/
+void markIndividualModified(Individual* person);
+
+/** Function for flagging a Family whose events or fields were changed after parsing,
+ *so writeGEDCOM formats it instead of copying its original lines. Changes to its members are detected without it.
+ *@pre family is a Family of a GEDCOMobject
+ *@post family will be formatted by writeGEDCOM
+ *@return void
+ *@param family - a pointer to a Family struct
+**/
+void markFamilyModified(Family* family);
+
 /** Function for converting a list of Individual structs into a JSON string
  *@pre List exists, is not null, and has been initialized
  *@post List has not been modified in any way, and a JSON string has been created
@@ -300,6 +379,519 @@ char* iListToJSON(List iList);
  **/
 char* gListToJSON(List gList);
 
+/** Function for converting a whole GEDCOMobject into a JSON string: header, submitter, and every
+ *  individual and family with their events and fields.  Records refer to each other by their
+ *  position in the "individuals" and "families" arrays; a missing husband or wife is null.
+ *@pre GEDCOMobject exists, is not null, and has a header
+ *@post GEDCOMobject has not been modified in any way, and a JSON string has been created
+ *@return newly allocated JSON string.  An empty string if obj is NULL.
+ *@param obj - a pointer to a GEDCOMobject struct
+ **/
+char* GEDCOMtoJSON(const GEDCOMobject* obj);
+
+/** Function for writing the same JSON as GEDCOMtoJSON straight to an open stream, without
+ *  building the whole string in memory
+ *@pre file is open for writing
+ *@post anything buffered in file has been flushed, followed by the JSON text
+ *@return the error code indicating success or the error encountered when writing the JSON
+ *@param file - the stream to write to
+ *@param obj - a pointer to a GEDCOMobject struct
+ **/
+GEDCOMerror writeGEDCOMJSON(FILE* file, const GEDCOMobject* obj);
+
+/** Function for exporting a GEDCOMobject as newline-delimited JSON: one object per individual,
+ *  then one per family, each on its own line.  Every object has a "type" ("INDI" or "FAM") and
+ *  the "xref" writeGEDCOM would give the record: the one in the source file while that file is unchanged
+ *  (not for compressed files or parses with ParseOptions), otherwise its number in the lists, as in @I1@.
+ *  Links are written as xrefs of the linked records.
+ *  Output is buffered in fixed-size chunks, so memory use does not grow with the output.
+ *@pre fd is open for writing
+ *@post GEDCOMobject has not been modified in any way, and the records have been written to fd.
+ *      fd is not closed.
+ *@return the error code indicating success or the error encountered when writing
+ *@param fd - the file descriptor to write to
+ *@param obj - a pointer to a GEDCOMobject struct
+ **/
+GEDCOMerror writeGEDCOMNDJSON(int fd, const GEDCOMobject* obj);
+
+/** Function for writing the same lines as writeGEDCOMNDJSON into several files in parallel.
+ *  Records are split into contiguous ranges of the same size, written to <prefix>.0.ndjson,
+ *  <prefix>.1.ndjson and so on; concatenated in order, the files hold the writeGEDCOMNDJSON output.
+ *@pre shards is between 1 and 4096
+ *@post GEDCOMobject has not been modified in any way, and the files have been created
+ *@return the error code indicating success or the error encountered when writing a file
+ *@param prefix - the path the shard file names start with
+ *@param obj - a pointer to a GEDCOMobject struct
+ *@param shards - the number of files to write
+ **/
+GEDCOMerror writeGEDCOMNDJSONshards(const char* prefix, const GEDCOMobject* obj, int shards);
+
+/** Function for writing the row of the gedApp file table for a GEDCOMobject, as LOAD DATA INFILE
+ *  reads it by default: tab separated, backslash escaped, NULL as \N.  The columns are
+ *  file_id, file_Name, source, version, encoding, sub_name, sub_addr, num_individials, num_families.
+ *@pre fd is open for writing
+ *@post GEDCOMobject has not been modified in any way, and the row has been written to fd
+ *@return the error code indicating success or the error encountered when writing
+ *@param fd - the file descriptor to write to
+ *@param obj - a pointer to a GEDCOMobject struct
+ *@param fileName - the name stored in file_Name
+ *@param fileId - the file_id of the row, referenced by the individual rows
+ **/
+GEDCOMerror writeGEDCOMfileTSV(int fd, const GEDCOMobject* obj, const char* fileName, int fileId);
+
+/** Function for writing the rows of the gedApp individual table for a GEDCOMobject, in the same format
+ *  as writeGEDCOMfileTSV.  The columns are surname, given_name, sex, fam_size, source_file, so ind_id
+ *  is left out of the column list of the LOAD DATA statement.  fam_size is the number of distinct
+ *  people in all the families the individual belongs to, the individual included (0 without families).
+ *@pre fd is open for writing
+ *@post GEDCOMobject has not been modified in any way, and the rows have been written to fd
+ *@return the error code indicating success or the error encountered when writing
+ *@param fd - the file descriptor to write to
+ *@param obj - a pointer to a GEDCOMobject struct
+ *@param fileId - the file_id written to source_file
+ **/
+GEDCOMerror writeGEDCOMindividualsTSV(int fd, const GEDCOMobject* obj, int fileId);
+
+
+// ****************************** Relationship functions ******************************
+
+//How the first person relates to the second one
+typedef enum relType {REL_NONE, REL_SELF, REL_ANCESTOR, REL_DESCENDANT, REL_SIBLING, REL_AUNT_UNCLE, REL_NIECE_NEPHEW, REL_COUSIN} RelationshipType;
+
+//Result of a relationship query
+typedef struct {
+    //REL_ANCESTOR means the first person is an ancestor of the second one, etc.
+    RelationshipType type;
+
+    //Generations from each person up to the nearest common ancestors.  -1 if the people are not related.
+    int generationsFromFirst;
+    int generationsFromSecond;
+
+    //Cousin degree (1 for first cousins) and removal, e.g. first cousins once removed.  Only meaningful for collateral relatives.
+    int degree;
+    int removal;
+
+    //Nearest common ancestors.  All objects in the list will be of type Individual, and are references into the GEDCOMobject.
+    List commonAncestors;
+
+    //Chain of people from the first person up to a common ancestor and down to the second person.  References, like above.
+    List path;
+
+} Relationship;
+
+/** Function for finding how two people are related through their nearest common ancestors
+ *@pre GEDCOM object exists, is not null, and is valid
+ *@post GEDCOM object has not been modified in any way.  The lists in the result must be released with clearRelationship.
+ *@return the relationship.  Type is REL_NONE if no common ancestor was found within maxGen generations.
+ *@param familyRecord - a pointer to a GEDCOMobject struct
+ *@param first - the first person
+ *@param second - the second person
+ *@param maxGen - maximum number of generations to go up from each person (values <= 0 mean no limit)
+ **/
+Relationship getRelationship(const GEDCOMobject* familyRecord, const Individual* first, const Individual* second, int maxGen);
+
+/** Function for releasing the lists of a relationship returned by getRelationship
+ *@param rel - a pointer to a Relationship struct
+ **/
+void clearRelationship(Relationship* rel);
+
+
+// ****************************** Whole tree analytics ******************************
+
+//Per-person statistics computed by getTreeStats
+typedef struct {
+    //Number of distinct descendants and ancestors.  Approximate for large sets if requested.
+    unsigned int descendants;
+    unsigned int ancestors;
+
+    //Longest chain of known ancestors above this person (0 for people without parents)
+    int generation;
+
+    //Number of distinct children over all families where this person is a spouse
+    unsigned int children;
+
+} IndividualStats;
+
+/** Function for computing descendant/ancestor counts, generation depth and number of children for every individual at once
+ *@pre GEDCOM object exists, is not null, and is valid
+ *@post GEDCOM object has not been modified in any way
+ *@return newly allocated array with one entry per individual, in the order of the individuals list.  NULL if there are no individuals,
+ *or if someone is their own ancestor (the pedigree cycle validateGEDCOM reports as INV_RECORD), since the counts would not be defined.
+ *@param obj - a pointer to a GEDCOMobject struct
+ *@param approximate - if true, sets larger than 1024 people are counted with HyperLogLog sketches: about 1.6% standard
+ *error, so single counts can be off by about 5%
+ **/
+IndividualStats* getTreeStats(const GEDCOMobject* obj, bool approximate);
+
+
+// ****************************** Record index and individual sets ******************************
+
+//Array view of a GEDCOMobject that numbers its records by position in the individuals and families lists.
+//It does not follow later changes to the object, so it must be recreated after the object is modified.
+typedef struct recordIndex RecordIndex;
+
+//Compressed set of individuals, stored as record numbers of a RecordIndex
+typedef struct individualSet IndividualSet;
+
+/** Function for creating a record index over a GEDCOMobject
+ *@pre GEDCOM object exists, is not null, and is valid
+ *@post GEDCOM object has not been modified in any way
+ *@return a newly allocated index.  Must be freed with deleteRecordIndex, and must not outlive the object.
+ *@param obj - a pointer to a GEDCOMobject struct
+ **/
+RecordIndex* createRecordIndex(const GEDCOMobject* obj);
+
+/** Function for freeing a record index
+ *@param index - a pointer to a RecordIndex, may be NULL
+ **/
+void deleteRecordIndex(RecordIndex* index);
+
+/** Function for collecting up to N generations of ancestors of an individual as a set
+ *@pre index exists and was created for the object the person belongs to
+ *@return a newly allocated set.  Contains the same people as all generations of getAncestorListN together.
+ *@param index - a pointer to a RecordIndex
+ *@param person - the Individual record whose ancestors we want
+ *@param maxGen - maximum number of generations to examine (values <= 0 mean no limit)
+ **/
+IndividualSet* getAncestorSet(const RecordIndex* index, const Individual* person, int maxGen);
+
+/** Function for collecting up to N generations of descendants of an individual as a set
+ *@pre index exists and was created for the object the person belongs to
+ *@return a newly allocated set.  Contains the same people as all generations of getDescendantListN together.
+ *@param index - a pointer to a RecordIndex
+ *@param person - the Individual record whose descendants we want
+ *@param maxGen - maximum number of generations to examine (0 means no limit)
+ **/
+IndividualSet* getDescendantSet(const RecordIndex* index, const Individual* person, unsigned int maxGen);
+
+/** Functions for combining two sets built over the same index: a AND b, a OR b, a AND NOT b
+ *@pre both sets exist
+ *@post neither set has been modified
+ *@return a newly allocated set
+ **/
+IndividualSet* intersectSets(const IndividualSet* a, const IndividualSet* b);
+IndividualSet* unionSets(const IndividualSet* a, const IndividualSet* b);
+IndividualSet* subtractSets(const IndividualSet* a, const IndividualSet* b);
+
+/** Function returning the number of individuals in a set
+ *@param set - a pointer to an IndividualSet
+ **/
+int getSetSize(const IndividualSet* set);
+
+/** Function for checking whether an individual is in a set
+ *@return true if the person is in the set
+ *@param index - the index the set was built over
+ *@param set - a pointer to an IndividualSet
+ *@param person - the Individual record to look for
+ **/
+bool setContains(const RecordIndex* index, const IndividualSet* set, const Individual* person);
+
+/** Function for converting a set back to a list
+ *@return a list of references to the Individual records of the object, in record order.  Freeing the list does not affect the object.
+ *@param index - the index the set was built over
+ *@param set - a pointer to an IndividualSet
+ **/
+List setToList(const RecordIndex* index, const IndividualSet* set);
+
+/** Function for freeing a set
+ *@param set - a pointer to an IndividualSet, may be NULL
+ **/
+void deleteIndividualSet(IndividualSet* set);
+
+
+// ****************************** Batched traversal ******************************
+
+/** Function to run getDescendantListN for many individuals of the same GEDCOM at once
+ *@pre GEDCOM object exists, is not null, and is valid
+ *@post GEDCOM object has not been modified in any way
+ *@return newly allocated array of count lists.  Entry i has the same generations, in the same order, as
+ *getDescendantListN(familyRecord, people[i], maxGen).  The generation lists hold references to the object's records,
+ *so clearing them does not affect the GEDCOM.  NULL if there is nothing to do.
+ *@param familyRecord - a pointer to a GEDCOMobject struct
+ *@param people - array of Individual records whose descendants we want; NULL entries give empty results
+ *@param count - number of entries in people
+ *@param maxGen - maximum number of generations to examine (must be >= 1)
+ **/
+List* getDescendantListsN(const GEDCOMobject* familyRecord, const Individual** people, int count, unsigned int maxGen);
+
+
+// ****************************** Streaming writer ******************************
+
+//Writer emitting GEDCOM records one at a time, without building a GEDCOMobject
+typedef struct gedcomWriter GEDCOMwriter;
+
+//Returns the xref number of an Individual or Family record (written as @I<n>@ or @F<n>@), or a number <= 0 to leave out links to it
+typedef int (*XrefResolver)(const void* record, void* context);
+
+/** Function for opening a streaming writer.  Records are formatted as writeGEDCOM formats them and
+ *written out as soon as a buffer fills, so memory use does not grow with the size of the output.
+ *Records are numbered only by the resolvers, never by their address, so one struct may be refilled and
+ *written for every record.  To write a whole GEDCOMobject, use writeGEDCOM.
+ *@pre fileName is not NULL
+ *@post fileName has been created, or truncated, and is written in place like fopen(fileName, "w") would
+ *@return a newly allocated writer, or NULL if a resolver is NULL or the file can not be opened.  Must be finished
+ *with closeGEDCOMwriter.
+ *@param fileName - name of the file to write
+ *@param individualXref - resolver numbering Individual records; must not be NULL
+ *@param familyXref - resolver numbering Family records; must not be NULL
+ *@param context - passed to both resolvers
+ **/
+GEDCOMwriter* openGEDCOMwriter(const char* fileName, XrefResolver individualXref, XrefResolver familyXref, void* context);
+
+/** Functions for writing one record.  The header must be written first, and only once; it refers to the submitter as @U1@.
+ *@pre writer was opened with openGEDCOMwriter
+ *@post the record has been formatted into the output
+ *@return OK, OTHER_ERROR if writer or the record is NULL, INV_HEADER if a record is written before the header or the
+ *header is written again, INV_RECORD if the resolver gives the record no xref, or WRITE_ERROR if the output could not
+ *be written
+ **/
+GEDCOMerror writeHeaderRecord(GEDCOMwriter* writer, const Header* header);
+GEDCOMerror writeSubmitterRecord(GEDCOMwriter* writer, const Submitter* submitter);
+GEDCOMerror writeIndividualRecord(GEDCOMwriter* writer, const Individual* person);
+GEDCOMerror writeFamilyRecord(GEDCOMwriter* writer, const Family* family);
+
+/** Function for finishing a streaming writer: writes the trailer, closes the file and frees the writer
+ *@return OK, OTHER_ERROR if writer is NULL, or WRITE_ERROR if any part of the output could not be written
+ *@param writer - a pointer to a GEDCOMwriter
+ **/
+GEDCOMerror closeGEDCOMwriter(GEDCOMwriter* writer);
+
+
+// ****************************** Binary snapshot ******************************
+
+//Read-only GEDCOM data mapped from a snapshot file.  Individuals and families are numbered from 0 in the order of the object's lists.
+typedef struct gedcomSnapshot GEDCOMsnapshot;
+
+/** Function for saving a GEDCOMobject as a binary snapshot that can be loaded without parsing.
+ *The file holds record arrays, a table of distinct strings, and indices in place of pointers.  It is written under a
+ *temporary name and renamed, so snapshots already loaded from the old file are not affected.
+ *@pre GEDCOMobject object exists, is not null, and is valid
+ *@post GEDCOMobject has not been modified in any way
+ *@return OK, INV_FILE if the file can not be created, or WRITE_ERROR
+ *@param fileName - name of the snapshot file
+ *@param obj - a pointer to a GEDCOMobject struct
+ **/
+GEDCOMerror saveSnapshot(const char* fileName, const GEDCOMobject* obj);
+
+/** Function for mapping a snapshot file into memory.  Only the header is checked, so loading takes the same time
+ *for any file size; the accessors below read the mapped records directly and check every index they follow.
+ *@pre fileName is not NULL
+ *@post on success *snapshot must be freed with closeSnapshot; otherwise it is NULL
+ *@return OK, INV_FILE if the file can not be read, or INV_GEDCOM if it is not a snapshot of this version
+ *@param fileName - name of the snapshot file
+ *@param snapshot - set to the loaded snapshot
+ **/
+GEDCOMerror loadSnapshot(const char* fileName, GEDCOMsnapshot** snapshot);
+
+/** Function for unmapping a snapshot.  Strings returned by the accessors become invalid.
+ *@param snapshot - a pointer to a GEDCOMsnapshot, may be NULL
+ **/
+void closeSnapshot(GEDCOMsnapshot* snapshot);
+
+/** Functions for reading a loaded snapshot.  Strings point into the mapped file.  Record numbers out of range give
+ *NULL, 0 or -1.
+ **/
+int getSnapshotIndividualCount(const GEDCOMsnapshot* snapshot);
+int getSnapshotFamilyCount(const GEDCOMsnapshot* snapshot);
+const char* getSnapshotGivenName(const GEDCOMsnapshot* snapshot, int person);
+const char* getSnapshotSurname(const GEDCOMsnapshot* snapshot, int person);
+int getSnapshotPersonFamilyCount(const GEDCOMsnapshot* snapshot, int person);
+int getSnapshotPersonFamily(const GEDCOMsnapshot* snapshot, int person, int n);
+int getSnapshotHusband(const GEDCOMsnapshot* snapshot, int family);
+int getSnapshotWife(const GEDCOMsnapshot* snapshot, int family);
+int getSnapshotChildCount(const GEDCOMsnapshot* snapshot, int family);
+int getSnapshotChild(const GEDCOMsnapshot* snapshot, int family, int n);
+int getSnapshotEventCount(const GEDCOMsnapshot* snapshot, int record, bool isFamily);
+bool getSnapshotEvent(const GEDCOMsnapshot* snapshot, int record, bool isFamily, int n,
+                      const char** type, const char** date, const char** place);
+
+/** Function for building a GEDCOMobject with the contents of a snapshot, for code that works on GEDCOMobject
+ *@pre snapshot was loaded with loadSnapshot
+ *@post snapshot has not been modified
+ *@return a newly allocated GEDCOMobject that must be freed with deleteGEDCOM, or NULL
+ *@param snapshot - a pointer to a GEDCOMsnapshot
+ **/
+GEDCOMobject* snapshotToGEDCOM(const GEDCOMsnapshot* snapshot);
+
+
+// ****************************** String builder ******************************
+
+//Growing text buffer.  str is always NUL-terminated and owned by the builder until takeBuilderString.
+typedef struct {
+    char*   str;
+
+    //Length of the text, not counting the terminator
+    size_t  length;
+
+    //Room for text in str, not counting the terminator
+    size_t  allocated;
+} StringBuilder;
+
+/** Function for initializing an empty builder
+ *@post builder holds "" and must be freed with deleteStringBuilder or takeBuilderString
+ *@param builder - a pointer to the builder
+ *@param capacity - room to allocate up front; 0 for a small default
+ **/
+void initStringBuilder(StringBuilder* builder, size_t capacity);
+
+/** Function for freeing the text of a builder
+ *@param builder - a pointer to the builder
+ **/
+void deleteStringBuilder(StringBuilder* builder);
+
+/** Function for making room for extra more bytes, so that many appends reallocate at most once.
+ *The buffer grows by doubling, so building a string of n bytes copies O(n) bytes in total.
+ *@param builder - a pointer to the builder
+ *@param extra - number of bytes about to be appended
+ **/
+void reserveStringBuilder(StringBuilder* builder, size_t extra);
+
+/** Functions for appending raw bytes, a C string, a character, a decimal integer, or a number with a fixed
+ *number of decimals (like "%.*f", rounded half away from zero).  Integers and floats are formatted without printf.
+ **/
+void appendToBuilder(StringBuilder* builder, const char* data, size_t len);
+void appendStringToBuilder(StringBuilder* builder, const char* str);
+void appendCharToBuilder(StringBuilder* builder, char c);
+void appendIntToBuilder(StringBuilder* builder, long long value);
+void appendFloatToBuilder(StringBuilder* builder, double value, int decimals);
+
+/** Function for appending printf-formatted text
+ *@return the number of characters appended, or a negative value on a formatting error
+ *@param builder - a pointer to the builder
+ *@param format - printf format string
+ **/
+int sprintfBuilder(StringBuilder* builder, const char* format, ...);
+
+/** Function for handing the text to the caller
+ *@post builder is empty and must be initialized again before reuse
+ *@return the text, to be freed by the caller
+ *@param builder - a pointer to the builder
+ **/
+char* takeBuilderString(StringBuilder* builder);
+
+/** Functions for appending the text the print functions return (printField, printEvent, printIndividual,
+ *printFamily and printGEDCOM) to a caller-owned builder.  The print functions are wrappers around them;
+ *appending many records to one builder does not allocate anything per record.
+ *@pre the record exists and is not NULL
+ *@post the record has not been modified in any way
+ **/
+void appendField(StringBuilder* builder, const Field* field);
+void appendEvent(StringBuilder* builder, const Event* event);
+void appendIndividual(StringBuilder* builder, const Individual* individual);
+void appendFamily(StringBuilder* builder, const Family* family);
+void appendSubmitter(StringBuilder* builder, const Submitter* submitter);
+void appendGEDCOM(StringBuilder* builder, const GEDCOMobject* obj);
+
+/** Function for writing the text of printGEDCOM to a file record by record, without building it in memory
+ *@pre GEDCOMobject object exists, is not null, and is valid; fd is open for writing
+ *@post GEDCOMobject has not been modified in any way; fd is not closed
+ *@return the error code indicating success or the error encountered when writing
+ *@param fd - the file descriptor to write to
+ *@param obj - a pointer to a GEDCOMobject struct
+ **/
+GEDCOMerror printGEDCOMToFd(int fd, const GEDCOMobject* obj);
+
+/** Function for writing the text of printGEDCOM to an open stream.  Whatever is buffered in the stream is
+ *flushed first, and the text is written to its file descriptor.
+ *@return the error code indicating success or the error encountered when writing
+ *@param file - the stream to write to
+ *@param obj - a pointer to a GEDCOMobject struct
+ **/
+GEDCOMerror printGEDCOMToFile(FILE* file, const GEDCOMobject* obj);
+
+/** Function for one page of the printGEDCOM text: the header and individuals offset to offset + limit - 1.
+ *Families are not included.
+ *@pre GEDCOMobject object exists, is not null, and is valid
+ *@post GEDCOMobject has not been modified in any way
+ *@return a newly allocated string, or NULL if obj is NULL or offset is negative
+ *@param obj - a pointer to a GEDCOMobject struct
+ *@param offset - position of the first individual on the page
+ *@param limit - maximum number of individuals on the page
+ **/
+char* printGEDCOMPage(const GEDCOMobject* obj, int offset, int limit);
+
+
+// ****************************** Quick scan ******************************
+
+//What the file list shows about a GEDCOM file, read without building a GEDCOMobject
+typedef struct {
+    char    source[249];
+    float   gedcVersion;
+    CharSet encoding;
+    char    submitterName[61];
+
+    //Submitter address in the form of Submitter.address, cut to fit
+    char    submitterAddress[256];
+
+    int     individualCount;
+    int     familyCount;
+} GEDCOMsummary;
+
+/** Function for reading the header, the submitter and the number of individuals and families of a GEDCOM file
+ *(.ged, or .ged.gz when built with -DHAVE_ZLIB as for createGEDCOM) without parsing the other records.  Only the first line of each record other than HEAD and SUBM
+ *is read; their bodies are skipped with a vectorized search for the next level 0 line, and are not validated.
+ *@pre fileName is not NULL
+ *@post summary is filled in if the result is OK
+ *@return the same error codes as createGEDCOM, except that line numbers are always -1
+ *@param fileName - name of the GEDCOM file
+ *@param summary - the summary to fill in
+ **/
+GEDCOMerror probeGEDCOM(const char* fileName, GEDCOMsummary* summary);
+
+/** Function for converting a summary to a JSON object with the keys source, gedcVersion, encoding, submitterName,
+ *submitterAddress, individualCount and familyCount
+ *@return a newly allocated string; "" if summary is NULL
+ *@param summary - a pointer to a GEDCOMsummary
+ **/
+char* summaryToJSON(const GEDCOMsummary* summary);
+
+
+// ****************************** Lazy loading ******************************
+
+//A GEDCOM file opened with an index of its records.  Records are parsed on first access and kept until the file is deleted.
+typedef struct gedcomLazy GEDCOMlazy;
+
+/** Function for opening a GEDCOM file without parsing its individuals and families.  The file is mapped into memory
+ *and read once to find the level 0 line and the links of every record and to parse the header and the submitter,
+ *with the same checks as createGEDCOM.  Record bodies are checked when the record is first accessed.  Compressed
+ *files are not supported, since records are read by their offset in the file.
+ *The record offsets, the xref hash table and the links between records are saved next to the file as an index
+ *(fileName + "idx", e.g. tree.gedidx).  Later calls only map the index and parse the header and the submitter,
+ *as long as the size, modification time and a hash of sampled parts of the file are unchanged; otherwise the
+ *index is built and saved again.  If the index can not be written, the file is still opened.
+ *@pre fileName is a .ged file
+ *@post on success *lazy must be freed with deleteLazyGEDCOM; otherwise it is NULL
+ *@return the same error codes as createGEDCOM, except that line numbers are always -1
+ *@param fileName - name of the GEDCOM file
+ *@param lazy - set to the opened file
+ **/
+GEDCOMerror createLazyGEDCOM(char* fileName, GEDCOMlazy** lazy);
+
+/** Function for freeing a lazily opened file and every record parsed from it
+ *@param lazy - a pointer to a GEDCOMlazy, may be NULL
+ **/
+void deleteLazyGEDCOM(GEDCOMlazy* lazy);
+
+/** Functions for the header (with its submitter) and the number of individuals and families of a lazily opened file
+ **/
+const Header* getLazyHeader(const GEDCOMlazy* lazy);
+int getLazyIndividualCount(const GEDCOMlazy* lazy);
+int getLazyFamilyCount(const GEDCOMlazy* lazy);
+
+/** Functions for finding a record by its xref (e.g. "@I1@") or by its position among the records of its type in the
+ *file.  The record is parsed on first access and its links are filled in: the families of an individual, and the
+ *husband, wife and children of a family.  Records reached through these links are parsed but their own links may
+ *still be empty; pass them to linkLazyIndividual or linkLazyFamily before following them further.
+ *Records are owned by lazy.  These functions are not thread safe.
+ *@return the record, or NULL if there is none or the record or one of its links is invalid
+ **/
+Individual* getLazyIndividual(GEDCOMlazy* lazy, const char* xref);
+Family* getLazyFamily(GEDCOMlazy* lazy, const char* xref);
+Individual* getLazyIndividualAt(GEDCOMlazy* lazy, int n);
+Family* getLazyFamilyAt(GEDCOMlazy* lazy, int n);
+Individual* linkLazyIndividual(GEDCOMlazy* lazy, Individual* individual);
+Family* linkLazyFamily(GEDCOMlazy* lazy, Family* family);
+
 
 //****************************************** List helper functions added for A2 *******************************************
 void deleteGeneration(void* toBeDeleted);
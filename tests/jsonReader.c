@@ -0,0 +1,170 @@
+// Checks for the JSON reader behind JSONtoInd and JSONtoGEDCOM.
+// Build and run from the repository root:
+//   gcc -std=gnu11 -I. tests/jsonReader.c GEDCOMutilities.c LinkedListAPI.c -lpthread -o jsonReader
+//   ./jsonReader gedApp/uploads/*.ged
+// Prints each failed check and exits with 1 if there was one.
+
+#include "GEDCOMutilities.h"
+#include "LinkedListAPI.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+int failures = 0;
+
+void fail(const char* name, const char* check) {
+    printf("FAIL %s: %s\n", name, check);
+    failures++;
+}
+
+// GEDCOMtoJSON -> JSONtoGEDCOM -> GEDCOMtoJSON gives the same text, and every truncation of it is rejected
+void checkRoundTrip(const char* fileName) {
+    GEDCOMobject* obj = NULL;
+    if (createGEDCOM((char*)fileName, &obj).type != OK) {
+        fail(fileName, "does not parse");
+        return;
+    }
+    char* json = GEDCOMtoJSON(obj);
+    deleteGEDCOM(obj);
+
+    GEDCOMobject* read = JSONtoGEDCOM(json);
+    if (!read) {
+        fail(fileName, "JSONtoGEDCOM rejects the GEDCOMtoJSON text");
+    } else {
+        char* again = GEDCOMtoJSON(read);
+        if (strcmp(json, again)) {
+            fail(fileName, "GEDCOMtoJSON of the read object differs");
+        }
+        free(again);
+        deleteGEDCOM(read);
+    }
+
+    size_t length = strlen(json);
+    char* prefix = malloc(length + 1);
+    for (size_t i = 0; i < length; i++) {
+        memcpy(prefix, json, i);
+        prefix[i] = '\0';
+        read = JSONtoGEDCOM(prefix);
+        if (read) {
+            char check[64];
+            snprintf(check, sizeof(check), "accepts the text cut after %zu bytes", i);
+            fail(fileName, check);
+            deleteGEDCOM(read);
+            break;
+        }
+    }
+    free(prefix);
+    free(json);
+}
+
+// JSONtoInd reads the given name as expected
+void checkName(const char* json, const char* expected) {
+    Individual* person = JSONtoInd(json);
+    if (!person || strcmp(person->givenName, expected)) {
+        fail(json, "given name read wrongly");
+    }
+    if (person) {
+        deleteIndividual(person);
+    }
+}
+
+void checkIndRejected(const char* json) {
+    Individual* person = JSONtoInd(json);
+    if (person) {
+        fail(json, "JSONtoInd accepts it");
+        deleteIndividual(person);
+    }
+}
+
+void checkGEDCOMrejected(const char* json) {
+    GEDCOMobject* obj = JSONtoGEDCOM(json);
+    if (obj) {
+        fail(json, "JSONtoGEDCOM accepts it");
+        deleteGEDCOM(obj);
+    }
+}
+
+// a GEDCOMtoJSON document with one individual and one family, where the family has the given members
+char* familyJson(const char* familyMembers) {
+    const char* format = "{\"header\":{\"source\":\"PAF\",\"gedcVersion\":5.5,\"encoding\":\"ASCII\",\"fields\":[]},"
+        "\"submitter\":{\"name\":\"Submitter\",\"address\":\"\",\"fields\":[]},"
+        "\"individuals\":[{\"givenName\":\"A\",\"surname\":\"B\",\"events\":[],\"fields\":[],\"families\":[0]}],"
+        "\"families\":[{%s,\"events\":[],\"fields\":[]}]}";
+    char* json = malloc(strlen(format) + strlen(familyMembers) + 1);
+    sprintf(json, format, familyMembers);
+    return json;
+}
+
+void checkFamily(const char* familyMembers, bool valid) {
+    char* json = familyJson(familyMembers);
+    GEDCOMobject* obj = JSONtoGEDCOM(json);
+    if (!obj != !valid) {
+        fail(familyMembers, valid ? "JSONtoGEDCOM rejects it" : "JSONtoGEDCOM accepts it");
+    }
+    if (obj) {
+        deleteGEDCOM(obj);
+    }
+    free(json);
+}
+
+// an individual with an unknown member holding depth nested arrays
+char* nestedJson(int depth) {
+    char* json = malloc(2 * depth + 64);
+    char* pos = json + sprintf(json, "{\"givenName\":\"A\",\"x\":");
+    memset(pos, '[', depth);
+    memset(pos + depth, ']', depth);
+    strcpy(pos + 2 * depth, "}");
+    return json;
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        checkRoundTrip(argv[i]);
+    }
+
+    // escapes, with \u escapes and surrogate pairs decoded to UTF-8
+    checkName("{\"givenName\":\"a\\\"b\\\\c\\/d\\b\\f\\n\\r\\te\"}", "a\"b\\c/d\b\f\n\r\te");
+    checkName("{\"givenName\":\"\\u0041\\u00e9\\u20AC\"}", "A\xc3\xa9\xe2\x82\xac");
+    checkName("{\"givenName\":\"\\ud83d\\ude00\"}", "\xf0\x9f\x98\x80");
+    checkName(" { \"surname\" : \"B\" , \"givenName\" : \"A\" , \"other\" : [1, {\"x\": null}] } ", "A");
+
+    // malformed input
+    checkIndRejected("{\"givenName\":\"A\"");
+    checkIndRejected("{\"givenName\":\"A");
+    checkIndRejected("{\"givenName\":\"\\u12G4\"}");
+    checkIndRejected("{\"givenName\":\"\\u12\"}");
+    checkIndRejected("{\"givenName\":\"\\x\"}");
+    checkIndRejected("{\"givenName\":\"\\ud83d\"}");
+    checkIndRejected("{\"givenName\":\"\\ud83dx\"}");
+    checkIndRejected("{\"givenName\":\"\\ud83d\\u0041\"}");
+    checkIndRejected("{\"givenName\":\"\\ude00\"}");
+    checkIndRejected("{\"givenName\":\"a\\u0000b\"}");
+    checkIndRejected("{\"givenName\":\"A\"} x");
+    checkIndRejected("{\"givenName\":\"A\"}}");
+    checkIndRejected("{\"givenName\":\"a\x01" "b\"}");
+    checkIndRejected("{\"givenName\":\"a\nb\"}");
+    checkGEDCOMrejected("{\"individuals\":[],\"families\":[]} []");
+
+    // links are positions in the arrays
+    checkFamily("\"husband\":0,\"wife\":null,\"children\":[]", true);
+    checkFamily("\"husband\":1,\"wife\":null,\"children\":[]", false);
+    checkFamily("\"husband\":-1,\"wife\":null,\"children\":[]", false);
+    checkFamily("\"husband\":0.5,\"wife\":null,\"children\":[]", false);
+    checkFamily("\"husband\":null,\"wife\":null,\"children\":[7]", false);
+    checkFamily("\"husband\":null,\"wife\":null,\"children\":[1e0]", false);
+
+    // nesting is limited to 64 levels
+    char* json = nestedJson(32);
+    checkName(json, "A");
+    free(json);
+    json = nestedJson(100);
+    checkIndRejected(json);
+    free(json);
+    json = nestedJson(100000);
+    checkIndRejected(json);
+    free(json);
+
+    printf("%s: %d failed\n", failures ? "FAILED" : "OK", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,195 @@
+// Checks that the sidecar index of createLazyGEDCOM is reused only for the file it was made for.
+// Build and run from the repository root:
+//   gcc -std=gnu11 -I. tests/lazyIndex.c GEDCOMutilities.c LinkedListAPI.c -lpthread -o lazyIndex
+//   ./lazyIndex
+// Prints each failed check and exits with 1 if there was one.
+
+#include "GEDCOMutilities.h"
+#include "LinkedListAPI.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define COUPLES 40
+// offset of the section table in the index header
+#define INDEX_SECTIONS_OFFSET 64
+
+int failures = 0;
+
+void fail(const char* step, const char* check) {
+    printf("FAIL %s: %s\n", step, check);
+    failures++;
+}
+
+// given name of individual n (1-based): every other one is long, starting with the first unless flipped,
+// so flipping moves records without changing the size of the file
+void givenName(char* name, int n, bool flipped) {
+    sprintf(name, (n % 2 == 1) != flipped ? "Longname%d" : "S%d", n);
+}
+
+void writeFile(const char* fileName, bool flipped) {
+    FILE* file = fopen(fileName, "w");
+    if (!file) {
+        return;
+    }
+    char name[32];
+    fprintf(file, "0 HEAD\n1 SOUR PAF\n1 GEDC\n2 VERS 5.5\n1 CHAR ASCII\n1 SUBM @U1@\n");
+    for (int i = 1; i <= 2 * COUPLES; i++) {
+        givenName(name, i, flipped);
+        fprintf(file, "0 @I%d@ INDI\n1 NAME %s /Family%d/\n1 FAMS @F%d@\n", i, name, (i + 1) / 2, (i + 1) / 2);
+    }
+    for (int i = 1; i <= COUPLES; i++) {
+        fprintf(file, "0 @F%d@ FAM\n1 HUSB @I%d@\n1 WIFE @I%d@\n", i, 2 * i - 1, 2 * i);
+    }
+    fprintf(file, "0 @U1@ SUBM\n1 NAME Submitter\n0 TRLR\n");
+    fclose(file);
+}
+
+void setModified(const char* fileName, time_t seconds) {
+    struct timespec times[2] = { { seconds, 0 }, { seconds, 0 } };
+    utimensat(AT_FDCWD, fileName, times, 0);
+}
+
+ino_t indexInode(const char* indexName) {
+    struct stat info;
+    return stat(indexName, &info) ? 0 : info.st_ino;
+}
+
+// the lazily opened file has the contents writeFile wrote
+void checkContents(const char* fileName, bool flipped, const char* step) {
+    GEDCOMlazy* lazy = NULL;
+    if (createLazyGEDCOM((char*)fileName, &lazy).type != OK) {
+        fail(step, "createLazyGEDCOM");
+        return;
+    }
+    if (getLazyIndividualCount(lazy) != 2 * COUPLES || getLazyFamilyCount(lazy) != COUPLES) {
+        fail(step, "record counts");
+    }
+    char name[32];
+    char xref[32];
+    for (int i = 1; i <= 2 * COUPLES; i++) {
+        givenName(name, i, flipped);
+        snprintf(xref, sizeof(xref), "@I%d@", i);
+        Individual* byXref = getLazyIndividual(lazy, xref);
+        Individual* byPosition = getLazyIndividualAt(lazy, i - 1);
+        if (!byXref || byXref != byPosition || strcmp(byXref->givenName, name) || getLength(byXref->families) != 1) {
+            fail(step, "individual lookups");
+            break;
+        }
+    }
+    for (int i = 1; i <= COUPLES; i++) {
+        snprintf(xref, sizeof(xref), "@F%d@", i);
+        Family* family = getLazyFamily(lazy, xref);
+        givenName(name, 2 * i, flipped);
+        if (!family || family != getLazyFamilyAt(lazy, i - 1) || !family->wife || strcmp(family->wife->givenName, name)) {
+            fail(step, "family lookups");
+            break;
+        }
+    }
+    if (getLazyIndividual(lazy, "@I0@") || getLazyFamily(lazy, "@F0@")) {
+        fail(step, "finds a record that is not in the file");
+    }
+    deleteLazyGEDCOM(lazy);
+}
+
+// the damaged index is not used: the file opens with its contents and the index is written again
+void checkDamagedIndex(const char* fileName, const char* indexName, const char* step) {
+    ino_t damaged = indexInode(indexName);
+    checkContents(fileName, false, step);
+    if (indexInode(indexName) == damaged) {
+        fail(step, "the index is not rebuilt");
+    }
+}
+
+void writeIndexAt(const char* indexName, off_t offset, const void* bytes, size_t size) {
+    int fd = open(indexName, O_WRONLY);
+    if (fd < 0 || pwrite(fd, bytes, size, offset) != (ssize_t)size) {
+        printf("can not change %s\n", indexName);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+int main(void) {
+    char dir[] = "/tmp/lazyIndexXXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char fileName[512];
+    char indexName[512];
+    snprintf(fileName, sizeof(fileName), "%s/tree.ged", dir);
+    snprintf(indexName, sizeof(indexName), "%s/tree.gedidx", dir);
+    time_t modified = time(NULL) - 3600;
+
+    // the first open writes the index, the second uses it
+    writeFile(fileName, false);
+    setModified(fileName, modified);
+    checkContents(fileName, false, "first open");
+    ino_t written = indexInode(indexName);
+    if (!written) {
+        fail("first open", "no index is written");
+    }
+    checkContents(fileName, false, "second open");
+    if (indexInode(indexName) != written) {
+        fail("second open", "the index is written again");
+    }
+
+    // same size and modification time, records moved: only the hash tells them apart
+    struct stat before;
+    struct stat after;
+    stat(fileName, &before);
+    writeFile(fileName, true);
+    setModified(fileName, modified);
+    stat(fileName, &after);
+    if (before.st_size != after.st_size) {
+        fail("rewritten file", "the size changed");
+    }
+    checkContents(fileName, true, "rewritten file");
+    if (indexInode(indexName) == written) {
+        fail("rewritten file", "the index is not rebuilt");
+    }
+
+    // same contents, newer modification time
+    written = indexInode(indexName);
+    setModified(fileName, modified + 60);
+    checkContents(fileName, true, "touched file");
+    if (indexInode(indexName) == written) {
+        fail("touched file", "the index is not rebuilt");
+    }
+
+    // damaged indexes
+    writeFile(fileName, false);
+    checkContents(fileName, false, "new file");
+    struct stat index;
+    stat(indexName, &index);
+    if (truncate(indexName, index.st_size / 2)) {
+        fail("truncated index", "can not truncate");
+    }
+    checkDamagedIndex(fileName, indexName, "truncated index");
+    if (truncate(indexName, 0)) {
+        fail("empty index", "can not truncate");
+    }
+    checkDamagedIndex(fileName, indexName, "empty index");
+    writeIndexAt(indexName, 0, "X", 1);
+    checkDamagedIndex(fileName, indexName, "index with the wrong magic");
+    uint64_t pastEnd = (uint64_t)index.st_size * 2;
+    writeIndexAt(indexName, INDEX_SECTIONS_OFFSET, &pastEnd, sizeof(pastEnd));
+    checkDamagedIndex(fileName, indexName, "index with a section past its end");
+    uint64_t wrongSize = 8;
+    writeIndexAt(indexName, INDEX_SECTIONS_OFFSET + 8, &wrongSize, sizeof(wrongSize));
+    checkDamagedIndex(fileName, indexName, "index with a section of the wrong size");
+
+    unlink(indexName);
+    unlink(fileName);
+    rmdir(dir);
+    printf("%s: %d failed\n", failures ? "FAILED" : "OK", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,278 @@
+// Regression checks for the GEDCOM writers and the parser behaviour they rely on.
+// Build and run from the repository root:
+//   gcc -std=gnu11 -I. tests/roundTrip.c GEDCOMutilities.c LinkedListAPI.c -lpthread -o roundTrip
+//   ./roundTrip gedApp/uploads/*.ged tests/noteRecords.ged
+// Prints each failed check and exits with 1 if there was one.
+
+#include "GEDCOMutilities.h"
+#include "LinkedListAPI.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+int failures = 0;
+
+void fail(const char* fileName, const char* check) {
+    printf("FAIL %s: %s\n", fileName, check);
+    failures++;
+}
+
+// whole file as a string, or NULL
+char* readWholeFile(const char* fileName, long* size) {
+    FILE* file = fopen(fileName, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* data = malloc(*size + 1);
+    if (fread(data, 1, *size, file) != (size_t)*size) {
+        free(data);
+        data = NULL;
+    } else {
+        data[*size] = '\0';
+    }
+    fclose(file);
+    return data;
+}
+
+bool sameFiles(const char* first, const char* second) {
+    long firstSize = 0;
+    long secondSize = 0;
+    char* firstData = readWholeFile(first, &firstSize);
+    char* secondData = readWholeFile(second, &secondSize);
+    bool same = firstData && secondData && firstSize == secondSize && !memcmp(firstData, secondData, firstSize);
+    free(firstData);
+    free(secondData);
+    return same;
+}
+
+// printGEDCOM of the parsed file, or NULL if it does not parse
+char* printParsed(const char* fileName) {
+    GEDCOMobject* obj = NULL;
+    if (createGEDCOM((char*)fileName, &obj).type != OK) {
+        return NULL;
+    }
+    char* text = printGEDCOM(obj);
+    deleteGEDCOM(obj);
+    return text;
+}
+
+// writes obj with writeGEDCOM, checks that it reads back as the original and that the threaded writer
+// gives the same bytes
+void checkWrite(const char* fileName, const GEDCOMobject* obj, const char* original, const char* dir, const char* kind) {
+    char written[512];
+    char threaded[512];
+    char check[256];
+    snprintf(written, sizeof(written), "%s/%s.ged", dir, kind);
+    snprintf(threaded, sizeof(threaded), "%s/%s-threaded.ged", dir, kind);
+
+    if (writeGEDCOM(written, obj).type != OK) {
+        snprintf(check, sizeof(check), "writeGEDCOM of %s records", kind);
+        fail(fileName, check);
+        return;
+    }
+    char* reparsed = printParsed(written);
+    if (!reparsed || strcmp(reparsed, original)) {
+        snprintf(check, sizeof(check), "%s records read back differently", kind);
+        fail(fileName, check);
+    }
+    free(reparsed);
+
+    for (int threads = 1; threads <= 4; threads *= 2) {
+        if (writeGEDCOMthreaded(threaded, obj, threads).type != OK || !sameFiles(written, threaded)) {
+            snprintf(check, sizeof(check), "writeGEDCOMthreaded with %d threads differs for %s records", threads, kind);
+            fail(fileName, check);
+        }
+    }
+
+    // writing what was read back gives the same file again
+    GEDCOMobject* copy = NULL;
+    if (createGEDCOM(written, &copy).type == OK) {
+        if (writeGEDCOM(threaded, copy).type != OK || !sameFiles(written, threaded)) {
+            snprintf(check, sizeof(check), "rewriting the written file changes it for %s records", kind);
+            fail(fileName, check);
+        }
+        deleteGEDCOM(copy);
+    }
+    unlink(written);
+    unlink(threaded);
+}
+
+void checkRoundTrip(const char* fileName, const char* dir) {
+    GEDCOMobject* obj = NULL;
+    if (createGEDCOM((char*)fileName, &obj).type != OK) {
+        fail(fileName, "does not parse");
+        return;
+    }
+    char* original = printGEDCOM(obj);
+    // unmodified records are copied from the source
+    checkWrite(fileName, obj, original, dir, "copied");
+
+    // modified ones are formatted from the object
+    ListIterator iter = createIterator(obj->individuals);
+    for (void* data = nextElement(&iter); data; data = nextElement(&iter)) {
+        markIndividualModified((Individual*)data);
+    }
+    iter = createIterator(obj->families);
+    for (void* data = nextElement(&iter); data; data = nextElement(&iter)) {
+        markFamilyModified((Family*)data);
+    }
+    checkWrite(fileName, obj, original, dir, "formatted");
+
+    free(original);
+    deleteGEDCOM(obj);
+}
+
+// a file with enough records for the threaded writer to use several shards, with NOTE records between them
+void writeLargeFile(const char* fileName, int couples) {
+    FILE* file = fopen(fileName, "w");
+    if (!file) {
+        return;
+    }
+    fprintf(file, "0 HEAD\n1 SOUR PAF\n1 GEDC\n2 VERS 5.5\n1 CHAR ASCII\n1 SUBM @U1@\n");
+    for (int i = 1; i <= couples; i++) {
+        fprintf(file, "0 @I%d@ INDI\n1 NAME Husband%d /Family%d/\n1 SEX M\n1 FAMS @F%d@\n", 2 * i - 1, i, i, i);
+        fprintf(file, "1 BIRT\n2 DATE %d JAN 1900\n2 PLAC Town %d\n", i % 28 + 1, i);
+        fprintf(file, "0 @N%d@ NOTE note %d\n1 CONT more text\n", i, i);
+        fprintf(file, "0 @I%d@ INDI\n1 NAME Wife%d /Family%d/\n1 SEX F\n1 FAMS @F%d@\n", 2 * i, i, i, i);
+        if (i > 1) {
+            fprintf(file, "1 FAMC @F%d@\n", i - 1);
+        }
+    }
+    for (int i = 1; i <= couples; i++) {
+        fprintf(file, "0 @F%d@ FAM\n1 HUSB @I%d@\n1 WIFE @I%d@\n", i, 2 * i - 1, 2 * i);
+        if (i < couples) {
+            fprintf(file, "1 CHIL @I%d@\n", 2 * i + 2);
+        }
+    }
+    fprintf(file, "0 @U1@ SUBM\n1 NAME Submitter\n0 TRLR\n");
+    fclose(file);
+}
+
+// resolvers numbering the record being streamed by the row in the context, not by its address
+int rowXref(const void* record, void* context) {
+    return *(int*)context;
+}
+
+int noXref(const void* record, void* context) {
+    return 0;
+}
+
+// streams rows through one reused Individual: every row gets its own xref and reads back
+void checkStreamingWriter(const char* dir) {
+    GEDCOMobject* obj = NULL;
+    if (createGEDCOM("gedApp/uploads/simpleValid.ged", &obj).type != OK) {
+        fail("streaming writer", "simpleValid.ged does not parse");
+        return;
+    }
+    char fileName[512];
+    snprintf(fileName, sizeof(fileName), "%s/streamed.ged", dir);
+    int row = 0;
+    if (openGEDCOMwriter(fileName, NULL, &noXref, &row) || openGEDCOMwriter(fileName, &rowXref, NULL, &row)) {
+        fail("streaming writer", "opens without a resolver");
+    }
+    GEDCOMwriter* writer = openGEDCOMwriter(fileName, &rowXref, &noXref, &row);
+    if (!writer) {
+        fail("streaming writer", "openGEDCOMwriter");
+        deleteGEDCOM(obj);
+        return;
+    }
+    Individual person;
+    char givenName[32];
+    person.givenName = givenName;
+    person.surname = "Streamed";
+    person.events = initializeList(&printEvent, &deleteEvent, &compareEvents);
+    person.families = initializeList(&printFamily, &deleteFamily, &compareFamilies);
+    person.otherFields = initializeList(&printField, &deleteField, &compareFields);
+
+    if (writeIndividualRecord(writer, &person).type != INV_HEADER) {
+        fail("streaming writer", "a record before the header is not INV_HEADER");
+    }
+    if (writeHeaderRecord(writer, obj->header).type != OK || writeSubmitterRecord(writer, obj->submitter).type != OK) {
+        fail("streaming writer", "writing the header and submitter");
+    }
+    if (writeHeaderRecord(writer, obj->header).type != INV_HEADER) {
+        fail("streaming writer", "a second header is not INV_HEADER");
+    }
+    if (writeIndividualRecord(writer, NULL).type != OTHER_ERROR) {
+        fail("streaming writer", "a NULL record is not OTHER_ERROR");
+    }
+    if (writeIndividualRecord(writer, &person).type != INV_RECORD) {
+        fail("streaming writer", "a record without an xref is not INV_RECORD");
+    }
+    for (row = 1; row <= 3; row++) {
+        snprintf(givenName, sizeof(givenName), "Row%d", row);
+        if (writeIndividualRecord(writer, &person).type != OK) {
+            fail("streaming writer", "writeIndividualRecord");
+        }
+    }
+    if (closeGEDCOMwriter(writer).type != OK) {
+        fail("streaming writer", "closeGEDCOMwriter");
+    }
+    if (closeGEDCOMwriter(NULL).type != OTHER_ERROR) {
+        fail("streaming writer", "closing NULL is not OTHER_ERROR");
+    }
+    deleteGEDCOM(obj);
+
+    obj = NULL;
+    if (createGEDCOM(fileName, &obj).type != OK) {
+        fail("streaming writer", "the streamed file does not parse");
+    } else {
+        if (getLength(obj->individuals) != 3) {
+            fail("streaming writer", "rows share an xref");
+        }
+        ListIterator iter = createIterator(obj->individuals);
+        Individual* read = NULL;
+        for (row = 1; (read = nextElement(&iter)); row++) {
+            snprintf(givenName, sizeof(givenName), "Row%d", row);
+            if (strcmp(read->givenName, givenName)) {
+                fail("streaming writer", "a row reads back wrongly");
+            }
+        }
+        deleteGEDCOM(obj);
+    }
+    unlink(fileName);
+}
+
+// printGEDCOM of fileName contains text, or does not when present is false
+void checkPrinted(const char* fileName, const char* text, bool present) {
+    char* printed = printParsed(fileName);
+    if (!printed || !strstr(printed, text) != !present) {
+        char check[256];
+        snprintf(check, sizeof(check), "printGEDCOM %s \"%s\"", present ? "lacks" : "contains", text);
+        fail(fileName, check);
+    }
+    free(printed);
+}
+
+int main(int argc, char** argv) {
+    char dir[] = "/tmp/roundTripXXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) {
+        checkRoundTrip(argv[i], dir);
+    }
+    char large[512];
+    snprintf(large, sizeof(large), "%s/large.ged", dir);
+    writeLargeFile(large, 2500);
+    checkRoundTrip(large, dir);
+    unlink(large);
+    checkStreamingWriter(dir);
+
+    // values start after the single space that follows the tag
+    checkPrinted("gedApp/uploads/simpleValid.ged", "DATE = 30 NOV 2000", true);
+    checkPrinted("tests/noteRecords.ged", "=  ", false);
+    // lines of NOTE and SOUR records do not become fields of the record before them
+    checkPrinted("tests/noteRecords.ged", "CONT", false);
+    checkPrinted("tests/noteRecords.ged", "TITL", false);
+
+    rmdir(dir);
+    printf("%s: %d failed\n", failures ? "FAILED" : "OK", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,220 @@
+// Checks for binary snapshots: saved and loaded snapshots give the same GEDCOM, and damaged files are rejected.
+// Build and run from the repository root:
+//   gcc -std=gnu11 -I. tests/snapshot.c GEDCOMutilities.c LinkedListAPI.c -lpthread -o snapshot
+//   ./snapshot gedApp/uploads/*.ged
+// Prints each failed check and exits with 1 if there was one.
+
+#include "GEDCOMutilities.h"
+#include "LinkedListAPI.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// offsets in the snapshot header: magic, version, byte order, file size, then the sections
+// (offset and size of each) after the header and submitter values
+#define VERSION_OFFSET 8
+#define BYTE_ORDER_OFFSET 12
+#define FILE_SIZE_OFFSET 16
+#define SECTIONS_OFFSET 64
+#define SECTION_SIZE 16
+#define INDIVIDUAL_SECTION 0
+#define STRING_SECTION 5
+
+int failures = 0;
+
+void fail(const char* fileName, const char* check) {
+    printf("FAIL %s: %s\n", fileName, check);
+    failures++;
+}
+
+bool copyFile(const char* from, const char* to) {
+    FILE* in = fopen(from, "rb");
+    FILE* out = fopen(to, "wb");
+    char buffer[4096];
+    size_t read = 0;
+    while (in && out && (read = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        fwrite(buffer, 1, read, out);
+    }
+    bool copied = in && out;
+    if (in) {
+        fclose(in);
+    }
+    if (out && fclose(out)) {
+        copied = false;
+    }
+    return copied;
+}
+
+uint64_t readAt(const char* fileName, off_t offset, size_t size) {
+    uint64_t value = 0;
+    int fd = open(fileName, O_RDONLY);
+    if (fd >= 0) {
+        if (pread(fd, &value, size, offset) != (ssize_t)size) {
+            value = 0;
+        }
+        close(fd);
+    }
+    return value;
+}
+
+void writeAt(const char* fileName, off_t offset, const void* bytes, size_t size) {
+    int fd = open(fileName, O_WRONLY);
+    if (fd >= 0) {
+        if (pwrite(fd, bytes, size, offset) != (ssize_t)size) {
+            printf("can not change %s\n", fileName);
+        }
+        close(fd);
+    }
+}
+
+// a copy of the snapshot with size bytes at offset replaced must not load
+void checkDamaged(const char* fileName, const char* snapshot, const char* damaged, off_t offset,
+                  const void* bytes, size_t size, const char* check) {
+    if (!copyFile(snapshot, damaged)) {
+        fail(fileName, "can not copy the snapshot");
+        return;
+    }
+    writeAt(damaged, offset, bytes, size);
+    GEDCOMsnapshot* loaded = NULL;
+    if (loadSnapshot(damaged, &loaded).type == OK || loaded) {
+        fail(fileName, check);
+        closeSnapshot(loaded);
+    }
+}
+
+void checkTruncated(const char* fileName, const char* snapshot, const char* damaged, off_t length) {
+    copyFile(snapshot, damaged);
+    if (truncate(damaged, length)) {
+        return;
+    }
+    GEDCOMsnapshot* loaded = NULL;
+    if (loadSnapshot(damaged, &loaded).type == OK || loaded) {
+        char check[64];
+        snprintf(check, sizeof(check), "loads the snapshot cut to %lld bytes", (long long)length);
+        fail(fileName, check);
+        closeSnapshot(loaded);
+    }
+}
+
+void checkSnapshot(const char* fileName, const char* dir) {
+    GEDCOMobject* obj = NULL;
+    if (createGEDCOM((char*)fileName, &obj).type != OK) {
+        fail(fileName, "does not parse");
+        return;
+    }
+    char snapshot[512];
+    char damaged[512];
+    snprintf(snapshot, sizeof(snapshot), "%s/saved.snap", dir);
+    snprintf(damaged, sizeof(damaged), "%s/damaged.snap", dir);
+    if (saveSnapshot(snapshot, obj).type != OK) {
+        fail(fileName, "saveSnapshot");
+        deleteGEDCOM(obj);
+        return;
+    }
+
+    // the snapshot holds the same GEDCOM
+    GEDCOMsnapshot* loaded = NULL;
+    if (loadSnapshot(snapshot, &loaded).type != OK) {
+        fail(fileName, "loadSnapshot of a saved snapshot");
+    } else {
+        if (getSnapshotIndividualCount(loaded) != getLength(obj->individuals) ||
+            getSnapshotFamilyCount(loaded) != getLength(obj->families)) {
+            fail(fileName, "record counts differ");
+        }
+        GEDCOMobject* copy = snapshotToGEDCOM(loaded);
+        char* original = printGEDCOM(obj);
+        char* restored = copy ? printGEDCOM(copy) : NULL;
+        if (!restored || strcmp(original, restored)) {
+            fail(fileName, "snapshotToGEDCOM prints differently");
+        }
+        free(original);
+        free(restored);
+        if (copy) {
+            deleteGEDCOM(copy);
+        }
+        closeSnapshot(loaded);
+    }
+    deleteGEDCOM(obj);
+
+    off_t size = (off_t)readAt(snapshot, FILE_SIZE_OFFSET, 8);
+    char magic[8] = "";
+    int fd = open(snapshot, O_RDONLY);
+    if (fd < 0 || pread(fd, magic, sizeof(magic), 0) != sizeof(magic) || strcmp(magic, "GEDSNAP") ||
+        readAt(snapshot, BYTE_ORDER_OFFSET, 4) != 0x01020304u || lseek(fd, 0, SEEK_END) != size) {
+        fail(fileName, "the snapshot header is not laid out as this test expects");
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    checkTruncated(fileName, snapshot, damaged, 0);
+    checkTruncated(fileName, snapshot, damaged, SECTIONS_OFFSET);
+    checkTruncated(fileName, snapshot, damaged, size / 2);
+    checkTruncated(fileName, snapshot, damaged, size - 1);
+
+    checkDamaged(fileName, snapshot, damaged, 0, "X", 1, "loads a snapshot with the wrong magic");
+    uint32_t version = (uint32_t)readAt(snapshot, VERSION_OFFSET, 4) + 1;
+    checkDamaged(fileName, snapshot, damaged, VERSION_OFFSET, &version, 4, "loads a snapshot of another version");
+    uint32_t byteOrder = __builtin_bswap32((uint32_t)readAt(snapshot, BYTE_ORDER_OFFSET, 4));
+    checkDamaged(fileName, snapshot, damaged, BYTE_ORDER_OFFSET, &byteOrder, 4, "loads a snapshot of the other byte order");
+    uint64_t fileSize = size + 8;
+    checkDamaged(fileName, snapshot, damaged, FILE_SIZE_OFFSET, &fileSize, 8, "loads a snapshot with the wrong size");
+
+    off_t individuals = SECTIONS_OFFSET + INDIVIDUAL_SECTION * SECTION_SIZE;
+    off_t strings = SECTIONS_OFFSET + STRING_SECTION * SECTION_SIZE;
+    // aligned, so only the bounds check can reject it
+    uint64_t offset = (size + 8) & ~7;
+    checkDamaged(fileName, snapshot, damaged, individuals, &offset, 8, "loads a section starting past the end");
+    offset = readAt(snapshot, individuals, 8) + 4;
+    checkDamaged(fileName, snapshot, damaged, individuals, &offset, 8, "loads a misaligned section");
+    uint64_t sectionSize = size - readAt(snapshot, strings, 8) + 1;
+    checkDamaged(fileName, snapshot, damaged, strings + 8, &sectionSize, 8, "loads a section ending past the end");
+    sectionSize = UINT64_MAX - 7;
+    checkDamaged(fileName, snapshot, damaged, strings + 8, &sectionSize, 8, "loads a section whose end overflows");
+    sectionSize = readAt(snapshot, individuals + 8, 8) - 1;
+    checkDamaged(fileName, snapshot, damaged, individuals + 8, &sectionSize, 8, "loads a section of partial records");
+    // the last string is not terminated
+    off_t lastByte = (off_t)(readAt(snapshot, strings, 8) + readAt(snapshot, strings + 8, 8) - 1);
+    checkDamaged(fileName, snapshot, damaged, lastByte, "x", 1, "loads a string section that is not terminated");
+
+    // indices in the records are checked when they are followed
+    if (readAt(snapshot, individuals + 8, 8) && copyFile(snapshot, damaged)) {
+        uint32_t badString = UINT32_MAX - 1;
+        writeAt(damaged, (off_t)readAt(snapshot, individuals, 8), &badString, 4);
+        if (loadSnapshot(damaged, &loaded).type == OK) {
+            if (getSnapshotGivenName(loaded, 0)) {
+                fail(fileName, "follows a string offset past the string section");
+            }
+            GEDCOMobject* copy = snapshotToGEDCOM(loaded);
+            if (copy) {
+                deleteGEDCOM(copy);
+            }
+            closeSnapshot(loaded);
+        }
+    }
+    unlink(damaged);
+    unlink(snapshot);
+}
+
+int main(int argc, char** argv) {
+    char dir[] = "/tmp/snapshotXXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) {
+        checkSnapshot(argv[i], dir);
+    }
+    GEDCOMsnapshot* loaded = NULL;
+    char missing[512];
+    snprintf(missing, sizeof(missing), "%s/missing.snap", dir);
+    if (loadSnapshot(missing, &loaded).type != INV_FILE || loaded) {
+        fail(missing, "a missing file is not INV_FILE");
+    }
+    rmdir(dir);
+    printf("%s: %d failed\n", failures ? "FAILED" : "OK", failures);
+    return failures ? 1 : 0;
+}
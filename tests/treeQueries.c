@@ -0,0 +1,410 @@
+// Checks that the batched and set-based tree queries agree with getDescendantListN and getAncestorListN,
+// and that getTreeStats agrees with both, on a generated random tree.
+// Build and run from the repository root:
+//   gcc -std=gnu11 -O2 -I. tests/treeQueries.c GEDCOMutilities.c LinkedListAPI.c -lpthread -o treeQueries
+//   ./treeQueries
+// Prints each failed check and exits with 1 if there was one.
+
+#include "GEDCOMutilities.h"
+#include "LinkedListAPI.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define PEOPLE 3000
+#define MAX_FAMILIES 2000
+#define MAX_CHILDREN 5
+// no limit for getDescendantListN and getAncestorListN, which need a positive maxGen
+#define ALL_GENERATIONS 1000
+
+int failures = 0;
+
+void fail(const char* check, int person) {
+    printf("FAIL %s (person %d)\n", check, person);
+    failures++;
+}
+
+// the generated tree; children always come after their parents, so there are no cycles
+typedef struct {
+    int husband;
+    int wife;
+    int children[MAX_CHILDREN];
+    int childCount;
+} TestFamily;
+
+TestFamily families[MAX_FAMILIES];
+int familyCount;
+int generation[PEOPLE];
+int childCount[PEOPLE];
+
+uint64_t seed = 88172645463325252ull;
+
+int randomBelow(int n) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return (int)(seed % (uint64_t)n);
+}
+
+// children are at most spread people after their parents; the smaller it is, the more generations the tree has
+void generateTree(int count, int spread) {
+    familyCount = count;
+    int parentFamilies[PEOPLE] = { 0 };
+    for (int f = 0; f < familyCount; f++) {
+        TestFamily* family = &families[f];
+        family->husband = randomBelow(20) ? randomBelow(PEOPLE - 1) : -1;
+        family->wife = randomBelow(20) ? randomBelow(PEOPLE - 1) : -1;
+        if (family->wife == family->husband) {
+            family->wife = -1;
+        }
+        int first = (family->husband > family->wife ? family->husband : family->wife) + 1;
+        family->childCount = 0;
+        for (int c = randomBelow(MAX_CHILDREN + 1); c > 0 && first < PEOPLE; c--) {
+            int child = first + randomBelow(PEOPLE - first < spread ? PEOPLE - first : spread);
+            bool repeated = parentFamilies[child] >= 2;
+            for (int i = 0; i < family->childCount; i++) {
+                repeated = repeated || family->children[i] == child;
+            }
+            if (!repeated) {
+                family->children[family->childCount++] = child;
+                parentFamilies[child]++;
+            }
+        }
+    }
+
+    // longest chain of ancestors, and distinct children over the families of each spouse
+    for (int p = 0; p < PEOPLE; p++) {
+        generation[p] = 0;
+        int seen[PEOPLE / 8 + 1];
+        int seenCount = 0;
+        for (int f = 0; f < familyCount; f++) {
+            const TestFamily* family = &families[f];
+            for (int i = 0; i < family->childCount; i++) {
+                int child = family->children[i];
+                if (child == p) {
+                    int parents[2] = { family->husband, family->wife };
+                    for (int j = 0; j < 2; j++) {
+                        if (parents[j] >= 0 && generation[parents[j]] + 1 > generation[p]) {
+                            generation[p] = generation[parents[j]] + 1;
+                        }
+                    }
+                }
+                if (family->husband == p || family->wife == p) {
+                    bool counted = false;
+                    for (int k = 0; k < seenCount; k++) {
+                        counted = counted || seen[k] == child;
+                    }
+                    if (!counted) {
+                        seen[seenCount++] = child;
+                    }
+                }
+            }
+        }
+        childCount[p] = seenCount;
+    }
+}
+
+void writeTree(const char* fileName) {
+    FILE* file = fopen(fileName, "w");
+    if (!file) {
+        return;
+    }
+    fprintf(file, "0 HEAD\n1 SOUR PAF\n1 GEDC\n2 VERS 5.5\n1 CHAR ASCII\n1 SUBM @U1@\n");
+    for (int p = 0; p < PEOPLE; p++) {
+        fprintf(file, "0 @I%d@ INDI\n1 NAME Person%d /Tree/\n", p, p);
+        for (int f = 0; f < familyCount; f++) {
+            if (families[f].husband == p || families[f].wife == p) {
+                fprintf(file, "1 FAMS @F%d@\n", f);
+            }
+            for (int i = 0; i < families[f].childCount; i++) {
+                if (families[f].children[i] == p) {
+                    fprintf(file, "1 FAMC @F%d@\n", f);
+                }
+            }
+        }
+    }
+    for (int f = 0; f < familyCount; f++) {
+        fprintf(file, "0 @F%d@ FAM\n", f);
+        if (families[f].husband >= 0) {
+            fprintf(file, "1 HUSB @I%d@\n", families[f].husband);
+        }
+        if (families[f].wife >= 0) {
+            fprintf(file, "1 WIFE @I%d@\n", families[f].wife);
+        }
+        for (int i = 0; i < families[f].childCount; i++) {
+            fprintf(file, "1 CHIL @I%d@\n", families[f].children[i]);
+        }
+    }
+    fprintf(file, "0 @U1@ SUBM\n1 NAME Submitter\n0 TRLR\n");
+    fclose(file);
+}
+
+void doNotDeleteRecord(void* record) {
+    (void)record;
+}
+
+// frees the generation lists without the records; getDescendantListN's generations would delete them
+void deleteGenerations(List* generations) {
+    ListIterator it = createIterator(*generations);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        ((List*)data)->deleteData = &doNotDeleteRecord;
+    }
+    clearList(generations);
+}
+
+bool sameGenerations(List first, List second) {
+    if (getLength(first) != getLength(second)) {
+        return false;
+    }
+    ListIterator firstIt = createIterator(first);
+    ListIterator secondIt = createIterator(second);
+    for (void* a = nextElement(&firstIt), *b = nextElement(&secondIt); a; a = nextElement(&firstIt), b = nextElement(&secondIt)) {
+        List* firstGeneration = (List*)a;
+        List* secondGeneration = (List*)b;
+        if (getLength(*firstGeneration) != getLength(*secondGeneration)) {
+            return false;
+        }
+        ListIterator i = createIterator(*firstGeneration);
+        ListIterator j = createIterator(*secondGeneration);
+        for (void* x = nextElement(&i), *y = nextElement(&j); x; x = nextElement(&i), y = nextElement(&j)) {
+            if (x != y) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// the set holds exactly the people of all generations together; people are numbered by their given name
+bool setMatchesGenerations(const RecordIndex* index, const IndividualSet* set, List generations, Individual** people) {
+    bool member[PEOPLE] = { false };
+    int count = 0;
+    ListIterator it = createIterator(generations);
+    for (void* data = nextElement(&it); data; data = nextElement(&it)) {
+        ListIterator jt = createIterator(*(List*)data);
+        for (void* person = nextElement(&jt); person; person = nextElement(&jt)) {
+            int p = atoi(((Individual*)person)->givenName + strlen("Person"));
+            count += !member[p];
+            member[p] = true;
+        }
+    }
+    if (getSetSize(set) != count) {
+        return false;
+    }
+    for (int p = 0; p < PEOPLE; p++) {
+        if (setContains(index, set, people[p]) != member[p]) {
+            return false;
+        }
+    }
+    List list = setToList(index, set);
+    bool same = getLength(list) == count;
+    clearList(&list);
+    return same;
+}
+
+void checkBatchedDescendants(const GEDCOMobject* obj, Individual** people) {
+    unsigned int limits[] = { 1, 3, ALL_GENERATIONS };
+    for (int l = 0; l < 3; l++) {
+        List* batched = getDescendantListsN(obj, (const Individual**)people, PEOPLE, limits[l]);
+        for (int p = 0; p < PEOPLE; p++) {
+            List single = getDescendantListN(obj, people[p], limits[l]);
+            if (!sameGenerations(batched[p], single)) {
+                fail("getDescendantListsN differs from getDescendantListN", p);
+            }
+            deleteGenerations(&single);
+            deleteGenerations(&batched[p]);
+        }
+        free(batched);
+    }
+    // NULL entries give empty results
+    const Individual* withNull[2] = { NULL, people[0] };
+    List* batched = getDescendantListsN(obj, withNull, 2, 3);
+    List single = getDescendantListN(obj, people[0], 3);
+    if (getLength(batched[0]) || !sameGenerations(batched[1], single)) {
+        fail("getDescendantListsN with a NULL entry", 0);
+    }
+    deleteGenerations(&single);
+    deleteGenerations(&batched[0]);
+    deleteGenerations(&batched[1]);
+    free(batched);
+}
+
+void checkSets(const GEDCOMobject* obj, const RecordIndex* index, Individual** people) {
+    int limits[] = { 1, 3, 0 };
+    for (int l = 0; l < 3; l++) {
+        int listLimit = limits[l] ? limits[l] : ALL_GENERATIONS;
+        for (int p = 0; p < PEOPLE; p++) {
+            IndividualSet* set = getDescendantSet(index, people[p], limits[l]);
+            List generations = getDescendantListN(obj, people[p], listLimit);
+            if (!setMatchesGenerations(index, set, generations, people)) {
+                fail("getDescendantSet differs from getDescendantListN", p);
+            }
+            deleteGenerations(&generations);
+            deleteIndividualSet(set);
+
+            set = getAncestorSet(index, people[p], limits[l]);
+            generations = getAncestorListN(obj, people[p], listLimit);
+            if (!setMatchesGenerations(index, set, generations, people)) {
+                fail("getAncestorSet differs from getAncestorListN", p);
+            }
+            deleteGenerations(&generations);
+            deleteIndividualSet(set);
+        }
+    }
+
+    // the combinations agree with membership in both sets
+    for (int p = 0; p + 1 < PEOPLE; p += PEOPLE / 50) {
+        IndividualSet* a = getDescendantSet(index, people[p], 0);
+        IndividualSet* b = getAncestorSet(index, people[PEOPLE - 1 - p], 0);
+        IndividualSet* both = intersectSets(a, b);
+        IndividualSet* either = unionSets(a, b);
+        IndividualSet* onlyA = subtractSets(a, b);
+        int bothCount = 0;
+        int eitherCount = 0;
+        int onlyACount = 0;
+        bool contained = true;
+        for (int q = 0; q < PEOPLE; q++) {
+            bool inA = setContains(index, a, people[q]);
+            bool inB = setContains(index, b, people[q]);
+            bothCount += inA && inB;
+            eitherCount += inA || inB;
+            onlyACount += inA && !inB;
+            contained = contained && setContains(index, both, people[q]) == (inA && inB) &&
+                setContains(index, either, people[q]) == (inA || inB) && setContains(index, onlyA, people[q]) == (inA && !inB);
+        }
+        if (!contained || getSetSize(both) != bothCount || getSetSize(either) != eitherCount || getSetSize(onlyA) != onlyACount) {
+            fail("set combinations", p);
+        }
+        deleteIndividualSet(a);
+        deleteIndividualSet(b);
+        deleteIndividualSet(both);
+        deleteIndividualSet(either);
+        deleteIndividualSet(onlyA);
+    }
+}
+
+// returns how many of the counts are estimated in approximate mode
+int checkTreeStats(const GEDCOMobject* obj, const RecordIndex* index, Individual** people) {
+    IndividualStats* stats = getTreeStats(obj, false);
+    IndividualStats* approximate = getTreeStats(obj, true);
+    int estimated = 0;
+    if (!stats || !approximate) {
+        fail("getTreeStats returns NULL", -1);
+        free(stats);
+        free(approximate);
+        return estimated;
+    }
+    for (int p = 0; p < PEOPLE; p++) {
+        IndividualSet* descendants = getDescendantSet(index, people[p], 0);
+        IndividualSet* ancestors = getAncestorSet(index, people[p], 0);
+        unsigned int descendantCount = getSetSize(descendants);
+        unsigned int ancestorCount = getSetSize(ancestors);
+        if (stats[p].descendants != descendantCount || stats[p].ancestors != ancestorCount) {
+            fail("getTreeStats counts differ from the sets", p);
+        }
+        if (stats[p].generation != generation[p] || stats[p].children != (unsigned int)childCount[p]) {
+            fail("getTreeStats generation or children", p);
+        }
+        if (approximate[p].generation != stats[p].generation || approximate[p].children != stats[p].children) {
+            fail("approximate getTreeStats generation or children", p);
+        }
+        // small sets stay exact; larger ones are estimates
+        unsigned int counts[2][2] = { { approximate[p].descendants, descendantCount }, { approximate[p].ancestors, ancestorCount } };
+        for (int i = 0; i < 2; i++) {
+            unsigned int estimate = counts[i][0];
+            unsigned int exact = counts[i][1];
+            if (exact <= 1024 ? estimate != exact : estimate < exact * 0.9 || estimate > exact * 1.1) {
+                fail("approximate getTreeStats count", p);
+            }
+            estimated += exact > 1024;
+        }
+        deleteIndividualSet(descendants);
+        deleteIndividualSet(ancestors);
+    }
+    free(stats);
+    free(approximate);
+    return estimated;
+}
+
+// someone who is their own grandparent: getTreeStats has no counts to give
+void checkCycle(const char* fileName) {
+    FILE* file = fopen(fileName, "w");
+    if (!file) {
+        return;
+    }
+    fprintf(file, "0 HEAD\n1 SOUR PAF\n1 GEDC\n2 VERS 5.5\n1 CHAR ASCII\n1 SUBM @U1@\n"
+        "0 @I1@ INDI\n1 NAME Top /A/\n1 FAMS @F1@\n"
+        "0 @I2@ INDI\n1 NAME B /A/\n1 FAMC @F1@\n1 FAMS @F2@\n1 FAMC @F3@\n"
+        "0 @I3@ INDI\n1 NAME C /A/\n1 FAMC @F2@\n1 FAMS @F3@\n"
+        "0 @F1@ FAM\n1 HUSB @I1@\n1 CHIL @I2@\n"
+        "0 @F2@ FAM\n1 HUSB @I2@\n1 CHIL @I3@\n"
+        "0 @F3@ FAM\n1 HUSB @I3@\n1 CHIL @I2@\n"
+        "0 @U1@ SUBM\n1 NAME Submitter\n0 TRLR\n");
+    fclose(file);
+    GEDCOMobject* obj = NULL;
+    if (createGEDCOM((char*)fileName, &obj).type != OK) {
+        fail("the cyclic file does not parse", -1);
+        return;
+    }
+    IndividualStats* stats = getTreeStats(obj, false);
+    if (stats) {
+        fail("getTreeStats gives counts for a tree with a cycle", -1);
+        free(stats);
+    }
+    deleteGEDCOM(obj);
+    unlink(fileName);
+}
+
+// generates, writes and parses a tree, then runs the checks on it.  The list functions are slow on large sets,
+// so only getTreeStats is checked when lists is false
+void checkTree(const char* fileName, int count, int spread, bool lists) {
+    generateTree(count, spread);
+    writeTree(fileName);
+    GEDCOMobject* obj = NULL;
+    if (createGEDCOM((char*)fileName, &obj).type != OK || getLength(obj->individuals) != PEOPLE) {
+        fail("the generated tree does not parse", -1);
+        return;
+    }
+    unlink(fileName);
+    Individual** people = malloc(PEOPLE * sizeof(Individual*));
+    ListIterator it = createIterator(obj->individuals);
+    for (int p = 0; p < PEOPLE; p++) {
+        people[p] = (Individual*)nextElement(&it);
+    }
+    RecordIndex* index = createRecordIndex(obj);
+
+    if (lists) {
+        checkBatchedDescendants(obj, people);
+        checkSets(obj, index, people);
+    }
+    if (!checkTreeStats(obj, index, people) && !lists) {
+        fail("no set is large enough to be estimated", -1);
+    }
+
+    deleteRecordIndex(index);
+    free(people);
+    deleteGEDCOM(obj);
+}
+
+int main(void) {
+    char dir[] = "/tmp/treeQueriesXXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char fileName[512];
+    snprintf(fileName, sizeof(fileName), "%s/tree.ged", dir);
+    // about 20 generations
+    checkTree(fileName, 1100, 200, true);
+    // denser and deeper, with descendant and ancestor sets above the approximation limit
+    checkTree(fileName, 2000, 60, false);
+    snprintf(fileName, sizeof(fileName), "%s/cycle.ged", dir);
+    checkCycle(fileName);
+
+    rmdir(dir);
+    printf("%s: %d failed\n", failures ? "FAILED" : "OK", failures);
+    return failures ? 1 : 0;
+}